@@ -90,6 +90,7 @@ struct CalculationParameters : public QCCalculationParametersBase {
 		initialize<bool>  ("no_compute",false,"if true use orbitals on disk, set value to computed");
 		initialize<bool>  ("save",true,"if true save orbitals to disk");
 		initialize<int>   ("maxsub",10,"size of iterative subspace ... set to 0 or 1 to disable");
+		initialize<int>   ("incremental_fock",0,"build the Coulomb and XC potentials from the density change, with a full build every n iterations ... set to 0 to disable");
 		initialize<double> ("orbitalshift",0.0,"scf orbital shift: shift the occ orbitals to lower energies");
 		initialize<int>    ("npt_plot",101,"no. of points to use in each dim for plots");
 //		initialize<Tensor<double> > ("plot_cell",Tensor<double>(),"lo hi in each dimension for plotting (default is all space)");
@@ -205,6 +206,7 @@ struct CalculationParameters : public QCCalculationParametersBase {
 	bool restart_cphf() const {return get<bool>("restart_cphf");}
 
 	int maxsub() const {return get<int>("maxsub");}
+	int incremental_fock() const {return get<int>("incremental_fock");}
 	double maxrotn() const {return get<double>("maxrotn");}
 
 	int vnucextra() const {return get<int>("vnucextra");}
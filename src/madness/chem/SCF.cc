@@ -1686,7 +1686,9 @@ void SCF::loadbal(World& world, functionT& arho, functionT& brho,
     if (world.size() == 1)
         return;
 
-    LoadBalanceDeux<3> lb(world);
+    // contiguous ranges of the space-filling curve; only the keys near
+    // range boundaries move, and not at all if the old ranges are still fine
+    LoadBalanceSFC<3> lb(world);
     real_function_3d vnuc;
     if (molecule.parameters.psp_calc()) {
         vnuc = gthpseudopotential->vlocalpot();
@@ -1708,6 +1710,8 @@ void SCF::loadbal(World& world, functionT& arho, functionT& brho,
             lb.add_tree(bmo[i], lbcost<double, 3>(1.0, 8.0), false);
         }
     }
+    // task times measured in apply and multiply during the previous iteration
+    lb.add_measured_cost();
     world.gop.fence();
 
     FunctionDefaults<3>::redistribute(world, lb.load_balance(
@@ -2084,6 +2088,8 @@ void SCF::solve(World& world) {
             END_TIMER(world, "Load balancing");
             print_meminfo(world.rank(), "Load balancing");
         }
+        // measure apply and multiply tasks only in the iteration before a rebalance
+        if (world.size() > 1 && (iter+1 < 2 || ((iter+1) % 10) == 0)) TaskCostRecorder<3>::set_enabled(true);
         double da = 0.0, db = 0.0;
         if (iter > 0) {
             da = (arho - arho_old).norm2();
@@ -2315,6 +2321,8 @@ void SCF::solve(World& world) {
                         bsh_residual, update_residual);
 
     }
+    TaskCostRecorder<3>::set_enabled(false);
+    TaskCostRecorder<3>::clear();
 
     // compute the dipole moment
     functionT rho = make_density(world, aocc, amo);
@@ -466,9 +466,11 @@ real_function_3d XCOperator<T, NDIM>::make_xc_potential() const {
 
     refine_to_common_level(world, xc_args);
 
-    // compute all the contributions to the xc kernel
+    // compute all the contributions to the xc kernel, with some 10^4 points per call of the functional
     xc_potential op(*xc, ispin);
-    const vecfuncT intermediates = multi_to_multi_op_values(op, xc_args);
+    const long k = FunctionDefaults<3>::get_k();
+    const std::size_t nbatch = std::max(1L, 32768/(k*k*k));
+    const vecfuncT intermediates = multi_to_multi_op_values_batch(op, xc_args, nbatch);
 
     // local part, first term in Yanai2005, Eq. (12)
     real_function_3d dft_pot = intermediates[0];
@@ -41,6 +41,12 @@ public:
         return aofunc(x[0], x[1], x[2]);
     }
 
+    bool supports_vectorized() const {return true;}
+
+    void operator()(const madness::Vector<double*,3>& xvals, double* fvals, int npts) const {
+        aofunc(xvals[0], xvals[1], xvals[2], fvals, npts);
+    }
+
     std::vector<madness::coord_3d> special_points() const {
         return std::vector<madness::coord_3d>(1,aofunc.get_coords_vec());
     }
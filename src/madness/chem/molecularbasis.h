@@ -117,6 +117,25 @@ public:
     }
 
 
+    /// Evaluates the radial part at npts points given their squared distances
+
+    /// Same screening as the pointwise eval_radial, with the primitives in the
+    /// outer loop so that the inner loop over points vectorizes.
+    void eval_radial(const double* rsq, double* R, int npts) const {
+        for (int p=0; p<npts; ++p) R[p] = 0.0;
+        for (unsigned int i=0; i<coeff.size(); ++i) {
+            const double c = coeff[i], a = expnt[i];
+            for (int p=0; p<npts; ++p) {
+                double ersq = a*rsq[p];
+                R[p] += (ersq < 27.6) ? c*exp(-ersq) : 0.0; // 27.6 = log(1e12)
+            }
+        }
+        for (int p=0; p<npts; ++p) {
+            if (rsq[p] > rsqmax || fabs(R[p]) < 1e-12) R[p] = 0.0;
+        }
+    }
+
+
     /// Evaluates the entire shell returning the incremented result pointer
     double* eval(double rsq, double x, double y, double z, double* bf) const {
         double R = eval_radial(rsq);
@@ -433,6 +452,35 @@ public:
         return bf[ibf];
     }
 
+    /// Evaluates the function at npts points given as separate coordinate arrays
+    void operator()(const double* x, const double* y, const double* z, double* f, int npts) const {
+        // Cartesian powers (lx,ly,lz) of function ibf, in the order of ContractedGaussianShell::eval
+        static const int powers[4][10][3] = {
+            {{0,0,0}},
+            {{1,0,0},{0,1,0},{0,0,1}},
+            {{2,0,0},{1,1,0},{1,0,1},{0,2,0},{0,1,1},{0,0,2}},
+            {{3,0,0},{2,1,0},{2,0,1},{1,2,0},{1,1,1},{1,0,2},{0,3,0},{0,2,1},{0,1,2},{0,0,3}}
+        };
+        const int type = shell.angular_momentum();
+        if (type < 0 || type > 3) throw "UNKNOWN ANGULAR MOMENTUM";
+        const int lx = powers[type][ibf][0], ly = powers[type][ibf][1], lz = powers[type][ibf][2];
+
+        std::vector<double> rsq(npts);
+        for (int p=0; p<npts; ++p) {
+            const double dx = x[p]-xx, dy = y[p]-yy, dz = z[p]-zz;
+            rsq[p] = dx*dx + dy*dy + dz*dz;
+        }
+        shell.eval_radial(rsq.data(), f, npts);
+        for (int p=0; p<npts; ++p) {
+            const double dx = x[p]-xx, dy = y[p]-yy, dz = z[p]-zz;
+            double a = 1.0;
+            for (int l=0; l<lx; ++l) a *= dx;
+            for (int l=0; l<ly; ++l) a *= dy;
+            for (int l=0; l<lz; ++l) a *= dz;
+            f[p] *= a;
+        }
+    }
+
     void print_me(std::ostream& s) const;
 
     const ContractedGaussianShell& get_shell() const {
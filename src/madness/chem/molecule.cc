@@ -993,6 +993,23 @@ double Molecule::nuclear_attraction_potential(double x, double y, double z) cons
     return sum;
 }
 
+void Molecule::nuclear_attraction_potential(const double* x, const double* y, const double* z,
+                                            double* v, int npts) const {
+    // same sum as the pointwise version, with the atoms in the outer loop so
+    // that the inner loop runs over contiguous points
+    for (int p=0; p<npts; ++p) v[p] = field[0] * x[p] + field[1] * y[p] + field[2] * z[p];
+    for (unsigned int i=0; i<atoms.size(); ++i) {
+        if (atoms[i].pseudo_atom) continue;
+        const double xi = atoms[i].x, yi = atoms[i].y, zi = atoms[i].z;
+        const double q = atoms[i].q, rc = rcut[i];
+        for (int p=0; p<npts; ++p) {
+            const double dx = x[p] - xi, dy = y[p] - yi, dz = z[p] - zi;
+            const double r = sqrt(dx*dx + dy*dy + dz*dz);
+            v[p] -= q * smoothed_potential(r*rc)*rc;
+        }
+    }
+}
+
 double Molecule::atomic_attraction_potential(int iatom, double x, double y,
         double z) const {
 
@@ -505,6 +505,10 @@ public:
     /// nuclear attraction potential for the whole molecule
     double nuclear_attraction_potential(double x, double y, double z) const;
 
+    /// nuclear attraction potential at npts points given as separate coordinate arrays
+    void nuclear_attraction_potential(const double* x, const double* y, const double* z,
+                                      double* v, int npts) const;
+
     /// nuclear attraction potential for a specific atom in the molecule
     double atomic_attraction_potential(int iatom, double x, double y, double z) const;
 
@@ -63,6 +63,12 @@ public:
         return molecule.nuclear_attraction_potential(x[0], x[1], x[2]);
     }
 
+    bool supports_vectorized() const {return true;}
+
+    void operator()(const Vector<double*,3>& xvals, double* fvals, int npts) const {
+        molecule.nuclear_attraction_potential(xvals[0], xvals[1], xvals[2], fvals, npts);
+    }
+
     std::vector<coord_3d> special_points() const {return molecule.get_all_coords_vec();}
 };
 
@@ -0,0 +1,157 @@
+/*
+ * test_projection.cc
+ *
+ *  batched (structure-of-arrays) evaluation of the chemistry functors
+ *  against their pointwise operator(), and of the AO projection
+ */
+
+#include <madness/mra/mra.h>
+#include <madness/chem/molecule.h>
+#include <madness/chem/molecularbasis.h>
+#include <madness/chem/molecular_functors.h>
+#include <madness/chem/potentialmanager.h>
+
+using namespace madness;
+
+/// hides the batched interface of a functor, so projection goes point by point
+class PointwiseFunctor : public FunctionFunctorInterface<double,3> {
+    std::shared_ptr<FunctionFunctorInterface<double,3> > f;
+public:
+    PointwiseFunctor(const std::shared_ptr<FunctionFunctorInterface<double,3> >& f) : f(f) {}
+
+    double operator()(const coord_3d& x) const {
+        return (*f)(x);
+    }
+
+    std::vector<coord_3d> special_points() const {return f->special_points();}
+};
+
+/// water in an external field, optionally with a scandium atom to have f shells in 6-31g**
+Molecule make_water(bool with_scandium) {
+    std::vector<Atom> atoms;
+    atoms.push_back(Atom( 0.0, 0.0, 0.2249, 8.0, 8));
+    atoms.push_back(Atom( 0.0, 1.4412,-0.8996, 1.0, 1));
+    atoms.push_back(Atom( 0.0,-1.4412,-0.8996, 1.0, 1));
+    if (with_scandium) atoms.push_back(Atom( 2.0, 2.0, 2.0, 21.0, 21));
+    Tensor<double> field(3L);
+    field(0L)=0.01;
+    field(1L)=-0.02;
+    field(2L)=0.03;
+    return Molecule(atoms, 1.e-4, CorePotentialManager(), field);
+}
+
+/// compare the batched operator() with the pointwise one on random points
+bool test_batched_values(World& world, const Molecule& molecule, const AtomicBasisSet& aobasis) {
+    const int npts=512;
+    std::vector<double> x(npts), y(npts), z(npts), fbatch(npts);
+    for (int i=0; i<npts; ++i) {
+        x[i]=6.0*(RandomValue<double>()-0.5);
+        y[i]=6.0*(RandomValue<double>()-0.5);
+        z[i]=6.0*(RandomValue<double>()-0.5);
+    }
+    Vector<double*,3> xvals{x.data(), y.data(), z.data()};
+
+    auto maxerr=[&](const FunctionFunctorInterface<double,3>& f) {
+        MADNESS_CHECK(f.supports_vectorized());
+        f(xvals, fbatch.data(), npts);
+        double err=0.0;
+        for (int i=0; i<npts; ++i) {
+            double fpt=f(coord_3d{x[i],y[i],z[i]});
+            err=std::max(err,std::abs(fpt-fbatch[i])/std::max(1.0,std::abs(fpt)));
+        }
+        return err;
+    };
+
+    // the batched potential adds the field term first, so only agreement up to rounding is expected
+    double err=0.0;
+    for (int i=0; i<aobasis.nbf(molecule); ++i) {
+        err=std::max(err,maxerr(madchem::AtomicBasisFunctor(aobasis.get_atomic_basis_function(molecule, i))));
+    }
+    double errv=maxerr(MolecularPotentialFunctor(molecule));
+    if (world.rank()==0) print("max error of batched AO and potential values", err, errv);
+    return (err<1.e-13) and (errv<1.e-13);
+}
+
+/// project the AO basis the way SCF::project_ao_basis_only does, batched or point by point
+std::vector<real_function_3d> project_ao(World& world, const Molecule& molecule,
+                                         const AtomicBasisSet& aobasis, bool batched) {
+    typedef std::shared_ptr<FunctionFunctorInterface<double,3> > functorT;
+    std::vector<real_function_3d> ao(aobasis.nbf(molecule));
+    for (int i=0; i<aobasis.nbf(molecule); ++i) {
+        functorT aofunc(new madchem::AtomicBasisFunctor(aobasis.get_atomic_basis_function(molecule, i)));
+        if (not batched) aofunc.reset(new PointwiseFunctor(aofunc));
+        ao[i]=real_factory_3d(world).functor(aofunc).truncate_on_project().nofence().truncate_mode(1);
+    }
+    world.gop.fence();
+    return ao;
+}
+
+bool test_project_ao_basis(World& world, const Molecule& molecule, const AtomicBasisSet& aobasis) {
+    const double thresh=FunctionDefaults<3>::get_thresh();
+    std::vector<real_function_3d> ao0=project_ao(world, molecule, aobasis, false);
+    std::vector<real_function_3d> ao1=project_ao(world, molecule, aobasis, true);
+
+    // rounding differences may flip the refinement of a box, which changes the result by O(thresh)
+    double err=norm2(world,sub(world,ao0,ao1));
+    if (world.rank()==0) print("project_ao_basis with",ao0.size(),"functions: difference",err);
+
+    typedef std::shared_ptr<FunctionFunctorInterface<double,3> > functorT;
+    functorT vfunc(new MolecularPotentialFunctor(molecule));
+    real_function_3d v0=real_factory_3d(world).functor(functorT(new PointwiseFunctor(vfunc))).truncate_on_project();
+    real_function_3d v1=real_factory_3d(world).functor(vfunc).truncate_on_project();
+    double errv=(v0-v1).norm2()/v0.norm2();
+    if (world.rank()==0) print("nuclear potential: relative difference",errv);
+    return (err<thresh) and (errv<thresh);
+}
+
+
+int main(int argc, char** argv) {
+
+	World& world=initialize(argc, argv);
+	if (world.rank() == 0) {
+		print("\n  test projection \n");
+		printf("starting at time %.1f\n", wall_time());
+	}
+	startup(world,argc,argv);
+	std::cout.precision(6);
+
+	FunctionDefaults<3>::set_k(6);
+	FunctionDefaults<3>::set_thresh(1.e-4);
+	FunctionDefaults<3>::set_refine(true);
+	FunctionDefaults<3>::set_initial_level(3);
+	FunctionDefaults<3>::set_truncate_mode(1);
+	FunctionDefaults<3>::set_cubic_cell(-20, 20);
+
+	int success=0;
+	try {
+		// 6-31g** has d shells on O and f shells on Sc
+		AtomicBasisSet aobasis("6-31gss");
+		if (not test_batched_values(world, make_water(true), aobasis)) success++;
+		if (not test_project_ao_basis(world, make_water(false), aobasis)) success++;
+
+	} catch (const SafeMPI::Exception& e) {
+		print(e);
+		error("caught an MPI exception");
+	} catch (const madness::MadnessException& e) {
+		print(e);
+		error("caught a MADNESS exception");
+	} catch (const madness::TensorException& e) {
+		print(e);
+		error("caught a Tensor exception");
+	} catch (const char* s) {
+		print(s);
+		error("caught a string exception");
+	} catch (const std::string& s) {
+		print(s);
+		error("caught a string (class) exception");
+	} catch (const std::exception& e) {
+		print(e.what());
+		error("caught an STL exception");
+	} catch (...) {
+		error("caught unhandled exception");
+	}
+
+	if (world.rank()==0) print("test_projection",(success==0) ? "passed" : "failed");
+	finalize();
+	return success;
+}
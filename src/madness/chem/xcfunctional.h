@@ -314,6 +314,17 @@ public:
     std::vector<madness::Tensor<double> > vxc(const std::vector< madness::Tensor<double> >& t,
             const int ispin) const;
 
+    /// Computes the potential as vxc() for the points of many boxes at once
+
+    /// The points of all boxes are gathered into one batch and the functional
+    /// is called once on the batch.  With libxc only the points with a
+    /// density above rhotol are passed (if rhomin is zero); the others have a zero potential.
+    /// @param[in] t    the input densities and derivatives of each box, as for vxc()
+    /// @param[in] ispin as for vxc()
+    /// @return the result of vxc() for each box
+    std::vector< std::vector<madness::Tensor<double> > > vxc_batch(
+            const std::vector< std::vector< madness::Tensor<double> > >& t, const int ispin) const;
+
 
     /// compute the second derivative of the XC energy wrt the density and apply
 
@@ -396,6 +407,13 @@ struct xc_potential {
         std::vector<madness::Tensor<double> > r = xc->vxc(t, ispin);
         return r;
     }
+
+    /// the potential in many boxes at once, see multi_to_multi_op_values_batch
+    std::vector< std::vector<madness::Tensor<double> > > operator()(const std::vector< madness::Key<3> >& keys,
+            const std::vector< std::vector< madness::Tensor<double> > >& t) const {
+        MADNESS_ASSERT(xc);
+        return xc->vxc_batch(t, ispin);
+    }
 };
 
 
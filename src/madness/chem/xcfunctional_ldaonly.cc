@@ -160,6 +160,15 @@ std::vector<madness::Tensor<double> > XCfunctional::vxc(const std::vector< madne
     return result;
 }
 
+std::vector< std::vector<madness::Tensor<double> > > XCfunctional::vxc_batch(
+        const std::vector< std::vector< madness::Tensor<double> > >& t, const int ispin) const
+{
+    // the munged density is never zero, so there is nothing to screen
+    std::vector< std::vector<madness::Tensor<double> > > result(t.size());
+    for (std::size_t ibox=0; ibox<t.size(); ++ibox) result[ibox] = vxc(t[ibox], ispin);
+    return result;
+}
+
 std::vector<madness::Tensor<double> > XCfunctional::fxc_apply(const std::vector<Tensor<double> >& t,
         const int ispin) const{
 	MADNESS_EXCEPTION("fxc_apply not implemented in xcfunctional_ldaonly.cc... use libxc",1);
@@ -20,6 +20,16 @@ namespace {
     }
 }
 
+namespace {
+    /// Per-thread buffers for the points of a batch in vxc_batch, grown as needed
+    struct XCBatchBuffers {
+        std::vector< madness::Tensor<double> > args;    ///< one per xc_arg
+        std::vector<long> box;                          ///< the box of each point
+        std::vector<long> point;                        ///< the index of each point in its box
+    };
+    thread_local XCBatchBuffers xc_batch_buffers;
+}
+
 namespace madness {
 
 static int lookup_name(const std::string& name) {
@@ -548,6 +558,63 @@ std::vector<madness::Tensor<double> > XCfunctional::vxc(
 }
 
 
+std::vector< std::vector<madness::Tensor<double> > > XCfunctional::vxc_batch(
+        const std::vector< std::vector< madness::Tensor<double> > >& t, const int ispin) const {
+    XCBatchBuffers& buf = xc_batch_buffers;
+
+    // select the points where the density is not munged to zero, see munge();
+    // with a finite rhomin all points are passed
+    const bool screen = (rhomin == 0.0);
+    buf.box.clear();
+    buf.point.clear();
+    for (std::size_t ibox=0; ibox<t.size(); ++ibox) {
+        const long np = t[ibox][enum_rhoa].size();
+        const double * MADNESS_RESTRICT rhoa = t[ibox][enum_rhoa].ptr();
+        const double * MADNESS_RESTRICT rhob = spin_polarized ? t[ibox][enum_rhob].ptr() : NULL;
+        for (long i=0; i<np; i++) {
+            bool keep = spin_polarized ? (rhoa[i] > rhotol) : (2.0*rhoa[i] > rhotol);
+            if (rhob) keep = keep or (rhob[i] > rhotol);
+            keep = keep or (not screen);
+            if (keep) {
+                buf.box.push_back(ibox);
+                buf.point.push_back(i);
+            }
+        }
+    }
+    const long n = buf.point.size();
+
+    int result_size=1;
+    if (is_gga()) result_size = spin_polarized ? 7 : 4;
+    std::vector< std::vector<madness::Tensor<double> > > result(t.size());
+    for (std::size_t ibox=0; ibox<t.size(); ++ibox) {
+        result[ibox].resize(result_size);
+        for (Tensor<double>& rr : result[ibox]) rr = Tensor<double>(3L, t[ibox][enum_rhoa].dims());
+    }
+    if (n == 0) return result;
+
+    // gather the arguments of the selected points, and call the functional once
+    std::vector< madness::Tensor<double> > args(t[0].size());
+    if (buf.args.size() < args.size()) buf.args.resize(args.size());
+    for (std::size_t iarg=0; iarg<args.size(); ++iarg) {
+        if (t[0][iarg].size() == 0) continue;
+        if (buf.args[iarg].size() < n) {
+            buf.args[iarg] = madness::Tensor<double>(std::vector<long>(1, std::max(n, 2*buf.args[iarg].size())), false);
+        }
+        args[iarg] = buf.args[iarg](Slice(0,n-1));
+        double * MADNESS_RESTRICT a = args[iarg].ptr();
+        for (long j=0; j<n; j++) a[j] = t[buf.box[j]][iarg].ptr()[buf.point[j]];
+    }
+    std::vector<madness::Tensor<double> > r = vxc(args, ispin);
+    MADNESS_ASSERT(int(r.size()) == result_size);
+
+    // scatter the results back to the boxes
+    for (int k=0; k<result_size; ++k) {
+        const double * MADNESS_RESTRICT rk = r[k].ptr();
+        for (long j=0; j<n; j++) result[buf.box[j]][k].ptr()[buf.point[j]] = rk[j];
+    }
+    return result;
+}
+
 std::vector<madness::Tensor<double> > XCfunctional::fxc_apply(
         const std::vector<Tensor<double> >& t, const int ispin) const {
 
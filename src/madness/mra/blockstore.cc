@@ -0,0 +1,263 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file mra/blockstore.cc
+/// \brief Persistent on-disk store of the 1D operator blocks
+
+#include <madness/mra/blockstore.h>
+#include <madness/mra/simplecache.h>
+#include <madness/world/madness_exception.h>
+#include <madness/world/safempi.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace madness {
+
+    namespace {
+
+        /// Header of a block file, followed by nrecord (n,l) pairs and nrecord blocks
+        struct BlockFileHeader {
+            char magic[8];
+            std::uint64_t version;
+            std::uint64_t nbytes_block;
+            std::uint64_t nrecord;
+        };
+
+        const char block_file_magic[8] = {'M','A','D','O','P','B','L','K'};
+        const std::uint64_t block_file_version = 1;
+
+        /// Memory held by one new block in the map
+        std::size_t added_nbytes(std::size_t nbytes_block) {
+            return nbytes_block + 64;   // map node and vector header
+        }
+
+        /// The files opened by the writer, for OperatorBlockStore::flush()
+        Mutex open_files_mutex;
+        std::vector< std::weak_ptr<OperatorBlockFile> > open_files;
+    }
+
+    OperatorBlockFile::OperatorBlockFile(const std::string& filename, std::size_t nbytes_block, bool writer)
+        : filename(filename)
+        , nbytes_block(nbytes_block)
+        , writer(writer)
+        , map_base(nullptr)
+        , map_size(0)
+        , index(nullptr)
+        , blocks(nullptr)
+        , nrecord(0)
+        , nflushed(0)
+    {
+        map_file();
+    }
+
+    OperatorBlockFile::~OperatorBlockFile() {
+        SimpleCacheStats::release(added.size()*added_nbytes(nbytes_block));
+        unmap_file();
+    }
+
+    void OperatorBlockFile::map_file() {
+        const int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return; // not yet created
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && std::size_t(st.st_size) >= sizeof(BlockFileHeader)) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                const BlockFileHeader* h = static_cast<const BlockFileHeader*>(p);
+                const std::size_t expected = sizeof(BlockFileHeader)
+                    + h->nrecord*(sizeof(indexT) + nbytes_block);
+                if (memcmp(h->magic, block_file_magic, sizeof(block_file_magic)) == 0
+                    && h->version == block_file_version
+                    && h->nbytes_block == nbytes_block
+                    && expected == std::size_t(st.st_size)) {
+                    map_base = p;
+                    map_size = st.st_size;
+                    nrecord = h->nrecord;
+                    index = reinterpret_cast<const indexT*>(h+1);
+                    blocks = reinterpret_cast<const char*>(index + nrecord);
+                }
+                else {
+                    // stale or foreign file ... ignored and replaced on flush
+                    munmap(p, st.st_size);
+                }
+            }
+        }
+        ::close(fd);
+    }
+
+    void OperatorBlockFile::unmap_file() {
+        if (map_base) munmap(map_base, map_size);
+        map_base = nullptr;
+        map_size = 0;
+        index = nullptr;
+        blocks = nullptr;
+        nrecord = 0;
+    }
+
+    bool OperatorBlockFile::read(int n, std::int64_t l, void* data) const {
+        const indexT key(n,l);
+        if (nrecord) {
+            const indexT* p = std::lower_bound(index, index+nrecord, key);
+            if (p != index+nrecord && *p == key) {
+                memcpy(data, blocks + (p-index)*nbytes_block, nbytes_block);
+                OperatorBlockStore::count_read();
+                return true;
+            }
+        }
+        // blocks computed in this run are found in the caches of the convolution
+        return false;
+    }
+
+    void OperatorBlockFile::write(int n, std::int64_t l, const void* data) {
+        if (!writer) return;
+        const char* c = static_cast<const char*>(data);
+        ScopedMutex<Mutex> lock(mutex);
+        if (added.insert(std::make_pair(indexT(n,l), std::vector<char>(c, c+nbytes_block))).second) {
+            OperatorBlockStore::count_write();
+            SimpleCacheStats::insert(added_nbytes(nbytes_block));
+        }
+    }
+
+    void OperatorBlockFile::flush() {
+        ScopedMutex<Mutex> lock(mutex);
+        if (added.size() == nflushed) return;
+
+        // merge the mapped and the new blocks, both sorted by (n,l)
+        std::vector<indexT> keys;
+        std::vector<const char*> data;
+        keys.reserve(nrecord + added.size());
+        data.reserve(nrecord + added.size());
+        std::size_t i = 0;
+        std::map<indexT, std::vector<char> >::const_iterator it = added.begin();
+        while (i < nrecord || it != added.end()) {
+            if (it == added.end() || (i < nrecord && index[i] < it->first)) {
+                keys.push_back(index[i]);
+                data.push_back(blocks + i*nbytes_block);
+                ++i;
+            }
+            else {
+                if (i < nrecord && index[i] == it->first) ++i; // same block, keep the new one
+                keys.push_back(it->first);
+                data.push_back(it->second.data());
+                ++it;
+            }
+        }
+
+        // write to a file private to this process and rename it over the old one
+        char suffix[64];
+        snprintf(suffix, sizeof(suffix), ".%ld.%p.tmp", long(getpid()), static_cast<void*>(this));
+        const std::string tmpname = filename + suffix;
+        FILE* f = fopen(tmpname.c_str(), "wb");
+        if (!f) return; // read-only store ... keep running without it
+
+        BlockFileHeader h;
+        memcpy(h.magic, block_file_magic, sizeof(block_file_magic));
+        h.version = block_file_version;
+        h.nbytes_block = nbytes_block;
+        h.nrecord = keys.size();
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+        ok = ok && fwrite(keys.data(), sizeof(indexT), keys.size(), f) == keys.size();
+        for (std::size_t j=0; ok && j<data.size(); ++j) ok = fwrite(data[j], nbytes_block, 1, f) == 1;
+        ok = (fclose(f) == 0) && ok;
+        if (!ok || rename(tmpname.c_str(), filename.c_str()) != 0) {
+            remove(tmpname.c_str());
+            return;
+        }
+
+        // the old mapping stays valid and the new blocks stay in memory, so
+        // concurrent readers are not disturbed
+        nflushed = added.size();
+    }
+
+
+    std::string& OperatorBlockStore::directory() {
+        static std::string dir = [] {
+            const char* env = getenv("MAD_OPERATOR_STORE");
+            if (env && *env) mkdir(env, 0755); // failure shows later as a store that cannot be written
+            return std::string(env ? env : "");
+        }();
+        return dir;
+    }
+
+    void OperatorBlockStore::set_directory(const std::string& dir) {
+        if (!dir.empty() && mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            MADNESS_EXCEPTION("OperatorBlockStore: cannot create directory", errno);
+        directory() = dir;
+    }
+
+    std::shared_ptr<OperatorBlockFile> OperatorBlockStore::open(const char* type, int k, double expnt,
+                                                                int m, bool periodic,
+                                                                std::size_t nbytes_block) {
+        if (!enabled()) return std::shared_ptr<OperatorBlockFile>();
+
+        // the exponent is encoded exactly by its bit pattern
+        std::uint64_t bits;
+        static_assert(sizeof(bits) == sizeof(expnt), "unexpected size of double");
+        memcpy(&bits, &expnt, sizeof(bits));
+        char name[128];
+        snprintf(name, sizeof(name), "/gauss_%s_k%d_m%d_p%d_%016llx.blk", type, k, m, int(periodic),
+                 (unsigned long long) bits);
+        const bool writer = !SafeMPI::Is_initialized() || SafeMPI::COMM_WORLD.Get_rank() == 0;
+        std::shared_ptr<OperatorBlockFile> file =
+            std::make_shared<OperatorBlockFile>(directory() + name, nbytes_block, writer);
+        if (writer) {
+            ScopedMutex<Mutex> lock(open_files_mutex);
+            open_files.push_back(file);
+        }
+        return file;
+    }
+
+    void OperatorBlockStore::flush() {
+        std::vector< std::shared_ptr<OperatorBlockFile> > files;
+        {
+            ScopedMutex<Mutex> lock(open_files_mutex);
+            std::vector< std::weak_ptr<OperatorBlockFile> > still_open;
+            for (const auto& w : open_files) {
+                if (std::shared_ptr<OperatorBlockFile> file = w.lock()) {
+                    files.push_back(file);
+                    still_open.push_back(w);
+                }
+            }
+            open_files.swap(still_open);
+        }
+        for (const auto& file : files) file->flush();
+    }
+
+}
@@ -0,0 +1,157 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_MRA_BLOCKSTORE_H__INCLUDED
+#define MADNESS_MRA_BLOCKSTORE_H__INCLUDED
+
+/// \file mra/blockstore.h
+/// \brief Persistent on-disk store of the 1D operator blocks
+
+#include <madness/world/worldmutex.h>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace madness {
+
+    /// The blocks r(n,l) of one 1D convolution, read from a memory-mapped file and extended on misses
+
+    /// The file holds a header, the sorted list of (n,l) and then the blocks,
+    /// each of the same size.  It is mapped read-only when opened and never
+    /// modified in place, so lookups take no lock.  Only the writer process
+    /// (rank 0) keeps the blocks computed during the run; they are merged with
+    /// the mapped ones into a new file that atomically replaces the old one on
+    /// flush().  Blocks not flushed before the file is closed are dropped.
+    /// Concurrent jobs sharing the directory thus only ever see complete
+    /// files, and the last writer wins.
+    class OperatorBlockFile {
+    public:
+        /// Open (or prepare to create) the file for blocks of \c nbytes_block bytes
+
+        /// Only a \c writer keeps the blocks added with write().
+        OperatorBlockFile(const std::string& filename, std::size_t nbytes_block, bool writer);
+
+        OperatorBlockFile(const OperatorBlockFile&) = delete;
+        OperatorBlockFile& operator=(const OperatorBlockFile&) = delete;
+
+        ~OperatorBlockFile();
+
+        /// If block (n,l) is in the mapped file copy it to \c data and return true
+        bool read(int n, std::int64_t l, void* data) const;
+
+        /// Add block (n,l) ... it is written to disk by flush(), and ignored if not the writer
+        void write(int n, std::int64_t l, const void* data);
+
+        /// Write the mapped and the new blocks to the file, if there are new blocks
+        void flush();
+
+        /// Number of blocks in the mapped file
+        std::size_t nmapped() const {return nrecord;}
+
+        /// Name of the file
+        const std::string& get_filename() const {return filename;}
+
+    private:
+        typedef std::pair<std::int64_t,std::int64_t> indexT; ///< (n,l)
+
+        const std::string filename;
+        const std::size_t nbytes_block;
+        const bool writer;
+        void* map_base;             ///< the mapped file or null
+        std::size_t map_size;
+        const indexT* index;        ///< sorted (n,l) of the mapped blocks
+        const char* blocks;         ///< the mapped blocks
+        std::size_t nrecord;        ///< number of mapped blocks
+        mutable Mutex mutex;        ///< protects added and nflushed
+        std::map<indexT, std::vector<char> > added; ///< blocks computed in this run, accounted in SimpleCacheStats
+        std::size_t nflushed;       ///< size of added at the last flush
+
+        void map_file();
+        void unmap_file();
+    };
+
+
+    /// Process-wide configuration and statistics of the persistent operator block store
+
+    /// The store is disabled unless a directory is set, with set_directory() or
+    /// the environment variable \c MAD_OPERATOR_STORE.  Blocks are keyed by the
+    /// wavelet order, the exponent (exactly), the derivative order, the
+    /// periodicity, the level and the translation.  They are only ever
+    /// computed from these, so a store can be shared by all jobs that use the
+    /// same operators and is refilled after the directory is removed.
+    ///
+    /// Only rank 0 writes.  New blocks reach the disk when flush() is called,
+    /// which should be done once all processes are done computing operators,
+    /// e.g. at the end of a calculation, followed by a fence if other
+    /// processes are to read them in the same run.
+    class OperatorBlockStore {
+        inline static std::atomic<std::uint64_t> nread{0};    ///< blocks read from a file
+        inline static std::atomic<std::uint64_t> nwrite{0};   ///< blocks added to a file
+
+        static std::string& directory();
+
+    public:
+        /// Use \c dir for the store, creating it if necessary ... an empty string disables the store
+
+        /// Only convolutions made after this call use the new setting.
+        static void set_directory(const std::string& dir);
+
+        /// The directory of the store, empty if disabled
+        static const std::string& get_directory() {return directory();}
+
+        /// True if a directory is set
+        static bool enabled() {return !directory().empty();}
+
+        /// Open the blocks of the Gaussian convolution with the given parameters, or null if disabled
+
+        /// @param[in]  type    tag for the element type of the blocks
+        static std::shared_ptr<OperatorBlockFile> open(const char* type, int k, double expnt,
+                                                       int m, bool periodic, std::size_t nbytes_block);
+
+        /// Write the new blocks of all open files to the store ... only rank 0 writes
+        static void flush();
+
+        /// Number of blocks read from the store
+        static std::uint64_t get_nread() {return nread;}
+
+        /// Number of blocks added to the store by this process
+        static std::uint64_t get_nwrite() {return nwrite;}
+
+        static void count_read() {nread.fetch_add(1, std::memory_order_relaxed);}
+        static void count_write() {nwrite.fetch_add(1, std::memory_order_relaxed);}
+    };
+}
+
+#endif // MADNESS_MRA_BLOCKSTORE_H__INCLUDED
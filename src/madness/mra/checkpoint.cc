@@ -0,0 +1,271 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file mra/checkpoint.cc
+/// \brief Asynchronous parallel checkpoints of functions, one file per process
+
+#include <madness/mra/checkpoint.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/types.h>
+
+namespace madness {
+
+    namespace {
+
+        /// Header of a checkpoint file, followed by nfunction RecordIndex and the records
+        struct CheckpointHeader {
+            char magic[8];
+            std::uint64_t version;
+            std::uint64_t nfile;        ///< number of files of the checkpoint
+            std::uint64_t file;         ///< index of this file
+            std::uint64_t nfunction;
+        };
+
+        struct RecordIndex {
+            std::uint64_t offset;       ///< from the start of the file
+            std::uint64_t nbyte;        ///< as stored
+            std::uint64_t nbyte_raw;    ///< uncompressed
+            std::uint64_t nnode;
+            std::uint64_t compressed;
+        };
+
+        const char checkpoint_magic[8] = {'M','A','D','C','K','P','T','1'};
+        const std::uint64_t checkpoint_version = 1;
+
+        /// Regroup the bytes of 8-byte words so that byte b of all words is contiguous
+        void shuffle(const unsigned char* in, std::size_t n, unsigned char* out) {
+            const std::size_t nword = n/8;
+            for (std::size_t b=0; b<8; ++b)
+                for (std::size_t i=0; i<nword; ++i) out[b*nword+i] = in[8*i+b];
+            memcpy(out+8*nword, in+8*nword, n-8*nword);
+        }
+
+        void unshuffle(const unsigned char* in, std::size_t n, unsigned char* out) {
+            const std::size_t nword = n/8;
+            for (std::size_t b=0; b<8; ++b)
+                for (std::size_t i=0; i<nword; ++i) out[8*i+b] = in[b*nword+i];
+            memcpy(out+8*nword, in+8*nword, n-8*nword);
+        }
+
+        /// Byte shuffle followed by run-length encoding (PackBits)
+
+        /// After the shuffle the sign and exponent bytes of neighboring
+        /// coefficients, exact zeros and the padding of keys and counters
+        /// form runs.  A control byte c < 128 is followed by c+1 literal
+        /// bytes, c >= 128 by one byte repeated c-125 times.
+        void pack(const std::vector<unsigned char>& in, std::vector<unsigned char>& out) {
+            const std::size_t n = in.size();
+            std::vector<unsigned char> s(n);
+            shuffle(in.data(), n, s.data());
+
+            out.clear();
+            out.reserve(n/2 + 16);
+            std::size_t i = 0;
+            while (i < n) {
+                std::size_t run = 1;
+                while (i+run < n && run < 130 && s[i+run] == s[i]) ++run;
+                if (run >= 3) {
+                    out.push_back((unsigned char)(128 + run - 3));
+                    out.push_back(s[i]);
+                    i += run;
+                }
+                else {
+                    // literals up to the next run of three
+                    std::size_t j = i;
+                    while (j < n && j-i < 128 && !(j+2 < n && s[j] == s[j+1] && s[j] == s[j+2])) ++j;
+                    out.push_back((unsigned char)(j-i-1));
+                    out.insert(out.end(), s.begin()+i, s.begin()+j);
+                    i = j;
+                }
+            }
+        }
+
+        void unpack(const std::vector<unsigned char>& in, std::size_t n, std::vector<unsigned char>& out) {
+            std::vector<unsigned char> s;
+            s.reserve(n);
+            std::size_t i = 0;
+            while (i < in.size()) {
+                const std::size_t c = in[i++];
+                if (c < 128) {
+                    if (i+c+1 > in.size()) break;
+                    s.insert(s.end(), in.begin()+i, in.begin()+i+c+1);
+                    i += c+1;
+                }
+                else {
+                    if (i >= in.size()) break;
+                    s.insert(s.end(), c-125, in[i++]);
+                }
+            }
+            if (s.size() != n) MADNESS_EXCEPTION("checkpoint: corrupt record", s.size());
+            out.resize(n);
+            unshuffle(s.data(), n, out.data());
+        }
+    }
+
+
+    struct CheckpointWriter::State {
+        std::string filename;
+        CheckpointHeader header;
+        std::vector< std::vector<unsigned char> > records;
+        std::vector<std::uint64_t> nnode;
+        bool compress;
+        std::size_t nbyte_raw = 0;
+        std::size_t nbyte_written = 0;
+        bool ok = false;
+        std::atomic<bool> finished{false};
+
+        /// Compress and write the records, run by the thread of the writer
+        void write() {
+            const std::size_t nfunction = records.size();
+            std::vector<RecordIndex> index(nfunction);
+            std::uint64_t offset = sizeof(CheckpointHeader) + nfunction*sizeof(RecordIndex);
+            for (std::size_t i=0; i<nfunction; ++i) {
+                index[i].nbyte_raw = records[i].size();
+                index[i].nnode = nnode[i];
+                index[i].compressed = 0;
+                if (compress) {
+                    std::vector<unsigned char> c;
+                    pack(records[i], c);
+                    if (c.size() < records[i].size()) {
+                        records[i].swap(c);
+                        index[i].compressed = 1;
+                    }
+                }
+                index[i].offset = offset;
+                index[i].nbyte = records[i].size();
+                offset += records[i].size();
+                nbyte_raw += index[i].nbyte_raw;
+            }
+
+            const std::string tmpname = filename + ".tmp";
+            FILE* f = fopen(tmpname.c_str(), "wb");
+            if (f) {
+                ok = fwrite(&header, sizeof(header), 1, f) == 1;
+                ok = ok && fwrite(index.data(), sizeof(RecordIndex), nfunction, f) == nfunction;
+                for (std::size_t i=0; ok && i<nfunction; ++i) {
+                    ok = fwrite(records[i].data(), 1, records[i].size(), f) == records[i].size();
+                    std::vector<unsigned char>().swap(records[i]);
+                }
+                ok = (fclose(f) == 0) && ok;
+                ok = ok && rename(tmpname.c_str(), filename.c_str()) == 0;
+                if (!ok) remove(tmpname.c_str());
+            }
+            if (ok) nbyte_written = offset;
+            records.clear();
+            finished = true;
+        }
+    };
+
+
+    CheckpointWriter::CheckpointWriter(const std::string& filename, ProcessID nfile, ProcessID file,
+                                       std::vector< std::vector<unsigned char> >&& records,
+                                       const std::vector<std::uint64_t>& nnode, bool compress)
+        : state(std::make_shared<State>())
+    {
+        state->filename = filename;
+        memcpy(state->header.magic, checkpoint_magic, sizeof(checkpoint_magic));
+        state->header.version = checkpoint_version;
+        state->header.nfile = nfile;
+        state->header.file = file;
+        state->header.nfunction = records.size();
+        state->records = std::move(records);
+        state->nnode = nnode;
+        state->compress = compress;
+        std::shared_ptr<State> s = state;
+        thread = std::thread([s] {s->write();});
+    }
+
+    CheckpointWriter& CheckpointWriter::operator=(CheckpointWriter&& other) {
+        if (this != &other) {
+            if (thread.joinable()) thread.join();
+            state = std::move(other.state);
+            thread = std::move(other.thread);
+        }
+        return *this;
+    }
+
+    CheckpointWriter::~CheckpointWriter() {
+        if (thread.joinable()) thread.join();
+    }
+
+    void CheckpointWriter::wait(World& world) {
+        if (thread.joinable()) thread.join();
+        int failed = (state && !state->ok) ? 1 : 0;
+        world.gop.max(failed);
+        if (failed) MADNESS_EXCEPTION("checkpoint: could not write the file of a process", failed);
+    }
+
+    bool CheckpointWriter::done() const {
+        return !state || state->finished;
+    }
+
+    std::size_t CheckpointWriter::nbyte_written() const {
+        return state ? state->nbyte_written : 0;
+    }
+
+    std::size_t CheckpointWriter::nbyte_raw() const {
+        return state ? state->nbyte_raw : 0;
+    }
+
+    std::vector< std::vector<unsigned char> > CheckpointWriter::read(const std::string& filename, ProcessID& nfile,
+                                                                      std::vector<std::uint64_t>& nnode) {
+        FILE* f = fopen(filename.c_str(), "rb");
+        if (!f) MADNESS_EXCEPTION(("checkpoint: cannot open " + filename).c_str(), 0);
+
+        CheckpointHeader h;
+        bool ok = fread(&h, sizeof(h), 1, f) == 1
+            && memcmp(h.magic, checkpoint_magic, sizeof(checkpoint_magic)) == 0
+            && h.version == checkpoint_version;
+        std::vector<RecordIndex> index(ok ? h.nfunction : 0);
+        ok = ok && fread(index.data(), sizeof(RecordIndex), index.size(), f) == index.size();
+
+        std::vector< std::vector<unsigned char> > records(index.size());
+        nnode.resize(index.size());
+        for (std::size_t i=0; ok && i<index.size(); ++i) {
+            std::vector<unsigned char> stored(index[i].nbyte);
+            ok = fseeko(f, off_t(index[i].offset), SEEK_SET) == 0
+                && fread(stored.data(), 1, stored.size(), f) == stored.size();
+            if (!ok) break;
+            if (index[i].compressed) unpack(stored, index[i].nbyte_raw, records[i]);
+            else records[i].swap(stored);
+            nnode[i] = index[i].nnode;
+        }
+        fclose(f);
+        if (!ok) MADNESS_EXCEPTION(("checkpoint: cannot read " + filename).c_str(), 0);
+        nfile = ProcessID(h.nfile);
+        return records;
+    }
+
+}
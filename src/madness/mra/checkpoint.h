@@ -0,0 +1,231 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_MRA_CHECKPOINT_H__INCLUDED
+#define MADNESS_MRA_CHECKPOINT_H__INCLUDED
+
+/// \file mra/checkpoint.h
+/// \brief Asynchronous parallel checkpoints of functions, one file per process
+/// \ingroup function
+
+#include <madness/mra/mra.h>
+#include <madness/world/vector_archive.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace madness {
+
+    /// A checkpoint being written in the background by this process
+
+    /// save_checkpoint() copies the local nodes of the functions into
+    /// memory and returns; a thread of this process then compresses and
+    /// writes them while the computation goes on.  The copy costs as much
+    /// memory as the local coefficients until the file is written.
+    ///
+    /// Each process writes the file \c name.ckpt.<rank> holding a header,
+    /// an index with one record per function and the records.  A record
+    /// holds the parameters of the function and its local nodes,
+    /// serialized and optionally compressed with a lossless byte shuffle
+    /// and run-length encoding.  A file is renamed into place only once
+    /// complete, so a crash leaves the previous checkpoint intact.
+    class CheckpointWriter {
+    public:
+        /// The checkpoint is complete once wait() returns
+        CheckpointWriter() = default;
+
+        CheckpointWriter(CheckpointWriter&&) = default;
+        CheckpointWriter& operator=(CheckpointWriter&& other);
+
+        /// Starts writing the serialized functions \c records to \c filename
+
+        /// @param[in]  records     one serialized record per function ... taken over
+        /// @param[in]  nnode       the number of nodes in each record
+        CheckpointWriter(const std::string& filename, ProcessID nfile, ProcessID file,
+                         std::vector< std::vector<unsigned char> >&& records,
+                         const std::vector<std::uint64_t>& nnode, bool compress);
+
+        /// Waits for the file of this process, without communication
+        ~CheckpointWriter();
+
+        /// Wait until all processes have written their files ... collective
+
+        /// Throws if any process could not write its file.
+        void wait(World& world);
+
+        /// True if this process has written its file (or failed to)
+        bool done() const;
+
+        /// Bytes written by this process, valid after wait()
+        std::size_t nbyte_written() const;
+
+        /// Bytes of the uncompressed records of this process
+        std::size_t nbyte_raw() const;
+
+        /// Read the records of the file \c filename, uncompressed
+
+        /// @param[out] nfile   the number of files of the checkpoint
+        /// @param[out] nnode   the number of nodes in each record
+        static std::vector< std::vector<unsigned char> > read(const std::string& filename, ProcessID& nfile,
+                                                               std::vector<std::uint64_t>& nnode);
+
+        /// The name of the file of process \c rank of the checkpoint \c name
+        static std::string filename(const std::string& name, ProcessID rank) {
+            return name + ".ckpt." + std::to_string(rank);
+        }
+
+    private:
+        struct State;
+        std::shared_ptr<State> state;
+        std::thread thread;
+    };
+
+
+    /// The parameters of a function stored at the head of each of its records
+    struct CheckpointFunctionParams {
+        long id = 0;                ///< TensorTypeData<T>::id
+        long ndim = 0;
+        int k = 0;
+        double thresh = 0.0;
+        bool autorefine = false;
+        int tree_state = 0;
+
+        template <typename Archive>
+        void serialize(Archive& ar) {
+            ar & id & ndim & k & thresh & autorefine & tree_state;
+        }
+    };
+
+
+    /// Start an asynchronous checkpoint of the functions \c f ... collective
+
+    /// Returns once the local nodes are copied, so the functions may be
+    /// modified while the checkpoint is written.  Call wait() on the result
+    /// before relying on the files, e.g. before the next checkpoint with the
+    /// same name.
+    /// @param[in]  compress    compress the coefficients (lossless)
+    template <typename T, std::size_t NDIM>
+    CheckpointWriter save_checkpoint(const std::vector< Function<T,NDIM> >& f, const std::string& name,
+                                     bool compress=true) {
+        MADNESS_ASSERT(f.size() > 0);
+        World& world = f.front().world();
+        world.gop.fence(); // all operations on the trees are done
+
+        std::vector< std::vector<unsigned char> > records(f.size());
+        std::vector<std::uint64_t> nnode(f.size(), 0);
+        for (std::size_t i=0; i<f.size(); ++i) {
+            const FunctionImpl<T,NDIM>& impl = *f[i].get_impl();
+            CheckpointFunctionParams p;
+            p.id = TensorTypeData<T>::id;
+            p.ndim = NDIM;
+            p.k = impl.get_k();
+            p.thresh = impl.get_thresh();
+            p.autorefine = impl.get_autorefine();
+            p.tree_state = impl.get_tree_state();
+
+            const typename FunctionImpl<T,NDIM>::dcT& coeffs = impl.get_coeffs();
+            std::size_t nbyte_node = sizeof(T);
+            for (std::size_t d=0; d<NDIM; ++d) nbyte_node *= p.k;
+            archive::VectorOutputArchive ar(records[i], coeffs.size()*(nbyte_node + 128) + 1024);
+            ar & p;
+            for (auto it=coeffs.begin(); it!=coeffs.end(); ++it) {
+                ar & it->first & it->second;
+                ++nnode[i];
+            }
+        }
+        return CheckpointWriter(CheckpointWriter::filename(name, world.rank()), world.size(), world.rank(),
+                                std::move(records), nnode, compress);
+    }
+
+
+    /// Load the functions of a checkpoint written by any number of processes ... collective
+
+    /// Each process reads a share of the files and sends the nodes to their
+    /// owners under the default process map of the new functions.
+    template <typename T, std::size_t NDIM>
+    std::vector< Function<T,NDIM> > load_checkpoint(World& world, const std::string& name) {
+        world.gop.fence();
+
+        // the number of files and the parameters are taken from the file of rank 0
+        ProcessID nfile = 0;
+        std::vector< std::vector<unsigned char> > records0;
+        std::vector<std::uint64_t> nnode0;
+        std::vector<CheckpointFunctionParams> params;
+        if (world.rank() == 0) {
+            records0 = CheckpointWriter::read(CheckpointWriter::filename(name, 0), nfile, nnode0);
+            params.resize(records0.size());
+            for (std::size_t i=0; i<records0.size(); ++i) {
+                archive::VectorInputArchive ar(records0[i]);
+                ar & params[i];
+            }
+        }
+        world.gop.broadcast(nfile, 0);
+        world.gop.broadcast_serializable(params, 0);
+
+        std::vector< Function<T,NDIM> > f(params.size());
+        for (std::size_t i=0; i<params.size(); ++i) {
+            MADNESS_CHECK(params[i].id == TensorTypeData<T>::id && params[i].ndim == long(NDIM));
+            f[i] = FunctionFactory<T,NDIM>(world).k(params[i].k).thresh(params[i].thresh).empty();
+            f[i].get_impl()->set_autorefine(params[i].autorefine);
+            f[i].get_impl()->set_tree_state(TreeState(params[i].tree_state));
+        }
+
+        for (ProcessID file=world.rank(); file<nfile; file+=world.size()) {
+            std::vector<std::uint64_t> nnode;
+            ProcessID n;
+            std::vector< std::vector<unsigned char> > records = (file == 0) ? std::move(records0)
+                : CheckpointWriter::read(CheckpointWriter::filename(name, file), n, nnode);
+            if (file == 0) nnode = nnode0;
+            MADNESS_CHECK(records.size() == f.size());
+            for (std::size_t i=0; i<records.size(); ++i) {
+                typename FunctionImpl<T,NDIM>::dcT& coeffs = f[i].get_impl()->get_coeffs();
+                archive::VectorInputArchive ar(records[i]);
+                CheckpointFunctionParams p;
+                ar & p;
+                for (std::uint64_t j=0; j<nnode[i]; ++j) {
+                    Key<NDIM> key;
+                    FunctionNode<T,NDIM> node;
+                    ar & key & node;
+                    coeffs.replace(key, node);
+                }
+                std::vector<unsigned char>().swap(records[i]);
+            }
+        }
+        world.gop.fence();
+        return f;
+    }
+
+}
+
+#endif // MADNESS_MRA_CHECKPOINT_H__INCLUDED
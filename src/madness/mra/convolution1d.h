@@ -37,6 +37,7 @@
 #include <limits.h>
 #include <madness/tensor/tensor.h>
 #include <madness/mra/simplecache.h>
+#include <madness/mra/blockstore.h>
 #include <madness/mra/adquad.h>
 #include <madness/mra/twoscale.h>
 #include <madness/tensor/aligned.h>
@@ -153,6 +154,12 @@ namespace madness {
     //     return result;
     // }
 
+    /// Estimate of the memory held by a cached tensor
+    template <typename T>
+    inline std::size_t cache_nbytes(const Tensor<T>& t) {
+        return sizeof(Tensor<T>) + t.size()*sizeof(T);
+    }
+
     /// actual data for 1 dimension and for 1 term and for 1 displacement for a convolution operator
     /// here we keep the transformation matrices
 
@@ -248,6 +255,13 @@ namespace madness {
         }
     };
 
+    /// Estimate of the memory held by cached operator blocks
+    template <typename Q>
+    inline std::size_t cache_nbytes(const ConvolutionData1D<Q>& d) {
+        return sizeof(d) + cache_nbytes(d.R) + cache_nbytes(d.T) + cache_nbytes(d.RU) + cache_nbytes(d.RVT)
+            + cache_nbytes(d.TU) + cache_nbytes(d.TVT) + cache_nbytes(d.Rs) + cache_nbytes(d.Ts);
+    }
+
     /// Provides the common functionality/interface of all 1D convolutions
 
     /// interface for 1 term and for 1 dimension;
@@ -272,6 +286,9 @@ namespace madness {
         mutable SimpleCache<ConvolutionData1D<Q>, 1> ns_cache;
         mutable SimpleCache<ConvolutionData1D<Q>, 2> mod_ns_cache;
 
+        /// Persistent store of the blocks of rnlp, or null
+        std::shared_ptr<OperatorBlockFile> block_file;
+
         virtual ~Convolution1D() {};
 
         Convolution1D(int k, int npt, int maxR, double arg = 0.0)
@@ -301,6 +318,16 @@ namespace madness {
         /// Compute the projection of the operator onto the double order polynomials
         virtual Tensor<Q> rnlp(Level n, Translation lx) const = 0;
 
+        /// Estimated number of bytes held in the caches of blocks
+        std::size_t cache_nbytes() const {
+            return rnlp_cache.nbytes() + rnlij_cache.nbytes() + ns_cache.nbytes() + mod_ns_cache.nbytes();
+        }
+
+        /// Use \c file to read blocks of rnlp and to save those that are computed
+        void set_block_file(const std::shared_ptr<OperatorBlockFile>& file) {
+            block_file = file;
+        }
+
         /// Returns true if the block of rnlp is expected to be small
         virtual bool issmall(Level n, Translation lx) const = 0;
 
@@ -507,6 +534,11 @@ namespace madness {
             if (get_issmall(n, lx)) {
                 r = Tensor<Q>(twok);
             }
+            else if (block_file && block_file->read(n, lx, (r = Tensor<Q>(twok)).ptr())) {
+                // from the persistent store ... nothing to compute or save
+                rnlp_cache.set(n, lx, r);
+                return *rnlp_cache.getptr(n,lx);
+            }
             else if (n < natural_level()) {
                 Tensor<Q>  R(2*twok);
                 R(Slice(0,twok-1)) = get_rnlp(n+1,2*lx);
@@ -529,6 +561,7 @@ namespace madness {
                     r = rnlp(n, lx);
                 }
             }
+            if (block_file && !get_issmall(n, lx)) block_file->write(n, lx, r.ptr());
 
             rnlp_cache.set(n, lx, r);
             //print("   SET rnlp", n, lx, r);
@@ -845,11 +878,23 @@ namespace madness {
     };
 
 
+    /// Process-wide cache of 1D Gaussian convolutions, shared by all operators
+
+    /// Each convolution holds its own caches of operator blocks, which can grow
+    /// large.  If the budget of SimpleCacheStats is exceeded the least recently
+    /// used convolutions that are not referenced by any operator are dropped.
     template <typename Q>
     struct GaussianConvolution1DCache {
-        static ConcurrentHashMap<hashT, std::shared_ptr< GaussianConvolution1D<Q> > > map;
-        typedef typename ConcurrentHashMap<hashT, std::shared_ptr< GaussianConvolution1D<Q> > >::iterator iterator;
-        typedef typename ConcurrentHashMap<hashT, std::shared_ptr< GaussianConvolution1D<Q> > >::datumT datumT;
+        /// A cached convolution with the time stamp of its last use
+        struct entryT {
+            std::shared_ptr< GaussianConvolution1D<Q> > conv;
+            std::uint64_t last_use = 0;
+        };
+
+        static ConcurrentHashMap<hashT, entryT > map;
+        typedef typename ConcurrentHashMap<hashT, entryT >::iterator iterator;
+        typedef typename ConcurrentHashMap<hashT, entryT >::accessor accessor;
+        typedef typename ConcurrentHashMap<hashT, entryT >::datumT datumT;
 
         static std::shared_ptr< GaussianConvolution1D<Q> > get(int k, double expnt, int m, bool periodic) {
             hashT key = hash_value(expnt);
@@ -860,35 +905,82 @@ namespace madness {
             MADNESS_PRAGMA_CLANG(diagnostic push)
             MADNESS_PRAGMA_CLANG(diagnostic ignored "-Wundefined-var-template")
 
-            iterator it = map.find(key);
-            if (it == map.end()) {
-                map.insert(datumT(key, std::make_shared< GaussianConvolution1D<Q> >(k,
-                                                                                    Q(sqrt(expnt/constants::pi)),
-                                                                                    expnt,
-                                                                                    m,
-                                                                                    periodic
-                                                                                    )));
-                it = map.find(key);
-                //printf("conv1d: making  %d %.8e\n",k,expnt);
+            std::shared_ptr< GaussianConvolution1D<Q> > result;
+            {
+                accessor a;
+                if (map.insert(a, key)) {
+                    a->second.conv = std::make_shared< GaussianConvolution1D<Q> >(k,
+                                                                                 Q(sqrt(expnt/constants::pi)),
+                                                                                 expnt,
+                                                                                 m,
+                                                                                 periodic
+                                                                                 );
+                    a->second.conv->set_block_file(
+                        OperatorBlockStore::open(std::is_same<Q,double>::value ? "double" : "complex",
+                                                 k, expnt, m, periodic, 2*k*sizeof(Q)));
+                    SimpleCacheStats::miss();
+                    //printf("conv1d: making  %d %.8e\n",k,expnt);
+                }
+                else {
+                    SimpleCacheStats::hit();
+                    //printf("conv1d: reusing %d %.8e\n",k,expnt);
+                }
+                a->second.last_use = SimpleCacheStats::next_tick();
+                result = a->second.conv;
+            }
+            if (SimpleCacheStats::over_budget()) evict();
+            return result;
+
+            MADNESS_PRAGMA_CLANG(diagnostic pop)
+
+        }
+
+        /// Drop least recently used convolutions not in use until the caches are within budget
+
+        /// A convolution is in use if an operator holds a reference to it, in
+        /// which case dropping it would not free any memory.
+        static void evict() {
+            static Mutex mutex;
+            if (!mutex.try_lock()) return; // another thread is evicting
+
+            MADNESS_PRAGMA_CLANG(diagnostic push)
+            MADNESS_PRAGMA_CLANG(diagnostic ignored "-Wundefined-var-template")
+
+            std::vector< std::pair<std::uint64_t,hashT> > candidates;
+            for (iterator it=map.begin(); it!=map.end(); ++it) {
+                if (it->second.conv.use_count() == 1)
+                    candidates.push_back(std::make_pair(it->second.last_use, it->first));
             }
-            else {
-                //printf("conv1d: reusing %d %.8e\n",k,expnt);
+            std::sort(candidates.begin(), candidates.end());
+            for (const auto& c : candidates) {
+                if (!SimpleCacheStats::over_budget()) break;
+                std::shared_ptr< GaussianConvolution1D<Q> > victim;
+                {
+                    accessor a;
+                    if (!map.find(a, c.second)) continue;
+                    // a concurrent get() may have picked it up since the scan
+                    if (a->second.conv.use_count() != 1 || a->second.last_use != c.first) continue;
+                    victim = a->second.conv;
+                    map.erase(a);
+                }
+                victim.reset(); // releases the caches outside the lock of the map
+                SimpleCacheStats::evict();
             }
-            return it->second;
 
             MADNESS_PRAGMA_CLANG(diagnostic pop)
 
+            mutex.unlock();
         }
     };
 
     // instantiated in mra1.cc
     template <>
-    ConcurrentHashMap< hashT, std::shared_ptr< GaussianConvolution1D<double> > >
+    ConcurrentHashMap< hashT, GaussianConvolution1DCache<double>::entryT >
         GaussianConvolution1DCache<double>::map;
 
     // instantiated in mra1.cc
     template <>
-    ConcurrentHashMap< hashT, std::shared_ptr< GaussianConvolution1D<double_complex> > >
+    ConcurrentHashMap< hashT, GaussianConvolution1DCache<double_complex>::entryT >
         GaussianConvolution1DCache<double_complex>::map;
 
 }
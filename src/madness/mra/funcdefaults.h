@@ -213,6 +213,8 @@ namespace madness {
         static bool truncate_on_project; ///< If true initial projection inserts at n-1 not n
         static bool apply_randomize;   ///< If true use randomization for load balancing in apply integral operator
         static bool project_randomize; ///< If true use randomization for load balancing in project/refine
+        static std::size_t apply_aggregate_bytes; ///< Size of the per-process buffers of remote results of apply, 0 to disable
+        static double apply_aggregate_time; ///< Maximum time in seconds a remote result of apply stays in the buffer
         static BoundaryConditions<NDIM> bc; ///< Default boundary conditions
         static Tensor<double> cell ;   ///< cell[NDIM][2] Simulation cell, cell(0,0)=xlo, cell(0,1)=xhi, ...
         static Tensor<double> cell_width;///< Width of simulation cell in each dimension
@@ -394,6 +396,34 @@ namespace madness {
         }
 
 
+        /// Gets the size of the buffers aggregating remote results of integral operators
+        static std::size_t get_apply_aggregate_bytes() {
+        	return apply_aggregate_bytes;
+        }
+
+        /// Sets the size of the buffers aggregating remote results of integral operators
+
+        /// Results of apply for nodes on another process are summed per node in
+        /// a buffer for that process, which is sent as one message when it holds
+        /// this many bytes, when its oldest result is older than
+        /// get_apply_aggregate_time(), when the process has no other tasks, or
+        /// at the next fence.  0 (the default) sends each result as its own
+        /// message; try 1<<18 when apply is dominated by many small messages.
+        static void set_apply_aggregate_bytes(std::size_t value) {
+        	apply_aggregate_bytes=value;
+        }
+
+        /// Gets the maximum time in seconds a remote result of an integral operator is buffered
+        static double get_apply_aggregate_time() {
+        	return apply_aggregate_time;
+        }
+
+        /// Sets the maximum time in seconds a remote result of an integral operator is buffered
+        static void set_apply_aggregate_time(double value) {
+        	apply_aggregate_time=value;
+        }
+
+
         /// Gets the random load balancing for projection flag
         static bool get_project_randomize() {
         	return project_randomize;
@@ -506,6 +536,7 @@ namespace madness {
 
         /// Sets the default process map and redistributes all functions using the old map
         static void redistribute(World& world, const std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >& newpmap) {
+        	if (newpmap == pmap) return;   // e.g. LoadBalanceSFC kept the current map
         	pmap->redistribute(world,newpmap);
         	pmap = newpmap;
         }
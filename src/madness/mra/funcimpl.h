@@ -48,6 +48,7 @@
 #include <madness/mra/key.h>
 #include <madness/mra/funcdefaults.h>
 #include <madness/mra/function_factory.h>
+#include <madness/mra/lbsfc.h>
 
 #include "leafop.h"
 
@@ -953,6 +954,16 @@ namespace madness {
 
         dcT coeffs; ///< The coefficients
 
+        /// Results of do_apply for the nodes of one remote process, summed per node when sent
+        struct accumulate_bufferT {
+            std::vector< std::pair<keyT,tensorT> > blocks;
+            std::size_t nbytes = 0;
+            double start = 0.0; ///< wall time of the oldest result
+        };
+        ConcurrentHashMap<ProcessID, accumulate_bufferT> accumulate_buffers; ///< One buffer per remote process
+        std::atomic<bool> accumulate_hook; ///< True if the buffers are flushed by the next fence
+        std::atomic<double> accumulate_checked{0.0}; ///< wall time of the last check for old buffers
+
         // Disable the default copy constructor
         FunctionImpl(const FunctionImpl<T,NDIM>& p);
 
@@ -988,6 +999,8 @@ namespace madness {
 //		  , redundant(false)
 		  , tree_state(factory._tree_state)
             , coeffs(world,factory._pmap,false)
+            , accumulate_buffers(13)
+            , accumulate_hook(false)
             //, bc(factory._bc)
         {
             // PROFILE_MEMBER_FUNC(FunctionImpl); // No need to profile this
@@ -1053,6 +1066,8 @@ namespace madness {
                 , functor()
                 , tree_state(other.tree_state)
                 , coeffs(world, pmap ? pmap : other.coeffs.get_pmap())
+                , accumulate_buffers(13)
+                , accumulate_hook(false)
         {
             if (dozero) {
                 initial_level = 1;
@@ -1063,7 +1078,12 @@ namespace madness {
             this->process_pending();
         }
 
-        virtual ~FunctionImpl() { }
+        virtual ~FunctionImpl() {
+            world.gop.remove_fence_hook(this);
+            for (auto it=accumulate_buffers.begin(); it!=accumulate_buffers.end(); ++it) {
+                MADNESS_ASSERT(it->second.blocks.empty()); // results of apply were lost
+            }
+        }
 
         const std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > >& get_pmap() const;
 
@@ -1296,6 +1316,33 @@ namespace madness {
         /// @param[in] v vector of Future<bool>'s that specify whether the current nodes children have coeffs
         bool truncate_op(const keyT& key, double tol, const std::vector< Future<bool> >& v);
 
+        /// Truncate in compressed form and leave the tree in finalstate, with optional global fence
+
+        /// The tree must be reconstructed or compressed, finalstate must be
+        /// reconstructed or compressed.  A reconstructed tree is compressed and
+        /// truncated in the same bottom-up sweep; for finalstate==reconstructed
+        /// the top-down sweep starts as soon as the root is done, so there is
+        /// no fence between the steps.  Gives the same tree as
+        /// compress, truncate and reconstruct one after the other.
+        /// If tol<=0 the default value of this->thresh is used
+        void truncate_to_state(double tol, const TreeState finalstate, bool fence);
+
+        /// Compresses the subtree at key and truncates it on the way up
+
+        /// Assumed to be invoked on process owning key.
+        /// @return the sum coefficients of key and whether key keeps coefficients
+        Future< std::pair<coeffT,bool> > compress_truncate_spawn(const keyT& key, double tol);
+
+        /// compress_op followed by truncate_op on the results of the children
+        std::pair<coeffT,bool> compress_truncate_op(const keyT& key, double tol,
+                                                    const std::vector< Future< std::pair<coeffT,bool> > >& v);
+
+        /// Starts the reconstruction from the root once truncate_spawn is done
+        void reconstruct_after_truncate(const bool& has_coeff);
+
+        /// Starts the reconstruction from the root once compress_truncate_spawn is done
+        void reconstruct_after_compress_truncate(const std::pair<coeffT,bool>& root);
+
         /// Evaluate function at quadrature points in the specified box
 
         /// @param[in] key the key indicating where the quadrature points are located
@@ -1887,6 +1934,7 @@ namespace madness {
         template <typename L, typename R>
         void do_mul(const keyT& key, const Tensor<L>& left, const std::pair< keyT, Tensor<R> >& arg) {
             // PROFILE_MEMBER_FUNC(FunctionImpl); // Too fine grain for routine profiling
+            typename TaskCostRecorder<NDIM>::scope cost_scope(key);
             const keyT& rkey = arg.first;
             const Tensor<R>& rcoeff = arg.second;
             //madness::print("do_mul: r", rkey, rcoeff.size());
@@ -2644,6 +2692,70 @@ namespace madness {
             }
         }
 
+#if !HAVE_GENTENSOR
+        /// Transform the boxes [start,end) of the functions in vright, see vtransform_boxwise
+        template <typename Q, typename R>
+        void vtransform_boxwise_doit(const std::shared_ptr<typename FunctionImpl<R,NDIM>::mapT> map,
+                                     const typename FunctionImpl<R,NDIM>::mapT::iterator start,
+                                     const typename FunctionImpl<R,NDIM>::mapT::iterator end,
+                                     const Tensor<Q>& c,
+                                     const std::vector< std::shared_ptr< FunctionImpl<T,NDIM> > >& vleft,
+                                     double tol) {
+            const long m = c.dim(1);
+            for (typename FunctionImpl<R,NDIM>::mapT::iterator it=start; it!=end; ++it) {
+                const keyT& key = it->first;
+                const typename FunctionImpl<R,NDIM>::mapvecT& vright = it->second;
+                const double keytol = truncate_tol(tol,key);
+                const long n = vright.size();
+
+                std::vector<double> norm(n);
+                for (long jj=0; jj<n; ++jj) norm[jj] = vright[jj].second->normf();
+
+                // the outputs with at least one term above keytol
+                std::vector<long> outputs;
+                for (long i=0; i<m; ++i) {
+                    for (long jj=0; jj<n; ++jj) {
+                        if (std::abs(norm[jj]*c(vright[jj].first,i)) > keytol) {
+                            outputs.push_back(i);
+                            break;
+                        }
+                    }
+                }
+                if (outputs.empty()) continue;
+
+                const long size = vright[0].second->size();
+                Tensor<R> V(n, size);
+                for (long jj=0; jj<n; ++jj) V(jj,_) = *(vright[jj].second);
+                Tensor<Q> U(n, long(outputs.size()));
+                for (std::size_t ii=0; ii<outputs.size(); ++ii) {
+                    for (long jj=0; jj<n; ++jj) {
+                        const Q cji = c(vright[jj].first,outputs[ii]);
+                        if (std::abs(norm[jj]*cji) > keytol) U(jj,ii) = cji;
+                    }
+                }
+                Tensor<T> result(long(outputs.size()), size);
+                mTxm(outputs.size(), size, n, result.ptr(), U.ptr(), V.ptr());
+
+                for (std::size_t ii=0; ii<outputs.size(); ++ii) {
+                    implT* left = vleft[outputs[ii]].get();
+                    typename dcT::accessor acc;
+                    bool newnode = left->coeffs.insert(acc,key);
+                    if (newnode && key.level()>0) {
+                        Key<NDIM> parent = key.parent();
+                        if (left->coeffs.is_local(parent))
+                            left->coeffs.send(parent, &nodeT::set_has_children_recursive, left->coeffs, parent);
+                        else
+                            left->coeffs.task(parent, &nodeT::set_has_children_recursive, left->coeffs, parent);
+                    }
+                    nodeT& node = acc->second;
+                    tensorT t = copy(result(ii,_)).reshape(cdata.v2k);
+                    if (node.has_coeff()) node.coeff().gaxpy(1.0, coeffT(t,targs), 1.0);
+                    else node.set_coeff(coeffT(t,targs));
+                }
+            }
+        }
+#endif
+
         /// Refine multiple functions down to the same finest level
 
         /// @param v the vector of functions we are refining.
@@ -2747,7 +2859,88 @@ namespace madness {
             if (fence) world.gop.fence();
         }
 
+        /// Inplace operate on many functions (impl's) with an operator within many boxes
+
+        /// The operator is called once for all boxes of the batch as op(keys,c),
+        /// where c[ibox] are the values of the input functions in box keys[ibox],
+        /// and returns the values of the output functions in each box.
+        /// @param[in] keys the keys of the boxes
+        /// @param[in] op the operator
+        /// @param[in] vin the vector of function impl's on which to be operated
+        /// @param[out] vout the resulting vector of function impl's
+        template <typename opT>
+        void multi_to_multi_op_values_batch_doit(const std::vector<keyT>& keys, const opT& op,
+                const std::vector<implT*>& vin, std::vector<implT*>& vout) {
+            std::vector< std::vector<tensorT> > c(keys.size(), std::vector<tensorT>(vin.size()));
+            for (std::size_t ibox=0; ibox<keys.size(); ++ibox) {
+                for (unsigned int i=0; i<vin.size(); i++) {
+                    if (vin[i]) {
+                        coeffT cc = coeffs2values(keys[ibox], vin[i]->coeffs.find(keys[ibox]).get()->second.coeff());
+                        c[ibox][i]=cc.full_tensor();
+                    }
+                }
+            }
+            std::vector< std::vector<tensorT> > r = op(keys, c);
+            MADNESS_ASSERT(r.size()==keys.size());
+            for (std::size_t ibox=0; ibox<keys.size(); ++ibox) {
+                MADNESS_ASSERT(r[ibox].size()==vout.size());
+                for (std::size_t i=0; i<vout.size(); ++i) {
+                    vout[i]->coeffs.replace(keys[ibox], nodeT(coeffT(values2coeffs(keys[ibox], r[ibox][i]),targs),false));
+                }
+            }
+        }
+
+        /// Inplace operate on many functions (impl's) with an operator on batches of boxes
+
+        /// As multi_to_multi_op_values, but the local boxes are handed to the
+        /// operator in batches of nbatch boxes, so its cost per call is spread
+        /// over many boxes.
+        /// @param[in] op the operator, see multi_to_multi_op_values_batch_doit
+        /// @param[in] vin the vector of function impl's on which to be operated
+        /// @param[out] vout the resulting vector of function impl's
+        /// @param[in] nbatch the number of boxes per call of the operator
+        template <typename opT>
+        void multi_to_multi_op_values_batch(const opT& op, const std::vector<implT*>& vin,
+                std::vector<implT*>& vout, const std::size_t nbatch, const bool fence=true) {
+            MADNESS_ASSERT(nbatch>0);
+            // rough check on refinement level (ignore non-initialized functions
+            for (std::size_t i=1; i<vin.size(); ++i) {
+                if (vin[i] and vin[i-1]) {
+                    MADNESS_ASSERT(vin[i]->coeffs.size()==vin[i-1]->coeffs.size());
+                }
+            }
+            std::vector<keyT> keys;
+            keys.reserve(nbatch);
+            typename dcT::iterator end = vin[0]->coeffs.end();
+            for (typename dcT::iterator it=vin[0]->coeffs.begin(); it!=end; ++it) {
+                const keyT& key = it->first;
+                if (it->second.has_coeff()) {
+                    keys.push_back(key);
+                    if (keys.size()==nbatch) {
+                        world.taskq.add(*this, &implT:: template multi_to_multi_op_values_batch_doit<opT>,
+                                keys, op, vin, vout);
+                        keys.clear();
+                    }
+                }
+                else {
+                    // fill result functions with empty box in this key
+                    for (implT* it2 : vout) {
+                        it2->coeffs.replace(key, nodeT(coeffT(),true));
+                    }
+                }
+            }
+            if (keys.size()>0) world.taskq.add(*this, &implT:: template multi_to_multi_op_values_batch_doit<opT>,
+                    keys, op, vin, vout);
+            if (fence) world.gop.fence();
+        }
+
         /// Transforms a vector of functions left[i] = sum[j] right[j]*c[j,i] using sparsity
+
+        /// The functions are transformed box by box: at each local box the
+        /// coefficients of all right functions are multiplied by the slice of
+        /// c as one matrix product, and the results are added to the left
+        /// functions.  The term of right[j] in left[i] is left out if
+        /// |c(j,i)|*||right[j]||_box is below truncate_tol(tol,key).
         /// @param[in] vright vector of functions (impl's) on which to be transformed
         /// @param[in] c the tensor (matrix) transformer
         /// @param[in] vleft vector of of the *newly* transformed functions (impl's)
@@ -2757,9 +2950,27 @@ namespace madness {
                         const std::vector< std::shared_ptr< FunctionImpl<T,NDIM> > >& vleft,
                         double tol,
                         bool fence) {
+#if HAVE_GENTENSOR
             for (unsigned int j=0; j<vright.size(); ++j) {
                 world.taskq.add(*this, &implT:: template vtransform_doit<Q,R>, vright[j], copy(c(j,_)), vleft, tol);
             }
+#else
+            typedef typename FunctionImpl<R,NDIM>::mapT maprT;
+            std::vector<const FunctionImpl<R,NDIM>*> right(vright.size());
+            for (unsigned int j=0; j<vright.size(); ++j) right[j] = vright[j].get();
+            // the map lives until the last task is done
+            std::shared_ptr<maprT> map(new maprT(FunctionImpl<R,NDIM>::make_key_vec_map(right)));
+            const Tensor<Q> cc = copy(c);
+
+            size_t chunk = (map->size()-1)/(3*4*5)+1;
+            typename maprT::iterator start = map->begin();
+            while (start != map->end()) {
+                typename maprT::iterator end = start;
+                advance(end,chunk);
+                world.taskq.add(*this, &implT:: template vtransform_boxwise_doit<Q,R>, map, start, end, cc, vleft, tol);
+                start = end;
+            }
+#endif
             if (fence)
                 world.gop.fence();
         }
@@ -2897,6 +3108,7 @@ namespace madness {
                     double tol) {
             typedef typename FunctionImpl<L,NDIM>::dcT::const_iterator literT;
             typedef typename FunctionImpl<R,NDIM>::dcT::const_iterator riterT;
+            typename TaskCostRecorder<NDIM>::scope cost_scope(key);
 
             double lnorm=1e99, rnorm=1e99;
 
@@ -3209,6 +3421,18 @@ namespace madness {
         void sock_it_to_me_too(const keyT& key,
                                const RemoteReference< FutureImpl< std::pair<keyT,coeffT> > >& ref) const;
 
+        /// sock_it_to_me for many keys owned by this process, with aggregated messages
+
+        /// Keys that are not in the tree are forwarded to their parents in
+        /// one message per owner of the parents, and the results go back in
+        /// one message per requesting process (set_neighbors).
+        void sock_it_to_me_many(const std::vector<keyT>& keys,
+                                const std::vector< RemoteReference< FutureImpl< std::pair<keyT,coeffT> > > >& refs) const;
+
+        /// Sets the local futures requested through sock_it_to_me_many
+        void set_neighbors(const std::vector< std::pair<keyT,coeffT> >& values,
+                           const std::vector< RemoteReference< FutureImpl< std::pair<keyT,coeffT> > > >& refs) const;
+
         /// @todo help!
         void plot_cube_kernel(archive::archive_ptr< Tensor<T> > ptr,
                               const keyT& key,
@@ -3243,6 +3467,27 @@ namespace madness {
                   const keyT& keyin,
                   const typename Future<T>::remote_refT& ref);
 
+        /// Evaluate the function at many points in \em simulation coordinates ... collective
+
+        /// Each process passes its own (possibly empty) list of points and
+        /// gets their values back in the same order.  The points are sorted
+        /// into boxes while descending the tree, travel to the owners of the
+        /// boxes in one message per destination, and each leaf evaluates its
+        /// polynomial once for all of its points.
+        std::vector<T> eval_many(const std::vector<coordT>& xin) const;
+
+        /// Moves a batch of points of eval_many down the locally owned part of the tree
+
+        /// Point i is at x[i] (simulation coordinates) in box keys[i] and
+        /// its value goes to element index[i] of *result on the requester.
+        void eval_many_kernel(archive::archive_ptr< std::vector<T> > result, ProcessID requester,
+                              const std::vector<long>& index, const std::vector<coordT>& x,
+                              const std::vector<keyT>& keys) const;
+
+        /// Stores values computed by eval_many_kernel on the requesting process
+        void eval_many_store(archive::archive_ptr< std::vector<T> > result,
+                             const std::vector<long>& index, const std::vector<T>& values) const;
+
         /// Get the depth of the tree at a point in \em simulation coordinates
 
         /// Only the invoking process will get the result via the
@@ -3740,6 +3985,26 @@ namespace madness {
         // Called by result function to differentiate f
         void diff(const DerivativeBase<T,NDIM>* D, const implT* f, bool fence);
 
+        /// Applies the derivatives D[i] to this function, putting the results into df[i]
+
+        /// The neighbors of all local leaves along all axes (the halo) are
+        /// fetched first, with one request per owning process, and the
+        /// leaves are then differentiated in batches.  Only where a neighbor
+        /// is refined further does it fall back to the recursion of do_diff1.
+        /// The df[i] must have been initialized with the distribution of this.
+        void diff_many(const std::vector<const DerivativeBase<T,NDIM>*>& D,
+                       const std::vector<implT*>& df, bool fence) const;
+
+        /// Differentiates a batch of leaves of this for all derivatives of diff_many
+
+        /// left and right hold the neighbors of leaf i for derivative j at i*D.size()+j
+        void do_diff_many(const std::vector<const DerivativeBase<T,NDIM>*>& D,
+                          const std::vector<implT*>& df,
+                          const std::vector<keyT>& keys,
+                          const std::vector< Future< std::pair<keyT,coeffT> > >& left,
+                          const std::vector< std::pair<keyT,coeffT> >& center,
+                          const std::vector< Future< std::pair<keyT,coeffT> > >& right) const;
+
         /// Returns key of general neighbor enforcing BC
 
         /// Out of volume keys are mapped to enforce the BC as follows.
@@ -4324,6 +4589,12 @@ namespace madness {
 
         T eval_cube(Level n, coordT& x, const tensorT& c) const;
 
+        /// Evaluates the polynomial of one box at many points given in the unit box
+
+        /// The first dimension is contracted for all points at once with a
+        /// matrix product, the remaining ones point by point.
+        void eval_cube_many(Level n, const std::vector<coordT>& x, const tensorT& c, T* values) const;
+
         /// Transform sum coefficients at level n to sums+differences at level n-1
 
         /// Given scaling function coefficients s[n][l][i] and s[n][l+1][i]
@@ -4687,6 +4958,7 @@ namespace madness {
         template <typename opT, typename R>
         void do_apply(const opT* op, const keyT& key, const Tensor<R>& c) {
             PROFILE_MEMBER_FUNC(FunctionImpl);
+            typename TaskCostRecorder<NDIM>::scope cost_scope(key);
 
 	    // working assumption here WAS that the operator is
 	    // isotropic and montonically decreasing with distance
@@ -4725,6 +4997,7 @@ namespace madness {
 
             const std::vector<opkeyT>& disp = op->get_disp(key.level()); // list of displacements sorted in orer of increasing distance
             const std::vector<bool> is_periodic(NDIM,false); // Periodic sum is already done when making rnlp
+            const double tol = truncate_tol(thresh, key);
 	    int ndone=1;	// Counts #done at each distance
 	    uint64_t distsq = 99999999999999; 
             for (typename std::vector<opkeyT>::const_iterator it=disp.begin(); it != disp.end(); ++it) {
@@ -4749,20 +5022,111 @@ namespace madness {
                 keyT dest = neighbor(key, d, is_periodic);
                 if (dest.is_valid()) {
                     double opnorm = op->norm(key.level(), *it, source);
-                    double tol = truncate_tol(thresh, key);
 
                     if (cnorm*opnorm> tol/fac) {
 		        ndone++;
-		        tensorT result = op->apply(source, *it, c, tol/fac/cnorm);
-			if (result.normf() > 0.3*tol/fac) {
-			  if (coeffs.is_local(dest))
-			      coeffs.send(dest, &nodeT::accumulate2, result, coeffs, dest);
-			  else
-  			      coeffs.task(dest, &nodeT::accumulate2, result, coeffs, dest);
-                        }
+                        tensorT result = op->apply(source, *it, c, tol/fac/cnorm);
+                        do_apply_accumulate(result, dest, tol/fac);
                     }
                 }
             }
+            flush_old_accumulate_buffers();
+        }
+
+        /// accumulate the result of do_apply into the destination node, if not negligible
+
+        /// Results for remote nodes are buffered per process unless
+        /// FunctionDefaults::get_apply_aggregate_bytes() is zero.
+        void do_apply_accumulate(const tensorT& result, const keyT& dest, const double tol) {
+            if (result.normf() > 0.3*tol) {
+                if (coeffs.is_local(dest))
+                    coeffs.send(dest, &nodeT::accumulate2, result, coeffs, dest);
+                else if (FunctionDefaults<NDIM>::get_apply_aggregate_bytes())
+                    buffer_accumulate(coeffs.owner(dest), dest, result);
+                else
+                    coeffs.task(dest, &nodeT::accumulate2, result, coeffs, dest);
+            }
+        }
+
+        /// add the result of do_apply for the remote node dest to the buffer of its owner p
+
+        /// The buffer is sent when it is full or old, when the process runs
+        /// out of tasks (no more pending tasks than threads), otherwise by the next fence.  Only the append holds
+        /// the lock of the buffer, results for the same node are summed when
+        /// it is sent.  \c result is taken over by the buffer and must not be
+        /// used by the caller.
+        void buffer_accumulate(const ProcessID p, const keyT& dest, const tensorT& result) {
+            bool full;
+            {
+                typename ConcurrentHashMap<ProcessID, accumulate_bufferT>::accessor a;
+                accumulate_buffers.insert(a, p);
+                accumulate_bufferT& buf = a->second;
+                const double now = wall_time();
+                if (buf.blocks.empty()) buf.start = now;
+                buf.blocks.push_back(std::make_pair(dest, result));
+                buf.nbytes += result.size()*sizeof(T);
+                full = buf.nbytes >= FunctionDefaults<NDIM>::get_apply_aggregate_bytes()
+                    || now - buf.start > FunctionDefaults<NDIM>::get_apply_aggregate_time();
+            }
+            if (full) flush_accumulate_buffer(p);
+            else if (!accumulate_hook.exchange(true))
+                world.gop.add_fence_hook(this, [this] {flush_accumulate_buffers();});
+        }
+
+        /// send the buffered results of do_apply for process p
+
+        /// @param[in] maxage   send only if the oldest result is older than this many seconds, -1 always
+        void flush_accumulate_buffer(const ProcessID p, const double maxage=-1.0) {
+            std::vector< std::pair<keyT,tensorT> > blocks;
+            {
+                typename ConcurrentHashMap<ProcessID, accumulate_bufferT>::accessor a;
+                if (!accumulate_buffers.find(a, p)) return;
+                if (a->second.blocks.empty()) return;
+                if (maxage >= 0.0 && wall_time() - a->second.start <= maxage) return;
+                blocks.swap(a->second.blocks);
+                a->second.nbytes = 0;
+            }
+
+            // several source boxes contribute to the same node
+            std::sort(blocks.begin(), blocks.end(),
+                      [](const std::pair<keyT,tensorT>& a, const std::pair<keyT,tensorT>& b) {return a.first < b.first;});
+            std::size_t n = 0;
+            for (std::size_t i=0; i<blocks.size(); ++i) {
+                if (n && blocks[n-1].first == blocks[i].first) blocks[n-1].second += blocks[i].second;
+                else if (n++ != i) blocks[n-1] = blocks[i];
+            }
+            blocks.resize(n);
+            woT::task(p, &implT::accumulate_blocks, blocks, TaskAttributes::hipri());
+        }
+
+        /// send the buffers older than get_apply_aggregate_time(), or all if this process has run out of tasks
+
+        /// Called at the end of each do_apply, the check itself runs at most
+        /// once per tenth of the aggregation time.
+        void flush_old_accumulate_buffers() {
+            if (!accumulate_hook) return;
+            const double maxage = FunctionDefaults<NDIM>::get_apply_aggregate_time();
+            const bool idle = world.taskq.size() <= std::size_t(ThreadPool::size()) + 1;
+            double last = accumulate_checked.load(std::memory_order_relaxed);
+            const double now = wall_time();
+            if (!idle && now - last < 0.1*maxage) return;
+            if (!accumulate_checked.compare_exchange_strong(last, now)) return;
+            std::vector<ProcessID> procs;
+            for (auto it=accumulate_buffers.begin(); it!=accumulate_buffers.end(); ++it) procs.push_back(it->first);
+            for (ProcessID p : procs) flush_accumulate_buffer(p, idle ? -1.0 : maxage);
+        }
+
+        /// send all buffered results of do_apply ... run by the fence
+        void flush_accumulate_buffers() {
+            accumulate_hook = false; // results buffered from now on register the hook again
+            std::vector<ProcessID> procs;
+            for (auto it=accumulate_buffers.begin(); it!=accumulate_buffers.end(); ++it) procs.push_back(it->first);
+            for (ProcessID p : procs) flush_accumulate_buffer(p);
+        }
+
+        /// accumulate the results of do_apply sent by another process into the local nodes
+        void accumulate_blocks(const std::vector< std::pair<keyT,tensorT> >& blocks) {
+            for (const auto& b : blocks) coeffs.send(b.first, &nodeT::accumulate2, b.second, coeffs, b.first);
         }
 
 
@@ -4808,7 +5172,7 @@ namespace madness {
         double do_apply_directed_screening(const opT* op, const keyT& key, const coeffT& coeff,
                                            const bool& do_kernel) {
             PROFILE_MEMBER_FUNC(FunctionImpl);
-            // insert timer here
+            typename TaskCostRecorder<NDIM>::scope cost_scope(key);
             typedef typename opT::keyT opkeyT;
 
             // screening: contains all displacement keys that had small result norms
@@ -5407,6 +5771,8 @@ namespace madness {
                                     const typename mapT::iterator lend,
                                     typename FunctionImpl<R,NDIM>::mapT* rmap_ptr,
                                     const bool sym,
+                                    const bool same,
+                                    const double tol,
                                     Tensor< TENSOR_RESULT_TYPE(T,R) >* result_ptr,
                                     Mutex* mutex) {
             Tensor< TENSOR_RESULT_TYPE(T,R) >& result = *result_ptr;
@@ -5428,7 +5794,8 @@ namespace madness {
                             const int j = rightv[jv].first;
                             const GenTensor<R>* jptr = rightv[jv].second;
 
-                            if (!sym || (sym && i<=j))
+                            if (tol > 0.0 && iptr->normf()*jptr->normf() < tol) continue;
+                            if (!(sym || same) || i<=j)
                                 r(i,j) += iptr->trace_conj(*jptr);
                         }
                     }
@@ -5439,48 +5806,98 @@ namespace madness {
             mutex->unlock();
         }
 #else
+       /// add the contributions of the nodes in [lstart,lend) to result
+
+       /// At each node the coefficients of all functions are multiplied as one
+       /// matrix product.  Functions whose coefficients at the node contribute
+       /// less than tol with any partner are left out.  If both sides are the
+       /// same functions (same) only the blocks on and above the diagonal are
+       /// multiplied, and only the elements i<=j are accumulated.
        template <typename R>
        static void do_inner_localX(const typename mapT::iterator lstart,
                                    const typename mapT::iterator lend,
                                    typename FunctionImpl<R,NDIM>::mapT* rmap_ptr,
                                    const bool sym,
+                                   const bool same,
+                                   const double tol,
                                    Tensor< TENSOR_RESULT_TYPE(T,R) >* result_ptr,
                                    Mutex* mutex) {
-           Tensor< TENSOR_RESULT_TYPE(T,R) >& result = *result_ptr;
-           //Tensor< TENSOR_RESULT_TYPE(T,R) > r(result.dim(0),result.dim(1));
+           typedef TENSOR_RESULT_TYPE(T,R) resultT;
+           Tensor<resultT>& result = *result_ptr;
            for (typename mapT::iterator lit=lstart; lit!=lend; ++lit) {
                const keyT& key = lit->first;
                typename FunctionImpl<R,NDIM>::mapT::iterator rit=rmap_ptr->find(key);
                if (rit != rmap_ptr->end()) {
-                   const mapvecT& leftv = lit->second;
-                   const typename FunctionImpl<R,NDIM>::mapvecT& rightv =rit->second;
+                   mapvecT leftv = lit->second;
+                   typename FunctionImpl<R,NDIM>::mapvecT rightv = rit->second;
+
+                   if (tol > 0.0) {
+                       double lmax = 0.0, rmax = 0.0;
+                       std::vector<double> lnorm(leftv.size()), rnorm(rightv.size());
+                       for (size_t iv=0; iv<leftv.size(); ++iv) lmax = std::max(lmax, lnorm[iv] = leftv[iv].second->normf());
+                       for (size_t jv=0; jv<rightv.size(); ++jv) rmax = std::max(rmax, rnorm[jv] = rightv[jv].second->normf());
+                       size_t n = 0;
+                       for (size_t iv=0; iv<leftv.size(); ++iv) if (lnorm[iv]*rmax >= tol) leftv[n++] = leftv[iv];
+                       leftv.resize(n);
+                       n = 0;
+                       for (size_t jv=0; jv<rightv.size(); ++jv) if (rnorm[jv]*lmax >= tol) rightv[n++] = rightv[jv];
+                       rightv.resize(n);
+                   }
+                   if (leftv.empty() || rightv.empty()) continue;
+
+                   // with the functions in increasing order a block above the diagonal has i<=j
+                   const bool half = same;
+                   if (half) {
+                       auto by_index = [](const auto& a, const auto& b) {return a.first < b.first;};
+                       std::sort(leftv.begin(), leftv.end(), by_index);
+                       std::sort(rightv.begin(), rightv.end(), by_index);
+                   }
+
                    const size_t nleft = leftv.size();
                    const size_t nright= rightv.size();
-
                    unsigned int size = leftv[0].second->size();
                    Tensor<T> Left(nleft, size);
                    Tensor<R> Right(nright, size);
-                   Tensor< TENSOR_RESULT_TYPE(T,R)> r(nleft, nright);
                    for(unsigned int iv = 0; iv < nleft; ++iv) Left(iv,_) = *(leftv[iv].second);
                    for(unsigned int jv = 0; jv < nright; ++jv) Right(jv,_) = *(rightv[jv].second);
                    // call mxmT from mxm.h in tensor
                    if(TensorTypeData<T>::iscomplex) Left = Left.conj();  //Should handle complex case and leave real case alone
-                   mxmT(nleft, nright, size, r.ptr(), Left.ptr(), Right.ptr());
-                   mutex->lock();
-                   for(unsigned int iv = 0; iv < nleft; ++iv) {
-                       const int i = leftv[iv].first;
-                       for(unsigned int jv = 0; jv < nright; ++jv) {
-                         const int j = rightv[jv].first;
-                         if (!sym || (sym && i<=j)) result(i,j) += r(iv,jv);
+
+                   if (half) {
+                       // rows [ib,ib+ni) times columns [ib,nright)
+                       const size_t nb = 32;
+                       for (size_t ib=0; ib<nleft; ib+=nb) {
+                           const size_t ni = std::min(nb, nleft-ib);
+                           const size_t nj = nright-ib;
+                           Tensor<resultT> r(ni, nj);
+                           mxmT(ni, nj, size, r.ptr(), Left.ptr()+ib*size, Right.ptr()+ib*size);
+                           mutex->lock();
+                           for (size_t iv=0; iv<ni; ++iv) {
+                               const int i = leftv[ib+iv].first;
+                               for (size_t jv=iv; jv<nj; ++jv) result(i, rightv[ib+jv].first) += r(iv,jv);
+                           }
+                           mutex->unlock();
                        }
                    }
-                   mutex->unlock();
+                   else {
+                       Tensor<resultT> r(nleft, nright);
+                       mxmT(nleft, nright, size, r.ptr(), Left.ptr(), Right.ptr());
+                       mutex->lock();
+                       for(unsigned int iv = 0; iv < nleft; ++iv) {
+                           const int i = leftv[iv].first;
+                           for(unsigned int jv = 0; jv < nright; ++jv) {
+                               const int j = rightv[jv].first;
+                               if (!sym || (sym && i<=j)) result(i,j) += r(iv,jv);
+                           }
+                       }
+                       mutex->unlock();
+                   }
                }
            }
        }
 #endif
 
-        static double conj(float x) {
+        static double conj(double x) {
             return x;
         }
 
@@ -5488,11 +5905,17 @@ namespace madness {
             return std::conj(x);
         }
 
+        /// the local part of the matrix of inner products of left and right ... no comms
+
+        /// If left and right are the same functions the matrix is Hermitian
+        /// and only its upper triangle is computed.
+        /// @param[in]  sym     the result is Hermitian (for complex types), compute only i<=j
+        /// @param[in]  tol     skip the contributions of nodes below tol to an element (0 for none)
         template <typename R>
         static Tensor< TENSOR_RESULT_TYPE(T,R) >
         inner_local(const std::vector<const FunctionImpl<T,NDIM>*>& left,
                     const std::vector<const FunctionImpl<R,NDIM>*>& right,
-                    bool sym) {
+                    bool sym, const double tol=0.0) {
 
             // This is basically a sparse matrix^T * matrix product
             // Rij = sum(k) Aki * Bkj
@@ -5506,10 +5929,13 @@ namespace madness {
             //             do k in ktile
             //                Rij += Aki*Bkj
 
+            bool same = false;
+            if constexpr (std::is_same<T,R>::value) same = (left == right);
+
             mapT lmap = make_key_vec_map(left);
             typename FunctionImpl<R,NDIM>::mapT rmap;
             typename FunctionImpl<R,NDIM>::mapT* rmap_ptr = (typename FunctionImpl<R,NDIM>::mapT*)(&lmap);
-            if ((std::vector<const FunctionImpl<R,NDIM>*>*)(&left) != &right) {
+            if (!same) {
                 rmap = FunctionImpl<R,NDIM>::make_key_vec_map(right);
                 rmap_ptr = &rmap;
             }
@@ -5523,12 +5949,12 @@ namespace madness {
             while (lstart != lmap.end()) {
                 typename mapT::iterator lend = lstart;
                 advance(lend,chunk);
-                left[0]->world.taskq.add(&FunctionImpl<T,NDIM>::do_inner_localX<R>, lstart, lend, rmap_ptr, sym, &r, &mutex);
+                left[0]->world.taskq.add(&FunctionImpl<T,NDIM>::do_inner_localX<R>, lstart, lend, rmap_ptr, sym, same, tol, &r, &mutex);
                 lstart = lend;
             }
             left[0]->world.taskq.fence();
 
-            if (sym) {
+            if (sym || same) {
                 for (long i=0; i<r.dim(0); i++) {
                     for (long j=0; j<i; j++) {
                         TENSOR_RESULT_TYPE(T,R) sum = r(i,j)+conj(r(j,i));
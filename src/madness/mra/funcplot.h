@@ -428,6 +428,17 @@ namespace madness {
     }
 
 
+    /// Points of plot_line on process 0 and none elsewhere, for Function::eval_many
+    template <std::size_t NDIM>
+    std::vector< Vector<double,NDIM> > plot_line_points(World& world, int npt, const Vector<double,NDIM>& lo,
+                                                        const Vector<double,NDIM>& h) {
+        std::vector< Vector<double,NDIM> > r;
+        if (world.rank() == 0) {
+            for (int i=0; i<npt; ++i) r.push_back(lo + h*double(i));
+        }
+        return r;
+    }
+
     /// Generates ASCII file tabulating f(r) at npoints along line r=lo,...,hi
 
     /// The ordinate is distance from lo
@@ -472,14 +483,15 @@ namespace madness {
 
         World& world = f.world();
         f.reconstruct();
+        const std::vector<coordT> r = plot_line_points(world, npt, lo, h);
+        const std::vector<T> fr = f.eval_many(r);
         if (world.rank() == 0) {
             FILE* file = fopen(filename,"w");
 	    if(!file)
 	      MADNESS_EXCEPTION("plot_line: failed to open the plot file", 0);
             for (int i=0; i<npt; ++i) {
-                coordT r = lo + h*double(i);
                 fprintf(file, "%.14e ", i*sum);
-                plot_line_print_value(file, f.eval(r));
+                plot_line_print_value(file, fr[i]);
                 fprintf(file,"\n");
             }
             fclose(file);
@@ -503,15 +515,17 @@ namespace madness {
         World& world = f.world();
         f.reconstruct();
         g.reconstruct();
+        const std::vector<coordT> r = plot_line_points(world, npt, lo, h);
+        const std::vector<T> fr = f.eval_many(r);
+        const std::vector<U> gr = g.eval_many(r);
         if (world.rank() == 0) {
             FILE* file = fopen(filename,"w");
 	    if(!file)
 	      MADNESS_EXCEPTION("plot_line: failed to open the plot file", 0);
             for (int i=0; i<npt; ++i) {
-                coordT r = lo + h*double(i);
                 fprintf(file, "%.14e ", i*sum);
-                plot_line_print_value(file, f.eval(r));
-                plot_line_print_value(file, g.eval(r));
+                plot_line_print_value(file, fr[i]);
+                plot_line_print_value(file, gr[i]);
                 fprintf(file,"\n");
             }
             fclose(file);
@@ -537,16 +551,19 @@ namespace madness {
         f.reconstruct();
         g.reconstruct();
         a.reconstruct();
+        const std::vector<coordT> r = plot_line_points(world, npt, lo, h);
+        const std::vector<T> fr = f.eval_many(r);
+        const std::vector<U> gr = g.eval_many(r);
+        const std::vector<V> ar = a.eval_many(r);
         if (world.rank() == 0) {
             FILE* file = fopen(filename,"w");
 	    if(!file)
 	      MADNESS_EXCEPTION("plot_line: failed to open the plot file", 0);
             for (int i=0; i<npt; ++i) {
-                coordT r = lo + h*double(i);
                 fprintf(file, "%.14e ", i*sum);
-                plot_line_print_value(file, f.eval(r));
-                plot_line_print_value(file, g.eval(r));
-                plot_line_print_value(file, a.eval(r));
+                plot_line_print_value(file, fr[i]);
+                plot_line_print_value(file, gr[i]);
+                plot_line_print_value(file, ar[i]);
                 fprintf(file,"\n");
             }
             fclose(file);
@@ -572,15 +589,19 @@ namespace madness {
         g.reconstruct();
         a.reconstruct();
         b.reconstruct();
+        const std::vector<coordT> r = plot_line_points(world, npt, lo, h);
+        const std::vector<T> fr = f.eval_many(r);
+        const std::vector<U> gr = g.eval_many(r);
+        const std::vector<V> ar = a.eval_many(r);
+        const std::vector<W> br = b.eval_many(r);
         if (world.rank() == 0) {
             FILE* file = fopen(filename,"w");
             for (int i=0; i<npt; ++i) {
-                coordT r = lo + h*double(i);
                 fprintf(file, "%.14e ", i*sum);
-                plot_line_print_value(file, f.eval(r));
-                plot_line_print_value(file, g.eval(r));
-                plot_line_print_value(file, a.eval(r));
-                plot_line_print_value(file, b.eval(r));
+                plot_line_print_value(file, fr[i]);
+                plot_line_print_value(file, gr[i]);
+                plot_line_print_value(file, ar[i]);
+                plot_line_print_value(file, br[i]);
                 fprintf(file,"\n");
             }
             fclose(file);
@@ -599,14 +620,16 @@ namespace madness {
         World& world = vf[0].world();// get world from first function
         // reconstruct each function in vf
         std::for_each(vf.begin(), vf.end(), [](const Function<T,NDIM>& f){f.reconstruct();});
+        const std::vector<coordT> r = plot_line_points(world, npt, lo, h);
+        std::vector< std::vector<T> > vfr;
+        std::for_each(vf.begin(), vf.end(), [&](const Function<T,NDIM>& f){ vfr.push_back(f.eval_many(r));});
         if (world.rank() == 0) {
             FILE* file = fopen(filename,"w");
             if(!file)
             MADNESS_EXCEPTION("plot_line: failed to open the plot file", 0);
             for (int i=0; i<npt; ++i) {
-                coordT r = lo + h*double(i);
                 fprintf(file, "%.14e ", i*sum);
-                std::for_each(vf.begin(), vf.end(), [&](const Function<T,NDIM>& f){ plot_line_print_value(file, f.eval(r));});
+                std::for_each(vfr.begin(), vfr.end(), [&](const std::vector<T>& fr){ plot_line_print_value(file, fr[i]);});
                 fprintf(file,"\n");
             }
             fclose(file);
@@ -80,30 +80,40 @@ namespace madness {
 	    }
 
 	    /// Does the interface support a vectorized operator()?
+
+	    /// If true, projection (fcube) evaluates all quadrature points of a box
+	    /// with a single call to the batched operator() below instead of one
+	    /// virtual call per point.
 	    virtual bool supports_vectorized() const {return false;}
 
+	    /// Batched evaluation on a block of points in structure-of-arrays layout
+
+	    /// xvals[d][i] is coordinate d of point i, fvals[i] receives f at point i.
+	    /// The default loops over the scalar operator(), so a functor may
+	    /// switch on supports_vectorized() and override only the overload
+	    /// matching its dimension.
 	    virtual void operator()(const Vector<double*,1>& xvals, T* fvals, int npts) const {
-	        MADNESS_EXCEPTION("FunctionFunctorInterface: This function should not be called!", 0);
+	        eval_pointwise(xvals, fvals, npts);
 	    }
 
 	    virtual void operator()(const Vector<double*,2>& xvals, T* fvals, int npts) const {
-	        MADNESS_EXCEPTION("FunctionFunctorInterface: This function should not be called!", 0);
+	        eval_pointwise(xvals, fvals, npts);
 	    }
 
 	    virtual void operator()(const Vector<double*,3>& xvals, T* fvals, int npts) const {
-	        MADNESS_EXCEPTION("FunctionFunctorInterface: This function should not be called!", 0);
+	        eval_pointwise(xvals, fvals, npts);
 	    }
 
 	    virtual void operator()(const Vector<double*,4>& xvals, T* fvals, int npts) const {
-	        MADNESS_EXCEPTION("FunctionFunctorInterface: This function should not be called!", 0);
+	        eval_pointwise(xvals, fvals, npts);
 	    }
 
 	    virtual void operator()(const Vector<double*,5>& xvals, T* fvals, int npts) const {
-	        MADNESS_EXCEPTION("FunctionFunctorInterface: This function should not be called!", 0);
+	        eval_pointwise(xvals, fvals, npts);
 	    }
 
 	    virtual void operator()(const Vector<double*,6>& xvals, T* fvals, int npts) const {
-	        MADNESS_EXCEPTION("FunctionFunctorInterface: This function should not be called!", 0);
+	        eval_pointwise(xvals, fvals, npts);
 	    }
 
 	    /// You should implement this to return \c f(x)
@@ -134,6 +144,21 @@ namespace madness {
 	        return false;
 	    }
 
+	private:
+	    /// Fallback for the batched operator(): one scalar call per point
+	    template <std::size_t D>
+	    void eval_pointwise(const Vector<double*,D>& xvals, T* fvals, int npts) const {
+	        if constexpr (D == NDIM) {
+	            Vector<double,NDIM> x;
+	            for (int i=0; i<npts; ++i) {
+	                for (std::size_t d=0; d<NDIM; ++d) x[d] = xvals[d][i];
+	                fvals[i] = (*this)(x);
+	            }
+	        }
+	        else {
+	            MADNESS_EXCEPTION("FunctionFunctorInterface: batched call with wrong dimension", D);
+	        }
+	    }
 	};
 
 
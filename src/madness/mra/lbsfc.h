@@ -0,0 +1,395 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+#ifndef MADNESS_MRA_LBSFC_H__INCLUDED
+#define MADNESS_MRA_LBSFC_H__INCLUDED
+
+#include <madness/madness_config.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <madness/world/worlddc.h>
+#include <madness/world/worldhashmap.h>
+#include <madness/world/timers.h>
+
+#include <madness/mra/key.h>
+#include <madness/mra/indexit.h>
+#include <madness/mra/funcdefaults.h>
+
+/// \file mra/lbsfc.h
+/// \brief Incremental load/data balancing along a space-filling curve
+/// \ingroup function
+
+namespace madness {
+
+	template<typename T, std::size_t NDIM>
+	class FunctionNode;
+
+	template<typename T, std::size_t NDIM>
+	class Function;
+
+    /// Orders keys along the Morton (Z-order) curve
+
+    /// Keys on different levels are compared through the first corner of
+    /// the finer one; a box precedes all of its descendants.
+    template <std::size_t NDIM>
+    struct KeyCurveLess {
+        bool operator()(const Key<NDIM>& a, const Key<NDIM>& b) const {
+            const Level n = std::max(a.level(), b.level());
+            const Level da = n - a.level(), db = n - b.level();
+            Translation la[NDIM], lb[NDIM];
+            std::size_t dmax = NDIM;
+            Translation xmax = 0;
+            for (std::size_t d=0; d<NDIM; ++d) {
+                la[d] = a.translation()[d] << da;
+                lb[d] = b.translation()[d] << db;
+                // dimension holding the most significant differing bit; on a tie d=0 wins
+                const Translation x = la[d] ^ lb[d];
+                if (xmax < x && xmax < (x ^ xmax)) {
+                    xmax = x;
+                    dmax = d;
+                }
+            }
+            if (dmax == NDIM) return a.level() < b.level();
+            return la[dmax] < lb[dmax];
+        }
+    };
+
+
+    /// Process map assigning contiguous ranges of the space-filling curve to processes
+
+    /// Spatially adjacent boxes are mostly on the same process, so that
+    /// neighbor and parent accesses of apply, derivatives and multiplication
+    /// stay local far more often than with the hashed maps.
+    ///
+    /// The uniform map cuts the curve into ranges of equal volume at the
+    /// level n with 2^(NDIM*n) >= 64*nproc boxes and owner() computes the
+    /// Morton index of the key, O(n*NDIM) independent of nproc.  Ranges
+    /// weighted by the cost of the trees are made by LoadBalanceSFC, and
+    /// owner() is then a binary search in a flat table of nproc-1 keys.
+    template <std::size_t NDIM>
+    class CurveRangePmap : public WorldDCPmapInterface< Key<NDIM> > {
+        typedef Key<NDIM> keyT;
+        std::vector<keyT> first;    ///< first[p] is the first key owned by process p+1
+        Level n = -1;               ///< level of the uniform ranges, -1 for ranges in first
+        std::uint64_t nproc = 1;
+
+        /// Morton index of the box on level n containing the first corner of key
+        std::uint64_t index(const keyT& key) const {
+            std::uint64_t i = 0;
+            const Level m = key.level();
+            for (Level b=n-1; b>=0; --b) {
+                for (std::size_t d=0; d<NDIM; ++d) {
+                    const Translation l = (m >= n) ? (key.translation()[d] >> (m-n)) : (key.translation()[d] << (n-m));
+                    i = (i << 1) | ((l >> b) & 1);
+                }
+            }
+            return i;
+        }
+
+    public:
+        /// Uniform ranges of the curve on all processes of world
+        CurveRangePmap(World& world) : nproc(world.size()) {
+            n = 1;
+            while ((1ul<<(NDIM*n)) < 64ul*nproc && NDIM*(n+1) <= 42) ++n;
+            const std::uint64_t nbox = 1ul<<(NDIM*n);
+            for (std::uint64_t p=1; p<nproc; ++p) {
+                const std::uint64_t i = (p*nbox + nproc - 1)/nproc;
+                Vector<Translation,NDIM> l(0);
+                for (Level b=n-1; b>=0; --b) {
+                    for (std::size_t d=0; d<NDIM; ++d) {
+                        l[d] |= Translation((i >> (b*NDIM + NDIM-1-d)) & 1) << b;
+                    }
+                }
+                first.push_back(keyT(n,l));
+            }
+        }
+
+        /// @param[in] first    the first key of each process except process 0, in curve order
+        CurveRangePmap(const std::vector<keyT>& first) : first(first) {
+            MADNESS_ASSERT(std::is_sorted(first.begin(), first.end(), KeyCurveLess<NDIM>()));
+        }
+
+        ProcessID owner(const keyT& key) const {
+            if (n < 0) {
+                return std::upper_bound(first.begin(), first.end(), key, KeyCurveLess<NDIM>()) - first.begin();
+            }
+            // same result as the binary search: a coarser box precedes its first corner
+            std::uint64_t i = index(key);
+            if (key.level() < n) {
+                if (i == 0) return 0;
+                --i;
+            }
+            return ProcessID((i*nproc) >> (NDIM*n));
+        }
+
+        const std::vector<keyT>& get_ranges() const {
+            return first;
+        }
+
+        void print() const {
+            if (n < 0) madness::print("CurveRangePmap", first.size()+1, "ranges");
+            else madness::print("CurveRangePmap", first.size()+1, "uniform ranges on level", n);
+        }
+    };
+
+
+    /// Accumulates measured per-node task cost of the apply and multiply kernels
+
+    /// Disabled by default.  When enabled, the kernels add their wall time
+    /// to the key they work on, on the process where they ran.  Recording
+    /// is meant for a bounded window (e.g. the iteration before a rebalance)
+    /// that LoadBalanceSFC::add_measured_cost() closes by clearing the map.
+    template <std::size_t NDIM>
+    class TaskCostRecorder {
+        typedef Key<NDIM> keyT;
+        typedef ConcurrentHashMap<keyT,double> mapT;
+        static inline std::atomic<bool> enabled{false};
+        static inline mapT cost;
+
+    public:
+        typedef typename mapT::const_iterator const_iterator;
+
+        /// Times the enclosing scope and records it for key if recording is enabled
+        class scope {
+            const keyT& key;
+            const bool on;
+            const double t0;
+        public:
+            scope(const keyT& key) : key(key), on(is_enabled()), t0(on ? wall_time() : 0.0) {}
+            ~scope() {
+                if (on) TaskCostRecorder<NDIM>::add(key, wall_time()-t0);
+            }
+        };
+
+        static void set_enabled(bool value) {
+            enabled.store(value, std::memory_order_relaxed);
+        }
+
+        static bool is_enabled() {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        static void add(const keyT& key, double t) {
+            typename mapT::accessor acc;
+            if (cost.insert(acc, keyT(key))) acc->second = t;
+            else acc->second += t;
+        }
+
+        static const_iterator begin() {
+            return const_cast<const mapT&>(cost).begin();
+        }
+
+        static const_iterator end() {
+            return const_cast<const mapT&>(cost).end();
+        }
+
+        static void clear() {
+            cost.clear();
+        }
+    };
+
+
+    /// Incremental load balancer that cuts the space-filling curve into equal-cost ranges
+
+    /// Used like LoadBalanceDeux:
+    /// \code
+    ///     LoadBalanceSFC<3> lb(world);
+    ///     lb.add_tree(f, costfn);
+    ///     FunctionDefaults<3>::redistribute(world, lb.load_balance());
+    /// \endcode
+    /// Costs stay on the process that owns the node; only sums over coarse
+    /// boxes (buckets) of the curve are reduced globally.  Buckets heavier
+    /// than a fraction of the average cost per process are refined until
+    /// they are light enough or contain a single level.  Since the curve
+    /// order does not change, the new ranges move only the keys near the
+    /// old range boundaries.  If the current default map is already a
+    /// CurveRangePmap and its imbalance under the new costs is below
+    /// the tolerance, it is returned unchanged and nothing migrates.
+    template <std::size_t NDIM>
+    class LoadBalanceSFC {
+        typedef Key<NDIM> keyT;
+        typedef std::pair<keyT,double> costT;
+        World& world;
+        std::vector<costT> costs;       ///< local (key,cost) pairs
+        double tolerance;               ///< accepted ratio of maximum to average cost per process
+
+        static bool compare(const costT& a, const costT& b) {
+            return KeyCurveLess<NDIM>()(a.first, b.first);
+        }
+
+        /// Global cost and maximum key level of each bucket
+
+        /// A key belongs to the last bucket not after it in curve order
+        void bucket_costs(const std::vector<keyT>& buckets, std::vector<double>& cost,
+                          std::vector<long>& maxlevel) const {
+            const KeyCurveLess<NDIM> less;
+            cost.assign(buckets.size(), 0.0);
+            maxlevel.assign(buckets.size(), 0);
+            std::size_t b = 0;
+            for (const costT& c : costs) {
+                while (b+1 < buckets.size() && !less(c.first, buckets[b+1])) ++b;
+                cost[b] += c.second;
+                maxlevel[b] = std::max(maxlevel[b], long(c.first.level()));
+            }
+            world.gop.sum(cost.data(), cost.size());
+            world.gop.max(maxlevel.data(), maxlevel.size());
+        }
+
+        /// Ratio of maximum to average cost per process if buckets are assigned by pmap
+        double imbalance(const WorldDCPmapInterface<keyT>& pmap, const std::vector<keyT>& buckets,
+                         const std::vector<double>& cost, double total) const {
+            std::vector<double> per_proc(world.size(), 0.0);
+            for (std::size_t b=0; b<buckets.size(); ++b) per_proc[pmap.owner(buckets[b])] += cost[b];
+            return *std::max_element(per_proc.begin(), per_proc.end())*world.size()/total;
+        }
+
+    public:
+        LoadBalanceSFC(World& world, double tolerance=1.1)
+            : world(world), tolerance(tolerance) {}
+
+        /// Accumulates cost from the local nodes of a function
+
+        /// Purely local, fence is accepted for compatibility with LoadBalanceDeux
+        template <typename T, typename costfnT>
+        void add_tree(const Function<T,NDIM>& f, const costfnT& costfn, bool fence=false) {
+            const auto& coeffs = f.get_impl()->get_coeffs();
+            for (auto it=coeffs.begin(); it!=coeffs.end(); ++it) {
+                costs.push_back(costT(it->first, costfn(it->first, it->second)));
+            }
+            if (fence) world.gop.fence();
+        }
+
+        /// Stops TaskCostRecorder, adds the cost it measured and clears it
+
+        /// The measured times are scaled so that they make up the given
+        /// fraction of the total cost added so far.  Without measurements
+        /// (e.g. on the first call) only the model cost is used.  Collective.
+        /// @param[in] fraction share of the measured cost in the combined cost
+        void add_measured_cost(double fraction=0.5) {
+            TaskCostRecorder<NDIM>::set_enabled(false);
+            world.gop.fence();      // no kernel is still recording
+            double model = 0.0, measured = 0.0;
+            for (const costT& c : costs) model += c.second;
+            std::vector<costT> m;
+            for (auto it=TaskCostRecorder<NDIM>::begin(); it!=TaskCostRecorder<NDIM>::end(); ++it) {
+                m.push_back(costT(it->first, it->second));
+                measured += it->second;
+            }
+            world.gop.sum(model);
+            world.gop.sum(measured);
+            TaskCostRecorder<NDIM>::clear();
+            if (measured <= 0.0) return;
+            const double scale = (model > 0.0) ? fraction/(1.0-fraction)*model/measured : 1.0;
+            for (const costT& c : m) costs.push_back(costT(c.first, c.second*scale));
+        }
+
+        /// Computes the new curve ranges; collective
+
+        /// @param[in] fac  pieces per process the buckets are refined to, as in LoadBalanceDeux
+        std::shared_ptr< WorldDCPmapInterface<keyT> > load_balance(double fac = 1.0, bool printstuff=false) {
+            world.gop.fence();
+            std::sort(costs.begin(), costs.end(), compare);
+
+            // Start from the boxes of the coarsest level with at least 8 per process
+            Level n0 = 0;
+            while ((1ul<<(NDIM*n0)) < 8ul*world.size() && n0 < 10) ++n0;
+            std::vector<keyT> buckets;
+            for (HighDimIndexIterator it(NDIM, 1ul<<n0); it; ++it) {
+                Vector<Translation,NDIM> l;
+                for (std::size_t d=0; d<NDIM; ++d) l[d] = (*it)[d];
+                buckets.push_back(keyT(n0,l));
+            }
+            std::sort(buckets.begin(), buckets.end(), KeyCurveLess<NDIM>());
+
+            std::vector<double> cost;
+            std::vector<long> maxlevel;
+            bucket_costs(buckets, cost, maxlevel);
+            double total = 0.0;
+            for (double c : cost) total += c;
+            if (total <= 0.0) {
+                costs.clear();
+                return FunctionDefaults<NDIM>::get_pmap();
+            }
+
+            // Refine heavy buckets
+            const double target = total/(world.size()*fac*4.0);
+            for (int round=0; round<30; ++round) {
+                std::vector<keyT> refined;
+                bool changed = false;
+                for (std::size_t b=0; b<buckets.size(); ++b) {
+                    if (cost[b] > target && maxlevel[b] > buckets[b].level()) {
+                        for (KeyChildIterator<NDIM> kit(buckets[b]); kit; ++kit) refined.push_back(kit.key());
+                        changed = true;
+                    }
+                    else {
+                        refined.push_back(buckets[b]);
+                    }
+                }
+                if (!changed) break;
+                std::sort(refined.begin(), refined.end(), KeyCurveLess<NDIM>());
+                buckets.swap(refined);
+                bucket_costs(buckets, cost, maxlevel);
+            }
+
+            costs.clear();
+
+            // Keep the current ranges if they are still good enough
+            std::shared_ptr< WorldDCPmapInterface<keyT> > pmap = FunctionDefaults<NDIM>::get_pmap();
+            if (std::dynamic_pointer_cast< CurveRangePmap<NDIM> >(pmap)) {
+                const double old = imbalance(*pmap, buckets, cost, total);
+                if (printstuff && world.rank() == 0) print("LoadBalanceSFC: imbalance of current ranges", old);
+                if (old < tolerance) return pmap;
+            }
+
+            // Cut the curve into ranges of equal cost
+            std::vector<keyT> first;
+            double sum = 0.0;
+            const double avg = total/world.size();
+            for (std::size_t b=0; b<buckets.size() && first.size()+1<std::size_t(world.size()); ++b) {
+                while (first.size()+1<std::size_t(world.size()) && sum+0.5*cost[b] > avg*(first.size()+1)) {
+                    first.push_back(buckets[b]);
+                }
+                sum += cost[b];
+            }
+            while (first.size()+1<std::size_t(world.size())) first.push_back(buckets.back());
+
+            std::shared_ptr< WorldDCPmapInterface<keyT> > newpmap(new CurveRangePmap<NDIM>(first));
+            if (printstuff && world.rank() == 0) {
+                print("LoadBalanceSFC:", buckets.size(), "buckets, imbalance of new ranges",
+                      imbalance(*newpmap, buckets, cost, total));
+            }
+            return newpmap;
+        }
+    };
+}
+
+
+#endif // MADNESS_MRA_LBSFC_H__INCLUDED
@@ -295,6 +295,31 @@ public:
         return batch.size_of_input();
     }
 
+    /// estimated cost of a batch, used to schedule the largest tasks first
+    virtual double compute_cost(const Batch& batch) const {
+        return batch.size_of_input();
+    }
+
+    /// split a batch into at most npart batches whose results add up to the result of batch
+
+    /// The last input range is split; if it is also the result range (1D
+    /// partitioning) the result range is split along with it.  Returns
+    /// batch itself if it cannot be split.
+    virtual std::vector<Batch> split_batch(const Batch& batch, const long npart) const {
+        if (batch.input.size()==0 or batch.input.back().is_full_size()) return {batch};
+        const Batch_1D range=batch.input.back();
+        const bool split_result=(batch.input.size()==1 and batch.result==range);
+        const long n=std::max(1l,std::min(npart,range.size()));
+        std::vector<Batch> result;
+        for (long i=0; i<n; ++i) {
+            Batch part=batch;
+            part.input.back()=Batch_1D(range.begin+i*range.size()/n, range.begin+(i+1)*range.size()/n);
+            if (split_result) part.result=part.input.back();
+            result.push_back(part);
+        }
+        return result;
+    }
+
 };
 
 }
@@ -33,6 +33,11 @@
 #include <madness/world/world.h>
 #include <madness/mra/macrotaskpartitioner.h>
 
+#include <array>
+#include <fstream>
+#include <list>
+#include <set>
+
 namespace madness {
 
 /// base class
@@ -45,6 +50,7 @@ public:
 	virtual ~MacroTaskBase() {};
 
 	double priority=1.0;
+	double cost=1.0;        ///< estimated cost, the scheduler hands out the most expensive tasks first
 	enum Status {Running, Waiting, Complete, Unknown} stat=Unknown;
 
 	void set_complete() {stat=Complete;}
@@ -58,6 +64,11 @@ public:
 	virtual void run(World& world, Cloud& cloud, taskqT& taskq) = 0;
 	virtual void cleanup() = 0;		// clear static data (presumably persistent input data)
 
+	/// split this task into at most npart tasks that together do the same work
+
+	/// must give the same parts on every process; an empty list if the task cannot be split
+	virtual taskqT split(const long npart) const {return taskqT();}
+
     virtual void print_me(std::string s="") const {
         printf("this is task with priority %4.1f\n",priority);
     }
@@ -71,6 +82,7 @@ public:
     }
 
     double get_priority() const {return priority;}
+    double get_cost() const {return cost;}
 
     friend std::ostream& operator<<(std::ostream& os, const MacroTaskBase::Status s) {
     	if (s==MacroTaskBase::Status::Running) os << "Running";
@@ -109,6 +121,17 @@ class MacroTaskQ : public WorldObject< MacroTaskQ> {
 	std::mutex taskq_mutex;
 	long printlevel=0;
 	long nsubworld=1;
+	long max_chunk_size=4;          ///< maximum number of tasks handed out to a subworld at once
+	std::string timeline_name;      ///< if not empty, subworlds write their timelines to timeline_name.<rank>
+
+	/// a task or a part of a split task waiting to be scheduled
+	struct WorkItem {
+		long element=-1;            ///< index in taskq
+		long ipart=0, npart=1;      ///< part ipart of taskq[element]->split(npart), or the whole task
+		double cost=0.0;
+	};
+	std::list<WorkItem> schedule;   ///< on universe rank 0: waiting work, most expensive first
+	std::vector<long> nparts_left;  ///< on universe rank 0: parts of each task not yet complete
     std::shared_ptr< WorldDCPmapInterface< Key<1> > > pmap1;
     std::shared_ptr< WorldDCPmapInterface< Key<2> > > pmap2;
     std::shared_ptr< WorldDCPmapInterface< Key<3> > > pmap3;
@@ -126,6 +149,12 @@ public:
 	long get_nsubworld() const {return nsubworld;}
 	void set_printlevel(const long p) {printlevel=p;}
 
+	/// hand out up to n tasks at once to a subworld, fewer if they would take more than their share
+	void set_max_chunk_size(const long n) {max_chunk_size=std::max(1l,n);}
+
+	/// after run_all rank 0 of each subworld writes the tasks it ran with their start and end times to name.<universe rank>
+	void set_timeline(const std::string& name) {timeline_name=name;}
+
     /// create an empty taskq and initialize the subworlds
 	MacroTaskQ(World& universe, int nworld, const long printlevel=0)
 		  : universe(universe), WorldObject<MacroTaskQ>(universe), taskq(), cloud(universe), printlevel(printlevel),
@@ -157,6 +186,7 @@ public:
 		for (const auto& t : vtask) if (universe.rank()==0) t->set_waiting();
 		for (int i=0; i<vtask.size(); ++i) add_replicated_task(vtask[i]);
 		if (printdebug()) print_taskq();
+		if (universe.rank()==0) make_schedule();
 
 		cloud.replicate();
         universe.gop.fence();
@@ -175,21 +205,28 @@ public:
 		World& subworld=get_subworld();
 //		if (printdebug()) print("I am subworld",subworld.id());
 		double tasktime=0.0;
+		std::vector<std::array<double,6>> timeline;    // element, ipart, npart, cost, start, end
 		while (true){
-			long element=get_scheduled_task_number(subworld);
-            double cpu0=cpu_time();
-			if (element<0) break;
-			std::shared_ptr<MacroTaskBase> task=taskq[element];
-            if (printdebug()) print("starting task no",element, "in subworld",subworld.id(),"at time",wall_time());
-
-			task->run(subworld,cloud, taskq);
-
-			double cpu1=cpu_time();
-            set_complete(element);
-			tasktime+=(cpu1-cpu0);
-			if (subworld.rank()==0 and printlevel>=3) printf("completed task %3ld after %6.1fs at time %6.1fs\n",element,cpu1-cpu0,wall_time());
-
+			std::vector<long> chunk=get_scheduled_task_numbers(subworld);
+			if (chunk.empty()) break;
+			for (std::size_t i=0; i<chunk.size(); i+=3) {
+				const long element=chunk[i], ipart=chunk[i+1], npart=chunk[i+2];
+				double cpu0=cpu_time();
+				double wall0=wall_time();
+				std::shared_ptr<MacroTaskBase> task=taskq[element];
+				if (npart>1) task=task->split(npart)[ipart];
+				if (printdebug()) print("starting task no",element,"part",ipart,"of",npart,"in subworld",subworld.id(),"at time",wall0);
+
+				task->run(subworld,cloud, taskq);
+
+				double cpu1=cpu_time();
+				set_complete(element);
+				tasktime+=(cpu1-cpu0);
+				if (subworld.rank()==0) timeline.push_back({double(element),double(ipart),double(npart),task->get_cost(),wall0,wall_time()});
+				if (subworld.rank()==0 and printlevel>=3) printf("completed task %3ld after %6.1fs at time %6.1fs\n",element,cpu1-cpu0,wall_time());
+			}
 		}
+		if (subworld.rank()==0 and not timeline_name.empty()) write_timeline(timeline);
         universe.gop.set_forbid_fence(false);
 		universe.gop.fence();
 		universe.gop.sum(tasktime);
@@ -238,42 +275,101 @@ private:
 		taskq.push_back(task);
 	}
 
+	/// order the waiting tasks by decreasing cost, ties in submission order
+
+	/// a task may be in taskq more than once (added and then run with run_all), it is scheduled once
+	void make_schedule() {
+		std::lock_guard<std::mutex> lock(taskq_mutex);
+		schedule.clear();
+		nparts_left.assign(taskq.size(),0);
+		std::set<const MacroTaskBase*> scheduled;
+		for (std::size_t i=0; i<taskq.size(); ++i) {
+			if (not taskq[i]->is_waiting()) continue;
+			if (not scheduled.insert(taskq[i].get()).second) continue;
+			schedule.push_back(WorkItem{long(i),0,1,taskq[i]->get_cost()});
+			nparts_left[i]=1;
+		}
+		schedule.sort([](const WorkItem& a, const WorkItem& b) {return a.cost>b.cost;});
+	}
+
 	/// scheduler is located on universe.rank==0
-	long get_scheduled_task_number(World& subworld) {
-		long number=0;
-		if (subworld.rank()==0) number=this->send(ProcessID(0), &MacroTaskQ::get_scheduled_task_number_local);
-		subworld.gop.broadcast_serializable(number, 0);
-		subworld.gop.fence();
-		return number;
 
+	/// returns triples (element, ipart, npart), empty if there are no tasks left
+	std::vector<long> get_scheduled_task_numbers(World& subworld) {
+		std::vector<long> numbers;
+		if (subworld.rank()==0) numbers=this->send(ProcessID(0), &MacroTaskQ::get_scheduled_task_numbers_local).get();
+		subworld.gop.broadcast_serializable(numbers, 0);
+		subworld.gop.fence();
+		return numbers;
 	}
 
-	long get_scheduled_task_number_local() {
+	/// hand out the most expensive waiting tasks, about 1/(2 nsubworld) of the remaining cost
+
+	/// A task costing more than an even share of all remaining work is
+	/// split into parts that are scheduled like tasks, so that it does
+	/// not leave the other subworlds idle at the end of the queue.
+	std::vector<long> get_scheduled_task_numbers_local() {
 		MADNESS_ASSERT(universe.rank()==0);
 		std::lock_guard<std::mutex> lock(taskq_mutex);
 
-		auto is_Waiting = [](const std::shared_ptr<MacroTaskBase>& mtb_ptr) {return mtb_ptr->is_waiting();};
-		auto it=std::find_if(taskq.begin(),taskq.end(),is_Waiting);
-		if (it!=taskq.end()) {
-			it->get()->set_running();
-			long element=it-taskq.begin();
-			return element;
+		double remaining=0.0;
+		for (const auto& w : schedule) remaining+=w.cost;
+		const double share=remaining/(2.0*nsubworld);
+
+		std::vector<long> numbers;
+		double chunk_cost=0.0;
+		while (not schedule.empty() and long(numbers.size())<3*max_chunk_size) {
+			WorkItem w=schedule.front();
+			if (numbers.size()>0 and chunk_cost+w.cost>share) break;
+			schedule.pop_front();
+
+			if (w.npart==1 and nsubworld>1 and w.cost>remaining/nsubworld) {
+				const long npart=taskq[w.element]->split(nsubworld).size();
+				if (npart>1) {
+					for (long ipart=0; ipart<npart; ++ipart) {
+						WorkItem part{w.element,ipart,npart,w.cost/npart};
+						auto pos=std::find_if(schedule.begin(),schedule.end(),
+											  [&](const WorkItem& other) {return other.cost<part.cost;});
+						schedule.insert(pos,part);
+					}
+					nparts_left[w.element]=npart;
+					if (printdebug()) print("splitting task",w.element,"into",npart,"parts");
+					continue;
+				}
+			}
+			taskq[w.element]->set_running();
+			numbers.insert(numbers.end(),{w.element,w.ipart,w.npart});
+			chunk_cost+=w.cost;
 		}
-//		print("could not find task to schedule");
-		return -1;
+		return numbers;
 	}
 
 	/// scheduler is located on rank==0
-	void set_complete(const long task_number) const {
+	void set_complete(const long task_number) {
 		this->task(ProcessID(0), &MacroTaskQ::set_complete_local, task_number);
 	}
 
-	/// scheduler is located on rank==0
-	void set_complete_local(const long task_number) const {
+	/// scheduler is located on rank==0, a split task is complete with its last part
+	void set_complete_local(const long task_number) {
 		MADNESS_ASSERT(universe.rank()==0);
-		taskq[task_number]->set_complete();
+		std::lock_guard<std::mutex> lock(taskq_mutex);
+		if (--nparts_left[task_number]==0) taskq[task_number]->set_complete();
+	}
+
+	/// write the timeline of this subworld, one line per task
+	void write_timeline(const std::vector<std::array<double,6>>& timeline) const {
+		std::string filename=timeline_name+"."+std::to_string(universe.rank());
+		std::ofstream os(filename.c_str(), std::ios::app);
+		os << "# subworld " << get_subworld_id() << ": task part nparts cost start end\n";
+		for (const auto& t : timeline) {
+			os << std::setw(6) << long(t[0]) << std::setw(4) << long(t[1]) << std::setw(4) << long(t[2])
+			   << std::setw(12) << t[3] << std::fixed << std::setprecision(3)
+			   << std::setw(12) << t[4] << std::setw(12) << t[5] << std::defaultfloat << "\n";
+		}
 	}
 
+	unsigned long get_subworld_id() const {return subworld_ptr->id();}
+
 public:
 	void static set_pmap(World& world) {
         FunctionDefaults<1>::set_default_pmap(world);
@@ -348,6 +444,7 @@ public:
         for (const auto& batch_prio : partition) {
             vtask.push_back(
                     std::shared_ptr<MacroTaskBase>(new MacroTaskInternal(task, batch_prio, inputrecords, outputrecords)));
+            vtask.back()->cost=partitioner->compute_cost(batch_prio.first);
         }
         taskq_ptr->add_tasks(vtask);
 
@@ -398,6 +495,22 @@ private:
             print("this is task",typeid(task).name(),"with batch", task.batch,"priority",this->get_priority());
         }
 
+        /// split the batch with the partitioner of the task
+        MacroTaskBase::taskqT split(const long npart) const override {
+            auto partitioner=task.partitioner;
+            if (not partitioner) partitioner.reset(new MacroTaskPartitioner);
+            std::vector<Batch> batches=partitioner->split_batch(task.batch,npart);
+            MacroTaskBase::taskqT parts;
+            if (batches.size()<2) return parts;
+            for (const Batch& b : batches) {
+                auto part=std::make_shared<MacroTaskInternal>(*this);
+                part->task.batch=b;
+                part->cost=this->cost*double(b.size_of_input())/double(task.batch.size_of_input());
+                parts.push_back(part);
+            }
+            return parts;
+        }
+
         virtual void print_me_as_table(std::string s="") const {
             std::stringstream ss;
             std::string name=typeid(task).name();
@@ -0,0 +1,126 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file mra/mappedfunction.cc
+/// \brief Functions saved in a memory-mappable layout, loaded without copying the coefficients
+
+#include <madness/mra/mappedfunction.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace madness {
+
+    namespace {
+        const char mapped_magic[8] = {'M','A','D','M','M','A','P','1'};
+        const std::uint64_t mapped_version = 1;
+
+        std::uint64_t align(std::uint64_t offset) {
+            const std::uint64_t a = MappedFunctionFile::alignment;
+            return (offset + a - 1)/a*a;
+        }
+    }
+
+    MappedFunctionFile::MappedFunctionFile(const std::string& filename) : base(nullptr), nbyte(0) {
+        const int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) MADNESS_EXCEPTION(("mapped function: cannot open " + filename).c_str(), errno);
+        struct stat st;
+        if (fstat(fd, &st) == 0 && std::size_t(st.st_size) >= sizeof(Header)) {
+            nbyte = st.st_size;
+            void* p = mmap(nullptr, nbyte, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) base = static_cast<unsigned char*>(p);
+        }
+        close(fd);
+        if (!base) MADNESS_EXCEPTION(("mapped function: cannot map " + filename).c_str(), 0);
+
+        const Header& h = header();
+        if (memcmp(h.magic, mapped_magic, sizeof(mapped_magic)) != 0 || h.version != mapped_version ||
+            sizeof(Header) + h.nfunction*sizeof(FunctionRecord) > nbyte) {
+            munmap(base, nbyte);
+            MADNESS_EXCEPTION(("mapped function: not a valid file " + filename).c_str(), 0);
+        }
+    }
+
+    MappedFunctionFile::~MappedFunctionFile() {
+        munmap(base, nbyte);
+    }
+
+    void MappedFunctionFile::write(const std::string& filename, Header header, std::vector<FunctionRecord> functions,
+                                   std::vector<NodeRecord> nodes,
+                                   const std::vector<std::pair<const void*,std::size_t>>& blocks) {
+        MADNESS_ASSERT(nodes.size() == blocks.size());
+        memcpy(header.magic, mapped_magic, sizeof(mapped_magic));
+        header.version = mapped_version;
+        header.nfunction = functions.size();
+
+        // layout: header, function records, node records, aligned coefficient blocks
+        std::uint64_t offset = sizeof(Header) + functions.size()*sizeof(FunctionRecord);
+        for (FunctionRecord& f : functions) {
+            f.offset = offset;
+            offset += f.nnode*sizeof(NodeRecord);
+        }
+        MADNESS_ASSERT(offset == sizeof(Header) + functions.size()*sizeof(FunctionRecord) + nodes.size()*sizeof(NodeRecord));
+        for (std::size_t i=0; i<nodes.size(); ++i) {
+            offset = align(offset);
+            nodes[i].offset = offset;
+            offset += blocks[i].second;
+        }
+
+        const std::string tmpname = filename + ".tmp";
+        FILE* f = fopen(tmpname.c_str(), "wb");
+        bool ok = f != nullptr;
+        ok = ok && fwrite(&header, sizeof(header), 1, f) == 1;
+        ok = ok && fwrite(functions.data(), sizeof(FunctionRecord), functions.size(), f) == functions.size();
+        ok = ok && fwrite(nodes.data(), sizeof(NodeRecord), nodes.size(), f) == nodes.size();
+        const char zero[alignment] = {0};
+        std::uint64_t pos = sizeof(Header) + functions.size()*sizeof(FunctionRecord) + nodes.size()*sizeof(NodeRecord);
+        for (std::size_t i=0; ok && i<nodes.size(); ++i) {
+            if (!blocks[i].second) continue;
+            const std::size_t npad = nodes[i].offset - pos;
+            ok = fwrite(zero, 1, npad, f) == npad;
+            ok = ok && fwrite(blocks[i].first, 1, blocks[i].second, f) == blocks[i].second;
+            pos = nodes[i].offset + blocks[i].second;
+        }
+        if (f) ok = (fclose(f) == 0) && ok;
+        ok = ok && rename(tmpname.c_str(), filename.c_str()) == 0;
+        if (!ok) {
+            remove(tmpname.c_str());
+            MADNESS_EXCEPTION(("mapped function: cannot write " + filename).c_str(), 0);
+        }
+    }
+
+}
@@ -0,0 +1,264 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_MRA_MAPPEDFUNCTION_H__INCLUDED
+#define MADNESS_MRA_MAPPEDFUNCTION_H__INCLUDED
+
+/// \file mra/mappedfunction.h
+/// \brief Functions saved in a memory-mappable layout, loaded without copying the coefficients
+/// \ingroup function
+
+#include <madness/mra/mra.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace madness {
+
+    /// A file of functions saved by save_mapped(), mapped into memory
+
+    /// Each process writes the file \c name.mmap.<rank> holding a header,
+    /// one MappedFunctionRecord per function, the node records of all
+    /// functions and the coefficient blocks, each aligned to 64 bytes.
+    /// The file is mapped privately, so the pages are read on demand and
+    /// a write to the coefficients copies the page instead of changing the
+    /// file.  The mapping lives as long as any tensor referencing it.
+    class MappedFunctionFile {
+    public:
+        /// Header at the start of the file
+        struct Header {
+            char magic[8];
+            std::uint64_t version;
+            std::uint64_t nfile;        ///< number of files of the save
+            std::uint64_t file;         ///< index of this file
+            std::uint64_t nfunction;
+            std::uint64_t ndim;
+        };
+
+        /// Parameters and location of the nodes of one function
+        struct FunctionRecord {
+            std::int64_t id;            ///< TensorTypeData<T>::id
+            std::int64_t k;
+            double thresh;
+            std::int64_t autorefine;
+            std::int64_t tree_state;
+            std::uint64_t nnode;
+            std::uint64_t offset;       ///< of the first NodeRecord
+        };
+
+        /// One node, the coefficients follow at offset
+        struct NodeRecord {
+            std::int64_t n;
+            std::int64_t l[6];
+            std::int64_t has_children;
+            std::int64_t ndim;          ///< of the coefficients, 0 if none
+            std::int64_t dim[6];
+            std::uint64_t offset;       ///< of the coefficients
+        };
+
+        /// Alignment of the coefficient blocks in the file
+        static const std::size_t alignment = 64;
+
+        /// Maps the file \c filename; throws if it is not a valid file
+        MappedFunctionFile(const std::string& filename);
+
+        ~MappedFunctionFile();
+
+        MappedFunctionFile(const MappedFunctionFile&) = delete;
+        MappedFunctionFile& operator=(const MappedFunctionFile&) = delete;
+
+        const Header& header() const {
+            return *reinterpret_cast<const Header*>(base);
+        }
+
+        const FunctionRecord& function(std::size_t i) const {
+            return reinterpret_cast<const FunctionRecord*>(base + sizeof(Header))[i];
+        }
+
+        const NodeRecord* nodes(std::size_t i) const {
+            return reinterpret_cast<const NodeRecord*>(base + function(i).offset);
+        }
+
+        /// The coefficients at offset, writable (copy on write)
+        void* data(std::uint64_t offset) const {
+            return base + offset;
+        }
+
+        std::size_t size() const {
+            return nbyte;
+        }
+
+        /// Write a file; \c blocks[i] has the bytes of the coefficients of \c nodes[i]
+
+        /// The offsets of the function and node records are filled in.
+        /// Throws if the file cannot be written.
+        static void write(const std::string& filename, Header header, std::vector<FunctionRecord> functions,
+                          std::vector<NodeRecord> nodes, const std::vector<std::pair<const void*,std::size_t>>& blocks);
+
+        /// The name of the file of process \c rank of the save \c name
+        static std::string filename(const std::string& name, ProcessID rank) {
+            return name + ".mmap." + std::to_string(rank);
+        }
+
+    private:
+        unsigned char* base;
+        std::size_t nbyte;
+    };
+
+
+    /// Save functions in the memory-mappable layout of MappedFunctionFile ... collective
+
+    /// Only full-rank coefficients can be saved.
+    template <typename T, std::size_t NDIM>
+    void save_mapped(const std::vector< Function<T,NDIM> >& f, const std::string& name) {
+        static_assert(NDIM <= 6, "save_mapped: at most 6 dimensions");
+        MADNESS_ASSERT(f.size() > 0);
+        World& world = f.front().world();
+        world.gop.fence();
+
+        MappedFunctionFile::Header header;
+        header.nfile = world.size();
+        header.file = world.rank();
+        header.nfunction = f.size();
+        header.ndim = NDIM;
+
+        std::vector<MappedFunctionFile::FunctionRecord> functions(f.size());
+        std::vector<MappedFunctionFile::NodeRecord> nodes;
+        std::vector<std::pair<const void*,std::size_t>> blocks;
+        for (std::size_t i=0; i<f.size(); ++i) {
+            const FunctionImpl<T,NDIM>& impl = *f[i].get_impl();
+            MappedFunctionFile::FunctionRecord& fr = functions[i];
+            fr.id = TensorTypeData<T>::id;
+            fr.k = impl.get_k();
+            fr.thresh = impl.get_thresh();
+            fr.autorefine = impl.get_autorefine();
+            fr.tree_state = impl.get_tree_state();
+            fr.nnode = 0;
+            const typename FunctionImpl<T,NDIM>::dcT& coeffs = impl.get_coeffs();
+            for (auto it=coeffs.begin(); it!=coeffs.end(); ++it) {
+                const Key<NDIM>& key = it->first;
+                const FunctionNode<T,NDIM>& node = it->second;
+                MappedFunctionFile::NodeRecord r = {};
+                r.n = key.level();
+                for (std::size_t d=0; d<NDIM; ++d) r.l[d] = key.translation()[d];
+                r.has_children = node.has_children();
+                if (node.has_coeff()) {
+                    MADNESS_CHECK(node.coeff().is_full_tensor());
+                    const Tensor<T>& t = node.coeff().full_tensor();
+                    MADNESS_CHECK(t.iscontiguous());
+                    r.ndim = t.ndim();
+                    for (long d=0; d<t.ndim(); ++d) r.dim[d] = t.dim(d);
+                    blocks.push_back(std::make_pair((const void*) t.ptr(), t.size()*sizeof(T)));
+                }
+                else {
+                    blocks.push_back(std::make_pair((const void*) nullptr, std::size_t(0)));
+                }
+                nodes.push_back(r);
+                ++fr.nnode;
+            }
+        }
+        MappedFunctionFile::write(MappedFunctionFile::filename(name, world.rank()), header,
+                                  functions, nodes, blocks);
+        world.gop.fence();
+    }
+
+
+    /// Load functions saved by save_mapped() ... collective
+
+    /// Each process maps a share of the files.  The coefficients of nodes
+    /// this process owns under the default process map reference the
+    /// mapping and are not copied; the others are sent to their owners.
+    /// With the same number of processes and process map as at the save,
+    /// nothing is copied or sent.
+    /// @param[out] nmapped     if not null, the number of local nodes referencing a mapping
+    template <typename T, std::size_t NDIM>
+    std::vector< Function<T,NDIM> > load_mapped(World& world, const std::string& name, std::size_t* nmapped=nullptr) {
+        world.gop.fence();
+        std::vector< std::shared_ptr<MappedFunctionFile> > files;
+        ProcessID nfile = 0;
+        std::vector<MappedFunctionFile::FunctionRecord> params;
+        if (world.rank() == 0) {
+            files.push_back(std::make_shared<MappedFunctionFile>(MappedFunctionFile::filename(name, 0)));
+            nfile = files[0]->header().nfile;
+            for (std::size_t i=0; i<files[0]->header().nfunction; ++i) params.push_back(files[0]->function(i));
+        }
+        world.gop.broadcast(nfile, 0);
+        world.gop.broadcast_serializable(params, 0);
+
+        std::vector< Function<T,NDIM> > f(params.size());
+        for (std::size_t i=0; i<params.size(); ++i) {
+            MADNESS_CHECK(params[i].id == TensorTypeData<T>::id);
+            f[i] = FunctionFactory<T,NDIM>(world).k(params[i].k).thresh(params[i].thresh).empty();
+            f[i].get_impl()->set_autorefine(params[i].autorefine);
+            f[i].get_impl()->set_tree_state(TreeState(params[i].tree_state));
+        }
+
+        std::size_t n = 0;
+        for (ProcessID file=world.rank(); file<nfile; file+=world.size()) {
+            if (file != 0) files.push_back(std::make_shared<MappedFunctionFile>(MappedFunctionFile::filename(name, file)));
+            const std::shared_ptr<MappedFunctionFile>& mf = files.back();
+            MADNESS_CHECK(mf->header().nfunction == f.size() && mf->header().ndim == NDIM);
+            for (std::size_t i=0; i<f.size(); ++i) {
+                typename FunctionImpl<T,NDIM>::dcT& coeffs = f[i].get_impl()->get_coeffs();
+                const MappedFunctionFile::NodeRecord* r = mf->nodes(i);
+                for (std::uint64_t j=0; j<mf->function(i).nnode; ++j, ++r) {
+                    Vector<Translation,NDIM> l;
+                    for (std::size_t d=0; d<NDIM; ++d) l[d] = r->l[d];
+                    const Key<NDIM> key(r->n, l);
+                    Tensor<T> t;
+                    if (r->ndim > 0) {
+                        std::vector<long> dim(r->dim, r->dim + r->ndim);
+                        t = Tensor<T>(dim, static_cast<T*>(mf->data(r->offset)), mf);
+                    }
+                    if (coeffs.is_local(key)) {
+                        typename FunctionImpl<T,NDIM>::dcT::accessor acc;
+                        coeffs.insert(acc, key);
+                        acc->second.set_coeff(typename FunctionImpl<T,NDIM>::coeffT(t));
+                        acc->second.set_has_children(r->has_children);
+                        if (r->ndim > 0) ++n;
+                    }
+                    else {
+                        // serialization copies the coefficients
+                        coeffs.replace(key, FunctionNode<T,NDIM>(typename FunctionImpl<T,NDIM>::coeffT(t), r->has_children));
+                    }
+                }
+            }
+        }
+        world.gop.fence();
+        if (nmapped) *nmapped = n;
+        return f;
+    }
+
+}
+
+#endif // MADNESS_MRA_MAPPEDFUNCTION_H__INCLUDED
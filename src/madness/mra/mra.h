@@ -71,6 +71,7 @@ namespace madness {
 #include <madness/mra/funcdefaults.h>
 #include <madness/mra/function_factory.h>
 #include <madness/mra/lbdeux.h>
+#include <madness/mra/lbsfc.h>
 #include <madness/mra/funcimpl.h>
 
 // some forward declarations
@@ -213,6 +214,44 @@ namespace madness {
             return result;
         }
 
+        /// Evaluates the function at many points in user coordinates.  Collective operation.
+
+        /// Each process passes its own (possibly empty) list of points and
+        /// receives their values in the same order.  Much cheaper than one
+        /// eval() per point: the points travel to the owners of their boxes
+        /// in aggregated messages and every leaf is evaluated once for all
+        /// of its points.
+        ///
+        /// Throws if function is not initialized.
+        std::vector<T> eval_many(const std::vector<coordT>& xuser) const {
+            PROFILE_MEMBER_FUNC(Function);
+            const double eps=1e-15;
+            verify();
+            MADNESS_ASSERT(is_reconstructed());
+            std::vector<coordT> xsim(xuser.size());
+            for (std::size_t i=0; i<xuser.size(); ++i) {
+                user_to_sim(xuser[i],xsim[i]);
+                // If on the boundary, move the point just inside the
+                // volume so that the evaluation logic does not fail
+                for (std::size_t d=0; d<NDIM; ++d) {
+                    if (xsim[i][d] < -eps) {
+                        MADNESS_EXCEPTION("eval_many: coordinate lower-bound error in dimension", d);
+                    }
+                    else if (xsim[i][d] < eps) {
+                        xsim[i][d] = eps;
+                    }
+
+                    if (xsim[i][d] > 1.0+eps) {
+                        MADNESS_EXCEPTION("eval_many: coordinate upper-bound error in dimension", d);
+                    }
+                    else if (xsim[i][d] > 1.0-eps) {
+                        xsim[i][d] = 1.0-eps;
+                    }
+                }
+            }
+            return impl->eval_many(xsim);
+        }
+
         /// Evaluate function only if point is local returning (true,value); otherwise return (false,0.0)
 
         /// maxlevel is the maximum depth to search down to --- the max local depth can be
@@ -606,6 +645,24 @@ namespace madness {
             return *this;
         }
 
+        /// Truncate in compressed form and leave the function in finalstate.  Optional fence.
+
+        /// Same result as compress(), truncate() and, for finalstate==reconstructed,
+        /// reconstruct(), but done in one bottom-up and one top-down sweep
+        /// over the tree without fences in between.
+        /// @param[in]  tol         truncation tolerance; if <=0 the default is used
+        /// @param[in]  finalstate  reconstructed or compressed
+        /// @param[in]  fence       fence after the operation
+        Function<T,NDIM>& truncate(double tol, const TreeState finalstate, bool fence = true) {
+            PROFILE_MEMBER_FUNC(Function);
+            if (!impl) return *this;
+            verify();
+            if (not (is_reconstructed() or is_compressed())) change_tree_state(reconstructed);
+            impl->truncate_to_state(tol,finalstate,fence);
+            if (fence && VERIFY_TREE) verify_tree();
+            return *this;
+        }
+
 
         /// Returns a shared-pointer to the implementation
         const std::shared_ptr< FunctionImpl<T,NDIM> >& get_impl() const {
@@ -1652,6 +1709,32 @@ namespace madness {
 
         }
 
+        /// apply op on the input vector yielding an output vector of functions, many boxes at a time
+
+        /// (*this) is just a dummy Function to be able to call internal methods in FuncImpl
+        /// @param[in]  op   the operator working on the values of vin in nbatch boxes
+        /// @param[in]  vin  vector of input Functions
+        /// @param[out] vout vector of output Functions vout = op(vin)
+        /// @param[in]  nbatch the number of boxes per call of op
+        template <typename opT>
+        void multi_to_multi_op_values_batch(const opT& op,
+                const std::vector< Function<T,NDIM> >& vin,
+                std::vector< Function<T,NDIM> >& vout,
+                const std::size_t nbatch, const bool fence=true) {
+            std::vector<implT*> vimplin(vin.size(),NULL);
+            for (unsigned int i=0; i<vin.size(); ++i) {
+                if (vin[i].is_initialized()) vimplin[i] = vin[i].get_impl().get();
+            }
+            std::vector<implT*> vimplout(vout.size(),NULL);
+            for (unsigned int i=0; i<vout.size(); ++i) {
+                if (vout[i].is_initialized()) vimplout[i] = vout[i].get_impl().get();
+            }
+
+            impl->multi_to_multi_op_values_batch(op, vimplin, vimplout, nbatch, fence);
+            if (VERIFY_TREE) verify_tree();
+
+        }
+
 
         /// Multiplication of function * vector of functions using recursive algorithm of mulxx
         template <typename L, typename R>
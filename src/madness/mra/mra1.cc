@@ -40,11 +40,11 @@
 namespace madness {
 
     template <>
-    ConcurrentHashMap< hashT, std::shared_ptr< GaussianConvolution1D<double> > >
+    ConcurrentHashMap< hashT, GaussianConvolution1DCache<double>::entryT >
     GaussianConvolution1DCache<double>::map = {};
 
     template <>
-    ConcurrentHashMap< hashT, std::shared_ptr< GaussianConvolution1D<double_complex> > >
+    ConcurrentHashMap< hashT, GaussianConvolution1DCache<double_complex>::entryT >
     GaussianConvolution1DCache<double_complex>::map = {};
 
 #ifdef FUNCTION_INSTANTIATE_1
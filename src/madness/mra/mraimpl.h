@@ -1041,25 +1041,118 @@ namespace madness {
     // Called by result function to differentiate f
     template <typename T, std::size_t NDIM>
     void FunctionImpl<T,NDIM>::diff(const DerivativeBase<T,NDIM>* D, const implT* f, bool fence) {
+        f->diff_many(std::vector<const DerivativeBase<T,NDIM>*>(1,D), std::vector<implT*>(1,this), fence);
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::diff_many(const std::vector<const DerivativeBase<T,NDIM>*>& D,
+                                         const std::vector<implT*>& df, bool fence) const {
         typedef std::pair<keyT,coeffT> argT;
-        typename dcT::const_iterator end = f->coeffs.end();
-        for (typename dcT::const_iterator it=f->coeffs.begin(); it!=end; ++it) {
+        typedef RemoteReference< FutureImpl<argT> > refT;
+        MADNESS_ASSERT(D.size()==df.size());
+        const std::size_t nd=D.size();
+        const std::size_t chunk=64;        // leaves per task
+
+        // one future per distinct neighbor; local leaves are looked up directly,
+        // everything else is requested from its owner below
+        std::map<keyT,Future<argT> > halo;
+        std::map<ProcessID, std::pair< std::vector<keyT>,std::vector<refT> > > requests;
+        const argT zero(keyT::invalid(),coeffT(cdata.vk,targs)); // Zero bc
+
+        std::vector<keyT> keys;
+        std::vector<Future<argT> > left, right;
+        std::vector<argT> center;
+
+        typename dcT::const_iterator end = coeffs.end();
+        for (typename dcT::const_iterator it=coeffs.begin(); it!=end; ++it) {
             const keyT& key = it->first;
             const nodeT& node = it->second;
-            if (node.has_coeff()) {
-                Future<argT> left  = D->find_neighbor(f, key,-1);
-                argT center(key,node.coeff());
-                Future<argT> right = D->find_neighbor(f, key, 1);
-                world.taskq.add(*this, &implT::do_diff1, D, f, key, left, center, right, TaskAttributes::hipri());
-            }
-            else {
-                coeffs.replace(key,nodeT(coeffT(),true)); // Empty internal node
+            if (not node.has_coeff()) {
+                for (std::size_t j=0; j<nd; ++j)
+                    df[j]->coeffs.replace(key,nodeT(coeffT(),true)); // Empty internal node
+                continue;
+            }
+            keys.push_back(key);
+            center.push_back(argT(key,node.coeff()));
+            for (std::size_t j=0; j<nd; ++j) {
+                for (int step=-1; step<=1; step+=2) {
+                    const keyT neigh=D[j]->neighbor(key,step);
+                    Future<argT> r;
+                    if (neigh.is_invalid()) {
+                        r=Future<argT>(argT(neigh,zero.second));
+                    }
+                    else {
+                        typename std::map<keyT,Future<argT> >::const_iterator h=halo.find(neigh);
+                        if (h!=halo.end()) {
+                            r=h->second;
+                        }
+                        else {
+                            typename dcT::const_iterator n=(coeffs.is_local(neigh)) ? coeffs.find(neigh).get() : end;
+                            if (n!=end) {
+                                r=Future<argT>(argT(neigh,n->second.has_coeff() ? n->second.coeff() : coeffT()));
+                            }
+                            else {
+                                std::pair< std::vector<keyT>,std::vector<refT> >& req=requests[coeffs.owner(neigh)];
+                                req.first.push_back(neigh);
+                                req.second.push_back(r.remote_ref(world));
+                            }
+                            halo.insert(std::make_pair(neigh,r));
+                        }
+                    }
+                    if (step<0) left.push_back(r);
+                    else right.push_back(r);
+                }
             }
         }
+
+        for (typename std::map<ProcessID, std::pair< std::vector<keyT>,std::vector<refT> > >::const_iterator
+                 it=requests.begin(); it!=requests.end(); ++it) {
+            if (it->first==world.rank()) sock_it_to_me_many(it->second.first,it->second.second);
+            else woT::task(it->first, &implT::sock_it_to_me_many, it->second.first, it->second.second,
+                           TaskAttributes::hipri());
+        }
+
+        for (std::size_t i0=0; i0<keys.size(); i0+=chunk) {
+            const std::size_t i1=std::min(keys.size(),i0+chunk);
+            world.taskq.add(*this, &implT::do_diff_many, D, df,
+                            std::vector<keyT>(keys.begin()+i0,keys.begin()+i1),
+                            std::vector<Future<argT> >(left.begin()+i0*nd,left.begin()+i1*nd),
+                            std::vector<argT>(center.begin()+i0,center.begin()+i1),
+                            std::vector<Future<argT> >(right.begin()+i0*nd,right.begin()+i1*nd),
+                            TaskAttributes::hipri());
+        }
         if (fence) world.gop.fence();
     }
 
 
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::do_diff_many(const std::vector<const DerivativeBase<T,NDIM>*>& D,
+                                            const std::vector<implT*>& df,
+                                            const std::vector<keyT>& keys,
+                                            const std::vector< Future< std::pair<keyT,coeffT> > >& left,
+                                            const std::vector< std::pair<keyT,coeffT> >& center,
+                                            const std::vector< Future< std::pair<keyT,coeffT> > >& right) const {
+        const std::size_t nd=D.size();
+        for (std::size_t i=0; i<keys.size(); ++i) {
+            for (std::size_t j=0; j<nd; ++j) {
+                const std::pair<keyT,coeffT>& l=left[i*nd+j].get();
+                const std::pair<keyT,coeffT>& r=right[i*nd+j].get();
+                if ((!l.second.has_data()) || (!r.second.has_data())) {
+                    // One of the neighbors is below us in the tree ... recur down
+                    D[j]->do_diff1(this, df[j], keys[i], l, center[i], r);
+                }
+                else if (l.first.is_invalid() || r.first.is_invalid()) {
+                    D[j]->do_diff2b(this, df[j], keys[i], l, center[i], r);
+                }
+                else {
+                    D[j]->do_diff2i(this, df[j], keys[i], l, center[i], r);
+                }
+            }
+        }
+    }
+
+
     /// return the a std::pair<key, node>, which MUST exist
     template <typename T, std::size_t NDIM>
     std::pair<Key<NDIM>,ShallowNode<T,NDIM> > FunctionImpl<T,NDIM>::find_datum(keyT key) const {
@@ -2095,6 +2188,43 @@ namespace madness {
         return sum*pow(2.0,0.5*NDIM*n)/sqrt(FunctionDefaults<NDIM>::get_cell_volume());
     }
 
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::eval_cube_many(Level n, const std::vector<coordT>& x, const tensorT& c, T* values) const {
+        PROFILE_MEMBER_FUNC(FunctionImpl);
+        const long k = cdata.k;
+        const long npt = x.size();
+        if (npt == 0) return;
+
+        std::vector< Tensor<double> > px(NDIM);
+        for (std::size_t d=0; d<NDIM; ++d) {
+            px[d] = Tensor<double>(npt,k);
+            for (long i=0; i<npt; ++i) legendre_scaling_functions(x[i][d],k,&px[d](i,0L));
+        }
+
+        // (npt,k) x (k,k^(NDIM-1)) for the first dimension
+        const Tensor<T> t = inner(px[0],c);
+        long m = 1;
+        for (std::size_t d=1; d<NDIM; ++d) m *= k;
+
+        const double fac = pow(2.0,0.5*NDIM*n)/sqrt(FunctionDefaults<NDIM>::get_cell_volume());
+        std::vector<T> work(m);
+        for (long i=0; i<npt; ++i) {
+            std::copy(t.ptr()+i*m, t.ptr()+(i+1)*m, work.begin());
+            // contract the remaining dimensions in place, last one first
+            long len = m;
+            for (long d=NDIM-1; d>0; --d) {
+                const double* p = &px[d](i,0L);
+                len /= k;
+                for (long j=0; j<len; ++j) {
+                    T sum = T(0.0);
+                    for (long q=0; q<k; ++q) sum += work[j*k+q]*p[q];
+                    work[j] = sum;
+                }
+            }
+            values[i] = work[0]*fac;
+        }
+    }
+
     template <typename T, std::size_t NDIM>
     void FunctionImpl<T,NDIM>::reconstruct_op(const keyT& key, const coeffT& s, const bool accumulate_NS) {
         //PROFILE_MEMBER_FUNC(FunctionImpl);
@@ -2684,6 +2814,84 @@ namespace madness {
     }
 
 
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::truncate_to_state(double tol, const TreeState finalstate, bool fence) {
+        MADNESS_CHECK_THROW(finalstate==reconstructed or finalstate==compressed,
+                            "truncate_to_state: finalstate must be reconstructed or compressed");
+        MADNESS_CHECK_THROW(is_reconstructed() or is_compressed(),
+                            "truncate_to_state wants a reconstructed or compressed tree");
+        if (tol <= 0.0)
+            tol = thresh;
+        const bool was_compressed=is_compressed();
+        // Must set here so that successive calls without fence do the right thing
+        set_tree_state(finalstate);
+
+        if (world.rank() == coeffs.owner(cdata.key0)) {
+            if (was_compressed) {
+                Future<bool> root=truncate_spawn(cdata.key0,tol);
+                if (finalstate==reconstructed)
+                    woT::task(world.rank(), &implT::reconstruct_after_truncate, root, TaskAttributes::hipri());
+            } else {
+                Future< std::pair<coeffT,bool> > root=compress_truncate_spawn(cdata.key0,tol);
+                if (finalstate==reconstructed)
+                    woT::task(world.rank(), &implT::reconstruct_after_compress_truncate, root, TaskAttributes::hipri());
+            }
+        }
+        if (fence)
+            world.gop.fence();
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    Future< std::pair<typename FunctionImpl<T,NDIM>::coeffT,bool> >
+    FunctionImpl<T,NDIM>::compress_truncate_spawn(const keyT& key, double tol) {
+        MADNESS_ASSERT(coeffs.probe(key));
+        nodeT& node = coeffs.find(key).get()->second;
+        if (node.has_children()) {
+            std::vector< Future< std::pair<coeffT,bool> > > v
+                = future_vector_factory< std::pair<coeffT,bool> >(1<<NDIM);
+            int i=0;
+            for (KeyChildIterator<NDIM> kit(key); kit; ++kit,++i) {
+                v[i] = woT::task(coeffs.owner(kit.key()), &implT::compress_truncate_spawn, kit.key(),
+                                 tol, TaskAttributes::hipri());
+            }
+            return woT::task(world.rank(),&implT::compress_truncate_op, key, tol, v);
+        }
+        else {
+            // leaves are local and ready at once; they keep coefficients only if they are the root
+            const coeffT s=compress_spawn(key,false,false,false).get();
+            return Future< std::pair<coeffT,bool> >(std::make_pair(s,node.has_coeff()));
+        }
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    std::pair<typename FunctionImpl<T,NDIM>::coeffT,bool>
+    FunctionImpl<T,NDIM>::compress_truncate_op(const keyT& key, double tol,
+                                               const std::vector< Future< std::pair<coeffT,bool> > >& v) {
+        std::vector< Future<coeffT> > s(v.size());
+        std::vector< Future<bool> > has_coeff(v.size());
+        for (std::size_t i=0; i<v.size(); ++i) {
+            s[i]=Future<coeffT>(v[i].get().first);
+            has_coeff[i]=Future<bool>(v[i].get().second);
+        }
+        const coeffT ss=compress_op(key,s,false);
+        return std::make_pair(ss,truncate_op(key,tol,has_coeff));
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::reconstruct_after_truncate(const bool& has_coeff) {
+        reconstruct_op(cdata.key0,coeffT(),true);
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::reconstruct_after_compress_truncate(const std::pair<coeffT,bool>& root) {
+        reconstruct_op(cdata.key0,coeffT(),true);
+    }
+
+
     template <typename T, std::size_t NDIM>
     void FunctionImpl<T,NDIM>::print_tree(std::ostream& os, Level maxlevel) const {
         if (world.rank() == 0) do_print_tree(cdata.key0, os, maxlevel);
@@ -2860,6 +3068,51 @@ namespace madness {
         }
     }
 
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::sock_it_to_me_many(const std::vector<keyT>& keys,
+                                                  const std::vector< RemoteReference< FutureImpl< std::pair<keyT,coeffT> > > >& refs) const {
+        typedef std::pair<keyT,coeffT> argT;
+        typedef RemoteReference< FutureImpl<argT> > refT;
+        std::map<ProcessID, std::pair< std::vector<keyT>,std::vector<refT> > > parents;
+        std::map<ProcessID, std::pair< std::vector<argT>,std::vector<refT> > > replies;
+        for (std::size_t i=0; i<keys.size(); ++i) {
+            const keyT& key=keys[i];
+            if (coeffs.probe(key)) {
+                const nodeT& node = coeffs.find(key).get()->second;
+                std::pair< std::vector<argT>,std::vector<refT> >& reply=replies[refs[i].owner()];
+                reply.first.push_back(argT(key,node.has_coeff() ? node.coeff() : coeffT()));
+                reply.second.push_back(refs[i]);
+            }
+            else {
+                const keyT parent = key.parent();
+                std::pair< std::vector<keyT>,std::vector<refT> >& req=parents[coeffs.owner(parent)];
+                req.first.push_back(parent);
+                req.second.push_back(refs[i]);
+            }
+        }
+        for (typename std::map<ProcessID, std::pair< std::vector<keyT>,std::vector<refT> > >::const_iterator
+                 it=parents.begin(); it!=parents.end(); ++it) {
+            if (it->first==world.rank()) sock_it_to_me_many(it->second.first,it->second.second);
+            else woT::task(it->first, &implT::sock_it_to_me_many, it->second.first, it->second.second,
+                           TaskAttributes::hipri());
+        }
+        for (typename std::map<ProcessID, std::pair< std::vector<argT>,std::vector<refT> > >::const_iterator
+                 it=replies.begin(); it!=replies.end(); ++it) {
+            if (it->first==world.rank()) set_neighbors(it->second.first,it->second.second);
+            else woT::task(it->first, &implT::set_neighbors, it->second.first, it->second.second,
+                           TaskAttributes::hipri());
+        }
+    }
+
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::set_neighbors(const std::vector< std::pair<keyT,coeffT> >& values,
+                                             const std::vector< RemoteReference< FutureImpl< std::pair<keyT,coeffT> > > >& refs) const {
+        for (std::size_t i=0; i<values.size(); ++i) {
+            Future< std::pair<keyT,coeffT> > result(refs[i]);
+            result.set(values[i]);
+        }
+    }
+
     // like sock_it_to_me, but it replaces empty node with averaged coeffs from further down the tree
     template <typename T, std::size_t NDIM>
     void FunctionImpl<T,NDIM>::sock_it_to_me_too(const keyT& key,
@@ -2956,6 +3209,125 @@ namespace madness {
         return std::pair<bool,T>(false,0.0);
     }
 
+    template <typename T, std::size_t NDIM>
+    std::vector<T> FunctionImpl<T,NDIM>::eval_many(const std::vector<coordT>& xin) const {
+        PROFILE_MEMBER_FUNC(FunctionImpl);
+        std::vector<T> result(xin.size(), T(0.0));
+        if (xin.size()) {
+            std::vector<long> index(xin.size());
+            for (std::size_t i=0; i<xin.size(); ++i) index[i] = i;
+            std::vector<keyT> keys(xin.size(), key0());
+            woT::task(coeffs.owner(key0()), &implT::eval_many_kernel,
+                      archive::archive_ptr< std::vector<T> >(&result), world.rank(), index, xin, keys,
+                      TaskAttributes::hipri());
+        }
+        world.gop.fence();
+        return result;
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::eval_many_kernel(archive::archive_ptr< std::vector<T> > result, ProcessID requester,
+                                                const std::vector<long>& index, const std::vector<coordT>& x,
+                                                const std::vector<keyT>& keys) const {
+        PROFILE_MEMBER_FUNC(FunctionImpl);
+        const ProcessID me = world.rank();
+
+        // Boxes still to visit with the positions of the points inside
+        // them.  Senders keep the points of one box together.
+        std::vector< std::pair< keyT,std::vector<long> > > todo;
+        for (std::size_t i=0; i<x.size(); ) {
+            std::vector<long> pos;
+            std::size_t j = i;
+            while (j<x.size() && keys[j]==keys[i]) pos.push_back(j++);
+            todo.push_back(std::make_pair(keys[i], pos));
+            i = j;
+        }
+
+        struct batchT {
+            std::vector<long> index;
+            std::vector<coordT> x;
+            std::vector<keyT> keys;
+        };
+        std::map<ProcessID,batchT> remote;
+        batchT done;
+        std::vector<T> values;
+
+        while (!todo.empty()) {
+            const keyT key = todo.back().first;
+            std::vector<long> pos;
+            pos.swap(todo.back().second);
+            todo.pop_back();
+
+            const ProcessID owner = coeffs.owner(key);
+            if (owner != me) {
+                batchT& b = remote[owner];
+                for (long p : pos) {
+                    b.index.push_back(index[p]);
+                    b.x.push_back(x[p]);
+                    b.keys.push_back(key);
+                }
+                continue;
+            }
+
+            typename dcT::const_iterator it = coeffs.find(key).get();
+            MADNESS_ASSERT(it != coeffs.end());
+            const nodeT& node = it->second;
+            const Vector<Translation,NDIM>& l = key.translation();
+            if (node.has_coeff()) {
+                const double twon = pow(2.0,double(key.level()));
+                std::vector<coordT> xbox(pos.size());
+                for (std::size_t j=0; j<pos.size(); ++j) {
+                    for (std::size_t d=0; d<NDIM; ++d) {
+                        double xd = x[pos[j]][d]*twon - l[d];
+                        xbox[j][d] = std::min(1.0,std::max(0.0,xd));
+                    }
+                    done.index.push_back(index[pos[j]]);
+                }
+                std::size_t n = values.size();
+                values.resize(n+pos.size());
+                eval_cube_many(key.level(), xbox, node.coeff().full_tensor_copy(), values.data()+n);
+            }
+            else {
+                // sort the points into the children, child c has bit NDIM-1-d set for the upper half in d
+                std::vector<long> child[1<<NDIM];
+                const double twon1 = pow(2.0,double(key.level()+1));
+                for (long p : pos) {
+                    int c = 0;
+                    for (std::size_t d=0; d<NDIM; ++d) {
+                        int ld = int(x[p][d]*twon1 - 2*l[d]);
+                        c = 2*c + std::min(1,std::max(0,ld));
+                    }
+                    child[c].push_back(p);
+                }
+                for (int c=0; c<(1<<NDIM); ++c) {
+                    if (child[c].empty()) continue;
+                    Vector<Translation,NDIM> lc;
+                    for (std::size_t d=0; d<NDIM; ++d) lc[d] = 2*l[d] + ((c>>(NDIM-1-d)) & 1);
+                    todo.push_back(std::make_pair(keyT(key.level()+1,lc), child[c]));
+                }
+            }
+        }
+
+        for (typename std::map<ProcessID,batchT>::const_iterator it=remote.begin(); it!=remote.end(); ++it) {
+            woT::task(it->first, &implT::eval_many_kernel, result, requester,
+                      it->second.index, it->second.x, it->second.keys, TaskAttributes::hipri());
+        }
+        if (!values.empty()) {
+            if (requester == me) eval_many_store(result, done.index, values);
+            else woT::task(requester, &implT::eval_many_store, result, done.index, values, TaskAttributes::hipri());
+        }
+    }
+
+
+    template <typename T, std::size_t NDIM>
+    void FunctionImpl<T,NDIM>::eval_many_store(archive::archive_ptr< std::vector<T> > result,
+                                               const std::vector<long>& index, const std::vector<T>& values) const {
+        std::vector<T>& r = *result;
+        for (std::size_t i=0; i<index.size(); ++i) r[index[i]] = values[i];
+    }
+
+
     template <typename T, std::size_t NDIM>
     void FunctionImpl<T,NDIM>::evaldepthpt(const Vector<double,NDIM>& xin,
                                            const keyT& keyin,
@@ -3516,6 +3888,8 @@ template <typename T, std::size_t NDIM>
         truncate_on_project = true;
         apply_randomize = false;
         project_randomize = false;
+        apply_aggregate_bytes = 0;
+        apply_aggregate_time = 0.01;
         bc = BoundaryConditions<NDIM>(BC_FREE);
         tt = TT_FULL;
         cell = make_default_cell();
@@ -3547,6 +3921,8 @@ template <typename T, std::size_t NDIM>
     		std::cout << "             truncate_on_project" <<  ": " << truncate_on_project << std::endl;
     		std::cout << "                 apply_randomize" <<  ": " << apply_randomize << std::endl;
     		std::cout << "               project_randomize" <<  ": " << project_randomize << std::endl;
+    		std::cout << "           apply_aggregate_bytes" <<  ": " << apply_aggregate_bytes << std::endl;
+    		std::cout << "            apply_aggregate_time" <<  ": " << apply_aggregate_time << std::endl;
     		std::cout << "                              bc" <<  ": " << bc << std::endl;
     		std::cout << "                              tt" <<  ": " << tt << std::endl;
     		std::cout << "                            cell" <<  ": " << cell << std::endl;
@@ -3568,6 +3944,8 @@ template <typename T, std::size_t NDIM>
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::truncate_on_project = true;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::apply_randomize = false;
     template <std::size_t NDIM> bool FunctionDefaults<NDIM>::project_randomize = false;
+    template <std::size_t NDIM> std::size_t FunctionDefaults<NDIM>::apply_aggregate_bytes = 0;
+    template <std::size_t NDIM> double FunctionDefaults<NDIM>::apply_aggregate_time = 0.01;
     template <std::size_t NDIM> BoundaryConditions<NDIM> FunctionDefaults<NDIM>::bc = BoundaryConditions<NDIM>(BC_FREE);
     template <std::size_t NDIM> TensorType FunctionDefaults<NDIM>::tt = TT_FULL;
     template <std::size_t NDIM> Tensor<double> FunctionDefaults<NDIM>::cell = FunctionDefaults<NDIM>::make_default_cell();
@@ -75,6 +75,12 @@ namespace madness {
         }
     };
 
+    /// Estimate of the memory held by cached operator data ... the 1D blocks are accounted in their own caches
+    template <typename Q, std::size_t NDIM>
+    inline std::size_t cache_nbytes(const SeparatedConvolutionData<Q,NDIM>& d) {
+        return sizeof(d) + d.muops.size()*sizeof(SeparatedConvolutionInternal<Q,NDIM>);
+    }
+
 
     /// Convolutions in separated form (including Gaussian)
 
@@ -146,7 +152,10 @@ namespace madness {
         const std::vector<long> v2k;
         const std::vector<Slice> s0;
 
-        // SeparatedConvolutionData keeps data for all terms and all dimensions and 1 displacement
+        // SeparatedConvolutionData keeps data for all terms and all dimensions and 1 displacement.
+        // These caches count towards the budget of SimpleCacheStats but are never evicted,
+        // since getop() hands out pointers into them; they grow with the number of
+        // (level, displacement) pairs used and are freed with the operator.
         mutable SimpleCache< SeparatedConvolutionData<Q,NDIM>, NDIM > data; ///< cache for all terms, dims and displacements
         mutable SimpleCache< SeparatedConvolutionData<Q,NDIM>, 2*NDIM > mod_data; ///< cache for all terms, dims and displacements
 
@@ -354,6 +363,58 @@ namespace madness {
         }
 
 
+        /// determine the (possibly low-rank) 1d transformations of the R or T block of one term
+
+        /// @param[in]      ops_1d  the 1d operators for all dimensions of one term
+        /// @param[in]      r_block use the R block (NS form) if true, the T block (scaling only) otherwise
+        /// @param[in,out]  tol     the requested precision, made relative to the norm of the block on return
+        /// @param[out]     trans   the transformations for all dimensions
+        /// @return         false if the block is negligible or of rank zero
+        bool make_transformation(const ConvolutionData1D<Q>* const ops_1d[NDIM],
+                                 const bool r_block, double& tol, Transformation trans[NDIM]) const {
+
+            double norm = 1.0;
+            for (std::size_t d=0; d<NDIM; ++d) norm *= (r_block ? ops_1d[d]->Rnorm : ops_1d[d]->Tnorm);
+            if (r_block and not (norm > 1.e-20)) return false;
+            if (not r_block and not (norm > 0.0)) return false;
+
+            tol = tol/(norm*NDIM);  // Errors are relative within here
+
+            // Determine rank of SVD to use or if to use the full matrix
+            long dimk = k;
+            if (r_block and not modified()) dimk = 2*k;
+
+            long break_even;
+            if (NDIM==1) break_even = long(0.5*dimk);
+            else if (NDIM==2) break_even = long(0.6*dimk);
+            else if (NDIM==3) break_even=long(0.65*dimk);
+            else break_even=long(0.7*dimk);
+            for (std::size_t d=0; d<NDIM; ++d) {
+                const Tensor<typename Tensor<Q>::scalar_type>& s = r_block ? ops_1d[d]->Rs : ops_1d[d]->Ts;
+                long r;
+                for (r=0; r<dimk; ++r) {
+                    if (s[r] < tol) break;
+                }
+                if (r >= break_even) {
+                    trans[d].r = dimk;
+                    trans[d].U = r_block ? ops_1d[d]->R.ptr() : ops_1d[d]->T.ptr();
+                    trans[d].VT = 0;
+                }
+                else {
+
+#ifdef USE_GENTENSOR
+                    r = std::max(2L,r+(r&1L)); // (needed for 6D == when GENTENSOR is on) NOLONGER NEED TO FORCE OPERATOR RANK TO BE EVEN
+#endif
+                    if (r == 0) return false;
+                    trans[d].r = r;
+                    trans[d].U = r_block ? ops_1d[d]->RU.ptr() : ops_1d[d]->TU.ptr();
+                    trans[d].VT = r_block ? ops_1d[d]->RVT.ptr() : ops_1d[d]->TVT.ptr();
+                }
+            }
+            return true;
+        }
+
+
         /// Apply one of the separated terms, accumulating into the result
         template <typename T>
         void muopxv_fast(ApplyTerms at,
@@ -368,99 +429,15 @@ namespace madness {
 
             //PROFILE_MEMBER_FUNC(SeparatedConvolution); // Too fine grain for routine profiling
             Transformation trans[NDIM];
-            Tensor<T> trans2[NDIM];
 
-            double Rnorm = 1.0;
-            for (std::size_t d=0; d<NDIM; ++d) Rnorm *= ops_1d[d]->Rnorm;
-
-            if (at.r_term and (Rnorm > 1.e-20)) {
-
-                tol = tol/(Rnorm*NDIM);  // Errors are relative within here
-
-                // Determine rank of SVD to use or if to use the full matrix
+            if (at.r_term and make_transformation(ops_1d, true, tol, trans)) {
                 long twok = 2*k;
                 if (modified()) twok=k;
-
-                long break_even;
-                if (NDIM==1) break_even = long(0.5*twok);
-                else if (NDIM==2) break_even = long(0.6*twok);
-                else if (NDIM==3) break_even=long(0.65*twok);
-                else break_even=long(0.7*twok);
-                bool rank_is_zero = false;
-                for (std::size_t d=0; d<NDIM; ++d) {
-                    long r;
-                    for (r=0; r<twok; ++r) {
-                        if (ops_1d[d]->Rs[r] < tol) break;
-                    }
-                    if (r >= break_even) {
-                        trans[d].r = twok;
-                        trans[d].U = ops_1d[d]->R.ptr();
-                        trans[d].VT = 0;
-                    }
-                    else {
-
-#ifdef USE_GENTENSOR
-                        r = std::max(2L,r+(r&1L)); // (needed for 6D == when GENTENSOR is on) NOLONGER NEED TO FORCE OPERATOR RANK TO BE EVEN
-#endif
-                        if (r == 0) {
-                            rank_is_zero = true;
-                            break;
-                        }
-                        trans[d].r = r;
-                        trans[d].U = ops_1d[d]->RU.ptr();
-                        trans[d].VT = ops_1d[d]->RVT.ptr();
-                    }
-                    trans2[d]=ops_1d[d]->R;
-                }
-
-                if (!rank_is_zero)
-                    apply_transformation(twok, trans, f, work1, work2, mufac, result);
-
-                //            apply_transformation2(n, twok, tol, trans2, f, work1, work2, mufac, result);
-//                apply_transformation3(trans2, f, mufac, result);
+                apply_transformation(twok, trans, f, work1, work2, mufac, result);
             }
 
-            double Tnorm = 1.0;
-            for (std::size_t d=0; d<NDIM; ++d) Tnorm *= ops_1d[d]->Tnorm;
-
-            if (at.t_term and (Tnorm>0.0)) {
-                tol = tol/(Tnorm*NDIM);  // Errors are relative within here
-
-                long break_even;
-                if (NDIM==1) break_even = long(0.5*k);
-                else if (NDIM==2) break_even = long(0.6*k);
-                else if (NDIM==3) break_even=long(0.65*k);
-                else break_even=long(0.7*k);
-                bool rank_is_zero = false;
-                for (std::size_t d=0; d<NDIM; ++d) {
-                    long r;
-                    for (r=0; r<k; ++r) {
-                        if (ops_1d[d]->Ts[r] < tol) break;
-                    }
-                    if (r >= break_even) {
-                        trans[d].r = k;
-                        trans[d].U = ops_1d[d]->T.ptr();
-                        trans[d].VT = 0;
-                    }
-                    else {
-
-#ifdef USE_GENTENSOR
-                        r = std::max(2L,r+(r&1L)); // (needed for 6D == GENTENSOR is USED) NOLONGER NEED TO FORCE OPERATOR RANK TO BE EVEN
-#endif
-                        if (r == 0) {
-                            rank_is_zero = true;
-                            break;
-                        }
-                        trans[d].r = r;
-                        trans[d].U = ops_1d[d]->TU.ptr();
-                        trans[d].VT = ops_1d[d]->TVT.ptr();
-                    }
-                    trans2[d]=ops_1d[d]->T;
-                }
-                if (!rank_is_zero)
-                    apply_transformation(k, trans, f0, work1, work2, -mufac, result0);
-//                apply_transformation2(n, k, tol, trans2, f0, work1, work2, -mufac, result0);
-//                apply_transformation3(trans2, f0, -mufac, result0);
+            if (at.t_term and make_transformation(ops_1d, false, tol, trans)) {
+                apply_transformation(k, trans, f0, work1, work2, -mufac, result0);
             }
         }
 
@@ -1050,7 +1027,10 @@ namespace madness {
 
         /// return the operator norm for all terms, all dimensions and 1 displacement
         double norm(Level n, const Key<NDIM>& d, const Key<NDIM>& source_key) const {
-            // SeparatedConvolutionData keeps data for all terms and all dimensions and 1 displacement
+            // SeparatedConvolutionData keeps data for all terms and all dimensions and 1 displacement.
+        // These caches count towards the budget of SimpleCacheStats but are never evicted,
+        // since getop() hands out pointers into them; they grow with the number of
+        // (level, displacement) pairs used and are freed with the operator.
 //            return 1.0;
             return getop(n, d, source_key)->norm;
         }
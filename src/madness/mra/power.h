@@ -36,6 +36,7 @@
 #ifndef MADNESS_MRA_POWER_H__INCLUDED
 #define MADNESS_MRA_POWER_H__INCLUDED
 
+#include <cmath>
 
 namespace madness {
 
@@ -35,37 +35,189 @@
 
 #include <madness/mra/key.h>
 #include <madness/world/worldhashmap.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <thread>
 
 namespace madness {
+
+    /// Estimate of the memory held by a cached value ... overloaded for tensors and operator blocks
+    template <typename Q>
+    inline std::size_t cache_nbytes(const Q& val) {
+        return sizeof(Q);
+    }
+
+    namespace detail {
+        /// A counter padded to a cache line so that threads updating different counters do not interfere
+        struct alignas(64) PaddedCounter {
+            std::atomic<std::uint64_t> n{0};
+        };
+    }
+
+    /// Memory accounting, budget and statistics shared by all SimpleCache instances
+
+    /// Every SimpleCache adds the estimated size of its entries to a process-wide
+    /// total.  The budget is enforced by GaussianConvolution1DCache which, when
+    /// the total exceeds the budget, drops the least recently used 1D convolutions
+    /// (and with them their caches of blocks) that are not referenced by an
+    /// operator.  Entries in use are never freed, so the budget is a soft limit.
+    ///
+    /// A budget of zero means unlimited.  The default is taken from the
+    /// environment variable \c MAD_CACHE_BUDGET_MB and is otherwise unlimited.
+    ///
+    /// Counting hits and misses costs an atomic increment per lookup and is
+    /// therefore off unless switched on with set_lookup_stats() or the
+    /// environment variable \c MAD_CACHE_STATS.  The byte and eviction
+    /// counts needed for the budget are always kept.
+    class SimpleCacheStats {
+        static const std::size_t nstripe = 64;
+        typedef detail::PaddedCounter counterT;
+
+        inline static counterT nhit[nstripe];   ///< hits counted per stripe of threads
+        inline static counterT nmiss[nstripe];  ///< misses counted per stripe of threads
+        inline static std::atomic<std::int64_t> nbytes_total{0};
+        inline static std::atomic<std::uint64_t> ninsert_total{0};
+        inline static std::atomic<std::uint64_t> nevict_total{0};
+        inline static std::atomic<std::uint64_t> tick{0};
+        inline static std::atomic<bool> lookup_stats{getenv("MAD_CACHE_STATS") != nullptr};
+
+        static std::size_t stripe() {
+            static thread_local const std::size_t s =
+                std::hash<std::thread::id>()(std::this_thread::get_id()) % nstripe;
+            return s;
+        }
+
+        static std::atomic<std::size_t>& budget_ref() {
+            static std::atomic<std::size_t> budget{[] {
+                const char* mb = getenv("MAD_CACHE_BUDGET_MB");
+                return mb ? std::size_t(atol(mb))<<20 : std::size_t(0);
+            }()};
+            return budget;
+        }
+
+        static std::uint64_t sum(const counterT* c) {
+            std::uint64_t s = 0;
+            for (std::size_t i=0; i<nstripe; ++i) s += c[i].n.load(std::memory_order_relaxed);
+            return s;
+        }
+
+    public:
+        /// Set the budget in bytes for all caches (0 = unlimited)
+        static void set_budget(std::size_t nbytes) {budget_ref() = nbytes;}
+
+        /// The budget in bytes for all caches (0 = unlimited)
+        static std::size_t get_budget() {return budget_ref();}
+
+        /// True if the budget is set and the caches hold more than it
+        static bool over_budget() {
+            const std::size_t budget = get_budget();
+            return budget && std::size_t(std::max<std::int64_t>(nbytes_total,0)) > budget;
+        }
+
+        /// Estimated number of bytes held by all caches
+        static std::size_t nbytes() {return std::size_t(std::max<std::int64_t>(nbytes_total,0));}
+
+        /// Switch counting of hits and misses on or off
+        static void set_lookup_stats(bool on) {lookup_stats.store(on, std::memory_order_relaxed);}
+
+        /// True if hits and misses are counted
+        static bool get_lookup_stats() {return lookup_stats.load(std::memory_order_relaxed);}
+
+        /// Number of successful lookups (only counted if get_lookup_stats())
+        static std::uint64_t get_nhit() {return sum(nhit);}
+
+        /// Number of failed lookups (only counted if get_lookup_stats())
+        static std::uint64_t get_nmiss() {return sum(nmiss);}
+
+        /// Number of entries inserted
+        static std::uint64_t get_ninsert() {return ninsert_total;}
+
+        /// Number of entries evicted
+        static std::uint64_t get_nevict() {return nevict_total;}
+
+        /// Print the statistics
+        static void print(const char* msg = "cache") {
+            printf("%s: nbytes=%zu budget=%zu hit=%llu miss=%llu insert=%llu evict=%llu\n",
+                   msg, nbytes(), get_budget(),
+                   (unsigned long long) get_nhit(), (unsigned long long) get_nmiss(),
+                   (unsigned long long) get_ninsert(), (unsigned long long) get_nevict());
+        }
+
+        static void hit() {
+            if (get_lookup_stats()) nhit[stripe()].n.fetch_add(1, std::memory_order_relaxed);
+        }
+        static void miss() {
+            if (get_lookup_stats()) nmiss[stripe()].n.fetch_add(1, std::memory_order_relaxed);
+        }
+        static void insert(std::size_t nbytes) {
+            ninsert_total.fetch_add(1, std::memory_order_relaxed);
+            nbytes_total.fetch_add(std::int64_t(nbytes), std::memory_order_relaxed);
+        }
+        static void release(std::size_t nbytes) {
+            nbytes_total.fetch_sub(std::int64_t(nbytes), std::memory_order_relaxed);
+        }
+        static void evict(std::size_t n = 1) {nevict_total.fetch_add(n, std::memory_order_relaxed);}
+
+        /// A monotonically increasing time stamp for LRU ordering
+        static std::uint64_t next_tick() {return tick.fetch_add(1, std::memory_order_relaxed);}
+    };
+
     /// Simplified interface around hash_map to cache stuff for 1D
 
     /// This is a write once cache --- subsequent writes of elements
     /// have no effect (so that pointers/references to cached data
-    /// cannot be invalidated)
+    /// cannot be invalidated).  The memory held is accounted in
+    /// SimpleCacheStats and is released only when the cache is destroyed,
+    /// which for the 1D convolutions happens when they are evicted from
+    /// GaussianConvolution1DCache and no longer used by any operator.
     template <typename Q, std::size_t NDIM>
     class SimpleCache {
     private:
         typedef ConcurrentHashMap< Key<NDIM>, Q > mapT;
         typedef std::pair<Key<NDIM>, Q> pairT;
         mapT cache;
+        std::atomic<std::size_t> nbytes_cache;   ///< estimated bytes held by this cache
 
     public:
-        SimpleCache() : cache() {};
+        SimpleCache() : cache(), nbytes_cache(0) {};
 
-        SimpleCache(const SimpleCache& c) : cache(c.cache) {};
+        SimpleCache(const SimpleCache& c) : cache(c.cache), nbytes_cache(c.nbytes()) {
+            SimpleCacheStats::insert(nbytes_cache);
+        };
 
         SimpleCache& operator=(const SimpleCache& c) {
             if (this != &c) {
                 cache.clear();
+                SimpleCacheStats::release(nbytes_cache);
                 cache = c.cache;
+                nbytes_cache = c.nbytes();
+                SimpleCacheStats::insert(nbytes_cache);
             }
             return *this;
         }
 
+        ~SimpleCache() {
+            SimpleCacheStats::release(nbytes_cache);
+        }
+
+        /// Estimated number of bytes held by the cached values
+        std::size_t nbytes() const {return nbytes_cache;}
+
+        /// Number of cached values
+        std::size_t size() const {return cache.size();}
+
         /// If key is present return pointer to cached value, otherwise return NULL
         inline const Q* getptr(const Key<NDIM>& key) const {
             typename mapT::const_iterator test = cache.find(key);
-            if (test == cache.end()) return 0;
+            if (test == cache.end()) {
+                SimpleCacheStats::miss();
+                return 0;
+            }
+            SimpleCacheStats::hit();
             return &(test->second);
         }
 
@@ -90,7 +242,12 @@ namespace madness {
 
         /// Set value associated with key ... gives ownership of a new copy to the container
         inline void set(const Key<NDIM>& key, const Q& val) {
-            cache.insert(pairT(key,val));
+            typename mapT::accessor a;
+            if (cache.insert(a,pairT(key,val))) {
+                const std::size_t n = cache_nbytes(val);
+                nbytes_cache += n;
+                SimpleCacheStats::insert(n);
+            }
         }
 
         inline void set(Level n, Translation l, const Q& val) {
@@ -126,6 +126,40 @@ int chunk_example(World &universe) {
     }
 }
 
+/// test fetching records on demand with a cache smaller than the stored objects
+int on_demand_example(World &universe) {
+    test_output t("testing on-demand loading with a bounded cache");
+    Cloud cloud(universe);
+    cloud.set_on_demand(true);
+    cloud.set_spill_directory(".");
+
+    std::vector<Tensor<double>> tensors;
+    std::vector<Recordlist<Cloud::keyT>> records;
+    for (int i=0; i<6; ++i) {
+        tensors.push_back(Tensor<double>(20,20).fillrandom());
+        records.push_back(cloud.store(universe, tensors.back()));
+    }
+    cloud.replicate();
+
+    // room for about two of the tensors
+    cloud.set_cache_budget(2*20*20*sizeof(double) + 1024);
+    double error = 0.0;
+    for (int sweep=0; sweep<2; ++sweep) {
+        for (std::size_t i=0; i<tensors.size(); ++i) {
+            auto r = records[i];
+            Tensor<double> c = cloud.load<Tensor<double>>(universe, r);
+            error = std::max(error, (c - tensors[i]).normf());
+        }
+    }
+    t.logger << "error " << error << " evictions " << cloud.get_nevict()
+             << " cached bytes " << cloud.get_cache_nbyte() << std::endl;
+    cloud.print_size(universe);
+    cloud.print_timings(universe);
+    bool ok = (error < 1.e-14) && (cloud.get_nevict() > 0) && (cloud.get_cache_nbyte() <= 2*20*20*sizeof(double) + 1024);
+    cloud.clear_cache(universe);
+    return t.end(ok);
+}
+
 int main(int argc, char **argv) {
 
     madness::World &universe = madness::initialize(argc, argv);
@@ -134,6 +168,7 @@ int main(int argc, char **argv) {
     chunk_example(universe);
     simple_example(universe);
     int success = 0;
+    success += on_demand_example(universe);
     {
         Cloud cloud(universe);
 //        cloud.set_debug(true);
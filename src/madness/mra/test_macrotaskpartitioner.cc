@@ -125,6 +125,37 @@ int test_partitioner(World& world) {
     return 0;
 }
 
+int test_split_batch(World& world) {
+    MacroTaskPartitioner mtp;
+
+    // 1D: input and result are split together
+    Batch batch1(Batch_1D(3,10),Batch_1D(3,10));
+    std::vector<Batch> parts1=mtp.split_batch(batch1,3);
+    MADNESS_CHECK(parts1.size()==3);
+    long begin=3;
+    for (const Batch& b : parts1) {
+        print("part",b);
+        MADNESS_CHECK(b.input[0].begin==begin);
+        MADNESS_CHECK(b.result==b.input[0]);
+        begin=b.input[0].end;
+    }
+    MADNESS_CHECK(begin==10);
+
+    // 2D: the second input is split, all parts accumulate into the same result
+    Batch batch2(Batch_1D(0,4),Batch_1D(4,6),Batch_1D(0,4));
+    std::vector<Batch> parts2=mtp.split_batch(batch2,5);
+    MADNESS_CHECK(parts2.size()==2);
+    for (const Batch& b : parts2) {
+        MADNESS_CHECK(b.result==batch2.result and b.input[0]==batch2.input[0]);
+        MADNESS_CHECK(b.input[1].size()==1);
+    }
+
+    // full-size batches cannot be split
+    Batch batch3(Batch_1D(0,-1),Batch_1D(0,-1));
+    MADNESS_CHECK(mtp.split_batch(batch3,4).size()==1);
+    return 0;
+}
+
 int main(int argc, char **argv) {
 
     madness::World &universe = madness::initialize(argc, argv);
@@ -134,6 +165,7 @@ int main(int argc, char **argv) {
     success+=test_batch_1D(universe);
     success+=test_batch(universe);
     success+=test_partitioner(universe);
+    success+=test_split_batch(universe);
 //    success+=test_partitioner(universe);
 //    success+=test_partitioner(universe);
 
@@ -186,6 +186,32 @@ int test_deferred(World& universe, const std::vector<real_function_3d>& v3,
     return success;
 }
 
+int test_chunked(World& universe, const std::vector<real_function_3d>& v3,
+                 const std::vector<real_function_3d>& ref) {
+    if (universe.rank() == 0) print("\nstarting chunked execution with timeline");
+    auto taskq = std::shared_ptr<MacroTaskQ>(new MacroTaskQ(universe, universe.size()));
+    taskq->set_printlevel(3);
+    taskq->set_max_chunk_size(3);
+    taskq->set_timeline("test_vectormacrotask.timeline");
+    MicroTask t;
+    t.partitioner->set_min_batch_size(2);
+    t.partitioner->set_max_batch_size(2);
+    MacroTask task(universe, t, taskq);
+    std::vector<real_function_3d> f2a = task(v3[0], 2.0, v3);
+    taskq->run_all();
+    int success=check_vector(universe,ref,f2a,"chunked execution of task");
+
+    // the subworlds have run all tasks, each exactly once
+    long nline=0;
+    std::ifstream is("test_vectormacrotask.timeline."+std::to_string(universe.rank()));
+    for (std::string line; std::getline(is,line);) if (line.size()>0 and line[0]!='#') ++nline;
+    universe.gop.sum(nline);
+    if (universe.rank()==0) print("tasks in timelines",nline);
+    if (nline<long(v3.size()/2)) success++;
+    std::remove(("test_vectormacrotask.timeline."+std::to_string(universe.rank())).c_str());
+    return success;
+}
+
 int test_twice(World& universe, const std::vector<real_function_3d>& v3,
                   const std::vector<real_function_3d>& ref) {
     if (universe.rank() == 0) print("\nstarting Microtask twice (check caching)\n");
@@ -267,6 +293,9 @@ int main(int argc, char **argv) {
         success+=test_twice(universe,v3,ref);
         timer1.tag("executing a task twice");
 
+        success+=test_chunked(universe,v3,ref);
+        timer1.tag("chunked execution with timeline");
+
         success+=test_task1(universe,v3);
         timer1.tag("task1 immediate execution");
 
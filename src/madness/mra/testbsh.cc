@@ -139,6 +139,27 @@ int test_bsh(World& world) {
         if (world.rank() == 0) print("done in time",cpu_time()-start);
         ff.clear();
         opf.verify_tree();
+
+        // results for remote nodes sent one at a time must agree with the aggregated ones
+        const std::size_t aggregate_bytes = FunctionDefaults<3>::get_apply_aggregate_bytes();
+        for (std::size_t nbytes : {std::size_t(0), std::size_t(1)<<18}) {
+            FunctionDefaults<3>::set_apply_aggregate_bytes(nbytes);
+            ff = copy(f);
+            world.gop.fence();
+            double nsent = RMI::get_stats().nmsg_sent;
+            double wall = wall_time();
+            Function<T,3> opf_agg = op(ff);
+            wall = wall_time() - wall;
+            nsent = RMI::get_stats().nmsg_sent - nsent;
+            world.gop.sum(nsent);
+            world.gop.max(wall);
+            double aggerr = (opf-opf_agg).norm2()/opf.norm2();
+            if (world.rank() == 0) print("apply with aggregate_bytes", nbytes, ": messages", nsent,
+                                         "wall time", wall, "rel. difference", aggerr);
+            if (aggerr>1.e-10) success++;
+        }
+        FunctionDefaults<3>::set_apply_aggregate_bytes(aggregate_bytes);
+        ff.clear();
         double opferr = opf.err(Qfunc());
         if (world.rank() == 0) print("err in opf", opferr);
         if (world.rank() == 0) print("err in f", ferr);
@@ -176,6 +197,71 @@ int test_bsh(World& world) {
 }
 
 
+/// Compares the curve map with the hashed LevelPmap: owner() and remote traffic of apply and derivatives
+int test_curve_pmap(World& world) {
+    typedef Vector<double,3> coordT;
+    typedef std::shared_ptr< FunctionFunctorInterface<double,3> > functorT;
+    int success=0;
+    if (world.rank() == 0) print("\nTest CurveRangePmap\n");
+
+    // the O(1) owner of the uniform ranges agrees with the binary search in the same ranges
+    CurveRangePmap<3> uniform(world);
+    CurveRangePmap<3> searched(uniform.get_ranges());
+    int nwrong = 0;
+    for (Level n=0; n<10; ++n) {
+        for (int i=0; i<200; ++i) {
+            Vector<Translation,3> l;
+            for (std::size_t d=0; d<3; ++d) l[d] = (Translation(RandomValue<int>()) & 0x7fffffff) % (Translation(1)<<n);
+            const Key<3> key(n,l);
+            if (uniform.owner(key) != searched.owner(key)) ++nwrong;
+        }
+    }
+    if (world.rank() == 0) print("keys with different owners", nwrong);
+    if (nwrong) success++;
+
+    FunctionDefaults<3>::set_k(8);
+    FunctionDefaults<3>::set_thresh(1e-6);
+    FunctionDefaults<3>::set_initial_level(5);
+    const double expnt = 100.0;
+    const double coeff = pow(expnt/constants::pi,1.5);
+    functorT gaussian(new Gaussian<double,3>(coordT(0.1), expnt, coeff));
+    SeparatedConvolution<double,3> op = BSHOperator<3>(world, 1.0, 1e-4, 1e-6);
+    Derivative<double,3> D = free_space_derivative<double,3>(world, 0);
+
+    std::vector<double> results;
+    for (int imap=0; imap<2; ++imap) {
+        std::shared_ptr< WorldDCPmapInterface< Key<3> > > pmap;
+        if (imap == 0) pmap.reset(new LevelPmap< Key<3> >(world));
+        else pmap.reset(new CurveRangePmap<3>(world));
+        Function<double,3> f = FunctionFactory<double,3>(world).functor(gaussian).pmap(pmap);
+        f.truncate();
+        world.gop.fence();
+
+        double nmsg[2], nbyte[2];
+        for (int i=0; i<2; ++i) {
+            RMIStats s0 = RMI::get_stats();
+            Function<double,3> g = (i == 0) ? op(f) : D(f);
+            world.gop.fence();
+            RMIStats s1 = RMI::get_stats();
+            nmsg[i] = s1.nmsg_sent - s0.nmsg_sent;
+            nbyte[i] = s1.nbyte_sent - s0.nbyte_sent;
+            results.push_back(g.norm2());
+        }
+        world.gop.sum(nmsg, 2);
+        world.gop.sum(nbyte, 2);
+        if (world.rank() == 0) print((imap == 0) ? "LevelPmap     " : "CurveRangePmap",
+                                     "apply: messages", nmsg[0], "bytes", nbyte[0],
+                                     "  derivative: messages", nmsg[1], "bytes", nbyte[1]);
+    }
+    // the distribution does not change the results
+    if (std::abs(results[0]-results[2]) > 1e-10*results[0]) success++;
+    if (std::abs(results[1]-results[3]) > 1e-10*results[1]) success++;
+
+    world.gop.fence();
+    return success;
+}
+
+
 int main(int argc, char**argv) {
     initialize(argc,argv);
     World world(SafeMPI::COMM_WORLD);
@@ -189,6 +275,7 @@ int main(int argc, char**argv) {
         std::cout << "small test : " << smalltest << std::endl;
 
         success=test_bsh<double>(world);
+        success+=test_curve_pmap(world);
 
     }
     catch (const SafeMPI::Exception& e) {
@@ -38,6 +38,7 @@
 #include <madness/mra/mra.h>
 #include <madness/mra/operator.h>
 #include <madness/constants.h>
+#include <unistd.h>
 
 using namespace madness;
 
@@ -174,6 +175,109 @@ int test_gconv(World& world) {
     return success;
 }
 
+/// test that the cache of 1D convolutions stays within its budget and recomputes evicted blocks correctly
+int test_gconv_cache(World& world) {
+    int success=0;
+    if (world.rank() == 0) print("Test bounded cache of Gaussian convolutions");
+
+    typedef GaussianConvolution1DCache<double> cacheT;
+    const real_function_1d f = real_factory_1d(world).f(g);
+    const std::size_t budget = SimpleCacheStats::get_budget();
+    const std::uint64_t nevict0 = SimpleCacheStats::get_nevict();
+    const double expnts[] = {1.0, 2.0, 4.0, 8.0, 16.0};
+
+    // populate the caches of blocks with operators for several exponents
+    std::vector<double> norms;
+    for (double expnt : expnts) {
+        std::vector< std::shared_ptr< Convolution1D<double> > > ops(1, cacheT::get(k, expnt, 0, false));
+        real_convolution_1d op(world, ops);
+        norms.push_back(op(f).norm2());
+        world.gop.fence();
+    }
+    const std::size_t nbytes = SimpleCacheStats::nbytes();
+    print("cache size ", cacheT::map.size(), " nbytes ", nbytes);
+    if (nbytes == 0) success++;
+
+    // with a tiny budget everything not in use is evicted on the next lookup
+    SimpleCacheStats::set_budget(1);
+    std::shared_ptr< Convolution1D<double> > inuse = cacheT::get(k, expnts[0], 0, false);
+    print("cache size after eviction ", cacheT::map.size(), " nbytes ", SimpleCacheStats::nbytes());
+    if (cacheT::map.size() != 1) success++;
+    if (SimpleCacheStats::get_nevict() - nevict0 < 4) success++;
+    if (SimpleCacheStats::nbytes() >= nbytes) success++;
+
+    // evicted convolutions are recomputed on demand
+    SimpleCacheStats::set_budget(budget);
+    const bool lookup_stats = SimpleCacheStats::get_lookup_stats();
+    SimpleCacheStats::set_lookup_stats(true);
+    const std::uint64_t nmiss0 = SimpleCacheStats::get_nmiss();
+    for (std::size_t i=0; i<norms.size(); ++i) {
+        std::vector< std::shared_ptr< Convolution1D<double> > > ops(1, cacheT::get(k, expnts[i], 0, false));
+        real_convolution_1d op(world, ops);
+        const double error = std::abs(op(f).norm2() - norms[i]);
+        if (error > 1e-12) success++;
+    }
+    if (SimpleCacheStats::get_nmiss() - nmiss0 < 4) success++;
+    SimpleCacheStats::print("gconv cache");
+    SimpleCacheStats::set_lookup_stats(lookup_stats);
+    print("success cache ", success);
+
+    world.gop.fence();
+    return success;
+}
+
+/// test that blocks saved to the persistent store are read back instead of recomputed
+int test_gconv_store(World& world) {
+    int success=0;
+    if (world.rank() == 0) print("Test persistent store of operator blocks");
+
+    typedef GaussianConvolution1DCache<double> cacheT;
+    const real_function_1d f = real_factory_1d(world).f(g);
+    const double expnt = 3.25;
+
+    char dir[] = "/tmp/madopstoreXXXXXX";
+    if (!mkdtemp(dir)) return 1;
+    OperatorBlockStore::set_directory(dir);
+
+    // first use computes the blocks, rank 0 saves them on flush
+    std::string filename;
+    double norm;
+    {
+        std::vector< std::shared_ptr< Convolution1D<double> > > ops(1, cacheT::get(k, expnt, 0, false));
+        if (!ops[0]->block_file) return 1;
+        filename = ops[0]->block_file->get_filename();
+        real_convolution_1d op(world, ops);
+        norm = op(f).norm2();
+        world.gop.fence();
+        OperatorBlockStore::flush();
+        world.gop.fence();
+    }
+    const std::uint64_t nwrite = OperatorBlockStore::get_nwrite();
+    cacheT::map.clear();
+
+    // second use reads them
+    const std::uint64_t nread0 = OperatorBlockStore::get_nread();
+    {
+        std::vector< std::shared_ptr< Convolution1D<double> > > ops(1, cacheT::get(k, expnt, 0, false));
+        print("blocks written ", nwrite, " mapped ", ops[0]->block_file->nmapped());
+        if (ops[0]->block_file->nmapped() == 0) success++;
+        real_convolution_1d op(world, ops);
+        const double error = std::abs(op(f).norm2() - norm);
+        print("blocks read ", OperatorBlockStore::get_nread() - nread0, " error ", error);
+        if (OperatorBlockStore::get_nread() == nread0) success++;
+        if (error > 1e-12) success++;
+        world.gop.fence();
+    }
+    cacheT::map.clear();
+
+    OperatorBlockStore::set_directory("");
+    remove(filename.c_str());
+    rmdir(dir);
+    print("success store ", success);
+
+    world.gop.fence();
+    return success;
+}
 
 int main(int argc, char**argv) {
     initialize(argc,argv);
@@ -193,6 +297,8 @@ int main(int argc, char**argv) {
         	print(" polynomial ", k,"\n");
         }
         success+=test_gconv(world);
+        success+=test_gconv_cache(world);
+        success+=test_gconv_store(world);
 
     }
     catch (const SafeMPI::Exception& e) {
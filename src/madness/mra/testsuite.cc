@@ -41,6 +41,8 @@
 #include <cstdio>
 #include <madness/constants.h>
 #include <madness/mra/qmprop.h>
+#include <madness/mra/checkpoint.h>
+#include <madness/mra/mappedfunction.h>
 
 #include <madness/misc/ran.h>
 
@@ -661,6 +663,16 @@ int test_diff(World& world) {
 
         if (world.rank() == 0) print("    error", err);
     }
+
+    // all axes in one pass
+    START_TIMER;
+    std::vector< Function<T,NDIM> > gradf = grad(f);
+    END_TIMER("grad");
+    for (std::size_t axis=0; axis<NDIM; ++axis) {
+        DerivativeGaussian<T,NDIM> df(origin,expnt,coeff,axis);
+        double err = gradf[axis].err(df);
+        CHECK(err, 110*thresh, "err in test_diff grad");
+    }
     world.gop.fence();
     if (not ok) return 1;
     return 0;
@@ -1183,6 +1195,116 @@ int test_plot(World& world) {
     return 1;
 }
 
+template <typename T, std::size_t NDIM>
+int test_eval_many(World& world) {
+    bool ok = true;
+    typedef Vector<double,NDIM> coordT;
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > functorT;
+    if (world.rank() == 0) {
+        print("\nTest eval_many - type =", archive::get_type_name<T>(),", ndim =",NDIM,"\n");
+    }
+    const double L = 4.0;
+    FunctionDefaults<NDIM>::set_cubic_cell(-L,L);
+    FunctionDefaults<NDIM>::set_k(7);
+    FunctionDefaults<NDIM>::set_thresh(1.e-7);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(2);
+
+    const coordT origin(0.6666666);
+    functorT functor(new Gaussian<T,NDIM>(origin, 1.0, pow(2.0/PI,0.25*NDIM)));
+    Function<T,NDIM> f = FunctionFactory<T,NDIM>(world).functor(functor);
+
+    // every process asks for its own points, including the corners of the cell
+    std::vector<coordT> x;
+    const std::size_t npt = (world.rank() == 0) ? 2000 : 100*world.rank();
+    for (std::size_t i=0; i<npt; ++i) {
+        coordT r;
+        for (std::size_t d=0; d<NDIM; ++d) r[d] = 2.0*L*(RandomValue<double>()-0.5);
+        x.push_back(r);
+    }
+    x.push_back(coordT(-L));
+    x.push_back(coordT(L));
+
+    double t0 = wall_time();
+    std::vector< Future<T> > fpt(x.size());
+    for (std::size_t i=0; i<x.size(); ++i) fpt[i] = f.eval(x[i]);
+    world.gop.fence();
+    double t1 = wall_time();
+    std::vector<T> fmany = f.eval_many(x);
+    double t2 = wall_time();
+
+    double err = 0.0;
+    for (std::size_t i=0; i<x.size(); ++i) err = std::max(err, double(std::abs(fpt[i].get()-fmany[i])));
+    world.gop.max(err);
+    CHECK(err,1e-12,"eval_many-eval");
+
+    if (world.rank() == 0) {
+        printf("  eval %8.4fs   eval_many %8.4fs   for %zu points on process 0\n", t1-t0, t2-t1, x.size());
+    }
+    world.gop.fence();
+    if (ok) return 0;
+    return 1;
+}
+
+template <typename T, std::size_t NDIM>
+int test_loadbal(World& world) {
+    bool ok = true;
+    typedef Vector<double,NDIM> coordT;
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > functorT;
+    typedef std::shared_ptr< WorldDCPmapInterface< Key<NDIM> > > pmapT;
+    if (world.rank() == 0) {
+        print("\nTest LoadBalanceSFC - type =", archive::get_type_name<T>(),", ndim =",NDIM,"\n");
+    }
+    FunctionDefaults<NDIM>::set_cubic_cell(-10,10);
+    FunctionDefaults<NDIM>::set_k(6);
+    FunctionDefaults<NDIM>::set_thresh(1e-6);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(2);
+
+    const coordT origin(0.5);
+    functorT functor(new Gaussian<T,NDIM>(origin, 10.0, pow(20.0/PI,0.25*NDIM)));
+    Function<T,NDIM> f = FunctionFactory<T,NDIM>(world).functor(functor);
+    const double norm = f.norm2();
+
+    // measure the multiply kernel in addition to the node count
+    TaskCostRecorder<NDIM>::set_enabled(true);
+    Function<T,NDIM> fsq = f*f;
+    const double normsq = fsq.norm2();
+
+    LoadBalanceSFC<NDIM> lb(world);
+    lb.add_tree(f, lbcost<T,NDIM>());
+    lb.add_measured_cost();
+    MADNESS_CHECK(!TaskCostRecorder<NDIM>::is_enabled());
+    MADNESS_CHECK(TaskCostRecorder<NDIM>::begin() == TaskCostRecorder<NDIM>::end());
+    pmapT pmap = lb.load_balance();
+    FunctionDefaults<NDIM>::redistribute(world, pmap);
+
+    // the ranges must be ordered along the curve
+    std::shared_ptr< CurveRangePmap<NDIM> > curve = std::dynamic_pointer_cast< CurveRangePmap<NDIM> >(pmap);
+    MADNESS_CHECK(curve);
+    MADNESS_CHECK(curve->get_ranges().size() == std::size_t(world.size()-1));
+    for (auto it=f.get_impl()->get_coeffs().begin(); it!=f.get_impl()->get_coeffs().end(); ++it) {
+        MADNESS_CHECK(pmap->owner(it->first) == world.rank());
+    }
+
+    double err = std::abs(f.norm2() - norm);
+    CHECK(err,1e-14*norm,"norm after redistribute");
+    err = std::abs((f*f).norm2() - normsq);
+    CHECK(err,1e-12*normsq,"f*f after redistribute");
+
+    // with a generous tolerance the current ranges are kept and nothing moves
+    LoadBalanceSFC<NDIM> lb2(world, 100.0);
+    lb2.add_tree(f, lbcost<T,NDIM>());
+    ok = ok && (lb2.load_balance() == pmap);
+    if (world.rank() == 0) print("current ranges kept", ok);
+
+    f.clear(); fsq.clear();
+    FunctionDefaults<NDIM>::set_default_pmap(world);
+    world.gop.fence();
+    if (ok) return 0;
+    return 1;
+}
+
 template <typename T, std::size_t NDIM>
 int test_io(World& world) {
     if (world.rank() == 0) {
@@ -1230,6 +1352,119 @@ int test_io(World& world) {
     return 1;
 }
 
+template <typename T, std::size_t NDIM>
+int test_checkpoint(World& world) {
+    if (world.rank() == 0) {
+        print("\nTest checkpoint - type =", archive::get_type_name<T>(),", ndim =",NDIM,"\n");
+    }
+    bool ok=true;
+    typedef Vector<double,NDIM> coordT;
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > functorT;
+
+    FunctionDefaults<NDIM>::set_k(6);
+    FunctionDefaults<NDIM>::set_thresh(1e-8);
+    FunctionDefaults<NDIM>::set_truncate_mode(0);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(3);
+    FunctionDefaults<NDIM>::set_cubic_cell(-10,10);
+
+    const double coeff = pow(2.0/PI,0.25*NDIM);
+    functorT ff(new Gaussian<T,NDIM>(coordT(0.0), 10.0, coeff));
+    functorT gg(new Gaussian<T,NDIM>(coordT(0.5), 2.0, coeff));
+    const Function<T,NDIM> f = FunctionFactory<T,NDIM>(world).functor(ff);
+    Function<T,NDIM> g = FunctionFactory<T,NDIM>(world).functor(gg);
+    g.compress();
+
+    for (bool compress : {false, true}) {
+        std::vector< Function<T,NDIM> > v = {copy(f), copy(g)};
+        v[0].reconstruct();
+        v[1].compress();
+        CheckpointWriter writer = save_checkpoint(v, "ckpt_test", compress);
+
+        // the nodes were copied, so the functions may change while the file is written
+        v[0].scale(2.0);
+        v[1].clear();
+        writer.wait(world);
+        if (world.rank() == 0) print("compress", compress, "bytes", writer.nbyte_raw(), "written", writer.nbyte_written());
+
+        std::vector< Function<T,NDIM> > w = load_checkpoint<T,NDIM>(world, "ckpt_test");
+        MADNESS_CHECK(w.size() == 2);
+        MADNESS_CHECK(w[1].is_compressed() && w[0].is_reconstructed());
+        w[0].verify_tree();
+        const double errf = (w[0]-f).norm2();
+        const double errg = (w[1]-g).norm2();
+        CHECK(errf,1e-14,"test_checkpoint f");
+        CHECK(errg,1e-14,"test_checkpoint g");
+        world.gop.fence();
+        remove(CheckpointWriter::filename("ckpt_test", world.rank()).c_str());
+    }
+
+    if (world.rank() == 0) print("test_checkpoint OK");
+    world.gop.fence();
+    if (ok) return 0;
+    return 1;
+}
+
+template <typename T, std::size_t NDIM>
+int test_mapped(World& world) {
+    if (world.rank() == 0) {
+        print("\nTest mapped load - type =", archive::get_type_name<T>(),", ndim =",NDIM,"\n");
+    }
+    bool ok=true;
+    typedef Vector<double,NDIM> coordT;
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > functorT;
+
+    FunctionDefaults<NDIM>::set_k(6);
+    FunctionDefaults<NDIM>::set_thresh(1e-8);
+    FunctionDefaults<NDIM>::set_truncate_mode(0);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(3);
+    FunctionDefaults<NDIM>::set_cubic_cell(-10,10);
+
+    const double coeff = pow(2.0/PI,0.25*NDIM);
+    functorT ff(new Gaussian<T,NDIM>(coordT(0.0), 10.0, coeff));
+    functorT gg(new Gaussian<T,NDIM>(coordT(0.5), 2.0, coeff));
+    const Function<T,NDIM> f = FunctionFactory<T,NDIM>(world).functor(ff);
+    Function<T,NDIM> g = FunctionFactory<T,NDIM>(world).functor(gg);
+    g.compress();
+    save_mapped(std::vector< Function<T,NDIM> >{f, g}, "mapped_test");
+
+    std::size_t nmapped = 0;
+    std::vector< Function<T,NDIM> > w = load_mapped<T,NDIM>(world, "mapped_test", &nmapped);
+    MADNESS_CHECK(w.size() == 2);
+    MADNESS_CHECK(w[1].is_compressed() && w[0].is_reconstructed());
+    w[0].verify_tree();
+
+    // with the same processes and map all local coefficients reference the file
+    std::size_t ncoeff = 0;
+    for (const auto& h : w) {
+        const auto& coeffs = h.get_impl()->get_coeffs();
+        for (auto it=coeffs.begin(); it!=coeffs.end(); ++it) if (it->second.has_coeff()) ++ncoeff;
+    }
+    MADNESS_CHECK(nmapped == ncoeff);
+
+    double errf = (w[0]-f).norm2();
+    const double errg = (w[1]-g).norm2();
+    CHECK(errf,1e-14,"test_mapped f");
+    CHECK(errg,1e-14,"test_mapped g");
+
+    // changing the loaded function changes neither the file nor other loads
+    w[0].scale(2.0);
+    std::vector< Function<T,NDIM> > v = load_mapped<T,NDIM>(world, "mapped_test");
+    errf = (v[0]-f).norm2();
+    CHECK(errf,1e-14,"test_mapped f after scale");
+
+    w.clear();
+    v.clear();
+    world.gop.fence();
+    remove(MappedFunctionFile::filename("mapped_test", world.rank()).c_str());
+
+    if (world.rank() == 0) print("test_mapped OK");
+    world.gop.fence();
+    if (ok) return 0;
+    return 1;
+}
+
 template <typename T, std::size_t NDIM>
 int test_apply_push_1d(World& world) {
     typedef Vector<double,NDIM> coordT;
@@ -1341,6 +1576,7 @@ int main(int argc, char**argv) {
         nfail+=test_diff<double,1>(world);
         nfail+=test_op<double,1>(world);
         nfail+=test_plot<double,1>(world);
+        nfail+=test_eval_many<double,1>(world);
         nfail+=test_apply_push_1d<double,1>(world);
         nfail+=test_io<double,1>(world);
 
@@ -1362,6 +1598,7 @@ int main(int argc, char**argv) {
         nfail+=test_diff<double_complex,1>(world);
         nfail+=test_op<double_complex,1>(world);
         nfail+=test_plot<double_complex,1>(world);
+        nfail+=test_eval_many<double_complex,1>(world);
         nfail+=test_io<double_complex,1>(world);
 
         //TaskInterface::debug = true;
@@ -1371,7 +1608,11 @@ int main(int argc, char**argv) {
         nfail+=test_diff<double,2>(world);
         nfail+=test_op<double,2>(world);
         nfail+=test_plot<double,2>(world);
+        nfail+=test_eval_many<double,2>(world);
         nfail+=test_io<double,2>(world);
+        nfail+=test_checkpoint<double,2>(world);
+        nfail+=test_mapped<double,2>(world);
+        nfail+=test_loadbal<double,2>(world);
 
         if (!smalltest) {
             nfail+=test_basic<double,3>(world);
@@ -1381,7 +1622,11 @@ int main(int argc, char**argv) {
             nfail+=test_op<double,3>(world);
             nfail+=test_coulomb(world);
             nfail+=test_plot<double,3>(world);
+            nfail+=test_eval_many<double,3>(world);
+            nfail+=test_loadbal<double,3>(world);
             nfail+=test_io<double,3>(world);
+            nfail+=test_checkpoint<double,3>(world);
+            nfail+=test_mapped<double,3>(world);
             
             test_plot<double,4>(world); // slow unless reduce npt in test_plot // comment out to speed up travis
         }
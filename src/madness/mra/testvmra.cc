@@ -40,6 +40,13 @@ struct many_to_many_op {
         result[1]=t[1]+t[2];
         return result;
     }
+
+    std::vector< std::vector<madness::Tensor<double> > > operator()(const std::vector< madness::Key<NDIM> >& keys,
+            const std::vector< std::vector< madness::Tensor<double> > >& t) const {
+        std::vector< std::vector<madness::Tensor<double> > > result(keys.size());
+        for (std::size_t i=0; i<keys.size(); ++i) result[i]=(*this)(keys[i],t[i]);
+        return result;
+    }
 };
 
 
@@ -188,6 +195,23 @@ void test_inner(World& world) {
 
     if (world.rank() == 0) 
         print("error norm",(rold-rnew).normf(),"\n");
+
+    START_TIMER;
+    Tensor<TENSOR_RESULT_TYPE(T,R)> rscreen = matrix_inner(world,left,*pright,sym,0.01*thresh);
+    END_TIMER("screened");
+    if (world.rank() == 0)
+        print("error norm screened",(rold-rscreen).normf(),"\n");
+
+    if constexpr (std::is_same<T,R>::value) {
+        START_TIMER;
+        DistributedMatrix<T> A = matrix_inner(column_distributed_matrix_distribution(world,nleft,nright,7),
+                                              left,*pright,sym,0.01*thresh);
+        END_TIMER("distributed");
+        Tensor<T> rdist(nleft,nright);
+        A.copy_to_replicated(rdist);
+        if (world.rank() == 0)
+            print("error norm distributed",(rold-rdist).normf(),"\n");
+    }
 }
 
 template <typename T, typename R, int NDIM>
@@ -301,6 +325,64 @@ void test_rot(World& world) {
 
 }
 
+/// transform localized functions with a banded matrix, against gaxpy, for increasing numbers of functions
+template <typename T, int NDIM>
+void test_transform_scaling(World& world) {
+    const double thresh=1.e-5;
+    Tensor<double> cell(NDIM,2);
+    for (std::size_t i=0; i<NDIM; ++i) {
+        cell(i,0) = -20.0;
+        cell(i,1) =  20.0;
+    }
+    FunctionDefaults<NDIM>::set_cell(cell);
+    FunctionDefaults<NDIM>::set_k(6);
+    FunctionDefaults<NDIM>::set_thresh(thresh);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(3);
+    FunctionDefaults<NDIM>::set_truncate_mode(1);
+
+    if (world.rank() == 0)
+        print("testing transform scaling<",archive::get_type_name<T>(),",",NDIM,">");
+
+    for (int n : {8, 16, 32, 64}) {
+        // localized functions on a line, coupled to their neighbors only
+        std::vector< Function<T,NDIM> > v(n);
+        for (int i=0; i<n; ++i) {
+            Vector<double,NDIM> origin(0.0);
+            origin[0] = -18.0 + 36.0*i/n;
+            std::shared_ptr< FunctionFunctorInterface<T,NDIM> > f(new Gaussian<T,NDIM>(origin,4.0,T(1.0)));
+            v[i] = FunctionFactory<T,NDIM>(world).functor(f);
+        }
+        Tensor<T> U(n,n);
+        for (int i=0; i<n; ++i) {
+            U(i,i) = 1.0;
+            if (i>0) U(i-1,i) = U(i,i-1) = 0.1;
+        }
+        compress(world,v);
+
+        START_TIMER;
+        std::vector< Function<T,NDIM> > ref = zero_functions_compressed<T,NDIM>(world,n);
+        for (int i=0; i<n; ++i) {
+            for (int j=0; j<n; ++j) {
+                if (U(j,i) != T(0.0)) ref[i].gaxpy(T(1.0),v[j],U(j,i),false);
+            }
+        }
+        END_TIMER("gaxpy");
+
+        START_TIMER;
+        std::vector< Function<T,NDIM> > w = transform(world,v,U);
+        END_TIMER("transform");
+
+        START_TIMER;
+        std::vector< Function<T,NDIM> > wtol = transform(world,v,U,thresh,true);
+        END_TIMER("transform tol");
+
+        double err = norm2(world,sub(world,w,ref));
+        double errtol = norm2(world,sub(world,wtol,ref));
+        if (world.rank() == 0) print("n =",n,"error",err,"error screened",errtol,"\n");
+    }
+}
+
 template<typename T, int NDIM>
 void test_matrix_mul_sparse(World &world) {
     typedef std::shared_ptr<FunctionFunctorInterface<T, NDIM> > ffunctorT;
@@ -356,6 +438,69 @@ void test_matrix_mul_sparse(World &world) {
 
 
 
+/// compare truncate(world,v,tol,reconstructed) with compress, truncate, reconstruct one after the other
+template <typename T, std::size_t NDIM>
+void test_fused_truncate(World& world) {
+    typedef std::shared_ptr< FunctionFunctorInterface<T,NDIM> > ffunctorT;
+
+    const double thresh=1.e-5;
+    Tensor<double> cell(NDIM,2);
+    for (std::size_t i=0; i<NDIM; ++i) {
+        cell(i,0) = -11.0-2*i;  // Deliberately asymmetric bounding box
+        cell(i,1) =  10.0+i;
+    }
+    FunctionDefaults<NDIM>::set_cell(cell);
+    FunctionDefaults<NDIM>::set_k(8);
+    FunctionDefaults<NDIM>::set_thresh(thresh);
+    FunctionDefaults<NDIM>::set_refine(true);
+    FunctionDefaults<NDIM>::set_initial_level(3);
+    FunctionDefaults<NDIM>::set_truncate_mode(1);
+
+    if (world.rank() == 0)
+        print("testing fused truncate<",archive::get_type_name<T>(),",",NDIM,">");
+
+    const int nvec=20;
+    std::vector< Function<T,NDIM> > left(nvec);
+    for (int i=0; i<nvec; ++i) {
+        ffunctorT f(RandomGaussian<T,NDIM>(FunctionDefaults<NDIM>::get_cell(),10.0));
+        left[i] = FunctionFactory<T,NDIM>(world).functor(f);
+    }
+
+    // products are reconstructed and oversampled, as in the SCF loops
+    std::vector< Function<T,NDIM> > v1=mul(world,left[0],left);
+    std::vector< Function<T,NDIM> > v2=copy(world,v1);
+
+    START_TIMER;
+    compress(world,v1);
+    for (auto& f : v1) f.truncate(0.0,false);
+    world.gop.fence();
+    reconstruct(world,v1);
+    END_TIMER("compr/trunc/recon");
+
+    START_TIMER;
+    truncate(world,v2,0.0,reconstructed);
+    END_TIMER("fused truncate");
+
+    double err=0.0;
+    for (int i=0; i<nvec; ++i) {
+        MADNESS_CHECK(v2[i].is_reconstructed());
+        MADNESS_CHECK(v1[i].size()==v2[i].size());
+        err=std::max(err,(v1[i]-v2[i]).norm2());
+    }
+    if (world.rank() == 0) print("error fused truncate",err,"\n");
+    MADNESS_CHECK(err<1.e-12);
+
+    // the same ending in compressed form, starting from compressed and reconstructed functions
+    compress(world,v1);
+    truncate(world,v1,0.0,compressed);
+    truncate(world,v2,0.0,compressed);
+    for (int i=0; i<nvec; ++i) {
+        MADNESS_CHECK(v1[i].is_compressed() and v2[i].is_compressed());
+        MADNESS_CHECK((v1[i]-v2[i]).norm2()<1.e-12);
+    }
+}
+
+
 template <std::size_t NDIM>
 void test_multi_to_multi_op(World& world) {
 
@@ -397,6 +542,10 @@ void test_multi_to_multi_op(World& world) {
     double error=norm2(world,result);
     if (world.rank()==0) print("error in multi_to_multi ",error,norm_in,norm_out);
 
+    vecfuncT vbatch=multi_to_multi_op_values_batch(op, vin, 7);
+    double error_batch=norm2(world,sub(world,vout,vbatch));
+    if (world.rank()==0) print("error in multi_to_multi batch ",error_batch);
+
 }
 
 int main(int argc, char**argv) {
@@ -428,10 +577,14 @@ int main(int argc, char**argv) {
         test_rot<double,3>(world);
         test_rot<std::complex<double>,3>(world);
 
+        test_fused_truncate<double,3>(world);
+        test_fused_truncate<std::complex<double>,3>(world);
+
         test_matrix_mul_sparse<double,2>(world);
         test_matrix_mul_sparse<double,3>(world);
 
         if (!smalltest) test_multi_to_multi_op<3>(world);
+        if (!smalltest) test_transform_scaling<double,3>(world);
 #if !HAVE_GENTENSOR
         test_inner<double,std::complex<double>,1,false>(world);
         if (!smalltest) {
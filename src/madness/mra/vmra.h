@@ -72,6 +72,7 @@
 	*) truncate: truncating vectors of functions to desired precision
 	\code
 	truncate(world, v, tolerance, fence);
+	truncate(world, v, tolerance, reconstructed, fence);  // compress+truncate+reconstruct in one sweep
 	\endcode
 
 
@@ -123,6 +124,7 @@
 #include <madness/mra/derivative.h>
 #include <madness/tensor/distributed_matrix.h>
 #include <cstdio>
+#include <map>
 
 namespace madness {
 
@@ -297,6 +299,36 @@ namespace madness {
     }
 
 
+    /// Truncates a vector of functions and leaves them in the given tree state
+
+    /// Compress, truncate and (for finalstate==reconstructed) reconstruct are
+    /// done in one bottom-up and one top-down sweep per function, and the
+    /// sweeps of all functions run concurrently with a single fence at the
+    /// end.  Functions in other states are reconstructed first.
+    /// @param[in]  tol         truncation tolerance; if <=0 the default is used
+    /// @param[in]  finalstate  reconstructed or compressed
+    template <typename T, std::size_t NDIM>
+    void truncate(World& world,
+                  std::vector< Function<T,NDIM> >& v,
+                  double tol,
+                  const TreeState finalstate,
+                  bool fence=true) {
+        PROFILE_BLOCK(Vtruncate);
+
+        bool must_fence=false;
+        for (auto& f : v) {
+            if (f.is_initialized() and not (f.is_reconstructed() or f.is_compressed())) {
+                f.change_tree_state(reconstructed, false);
+                must_fence=true;
+            }
+        }
+        if (must_fence) world.gop.fence();
+
+        for (auto& f : v) f.truncate(tol, finalstate, false);
+
+        if (fence) world.gop.fence();
+    }
+
     /// Truncates a vector of functions
     template <typename T, std::size_t NDIM>
     void truncate(World& world,
@@ -307,7 +339,10 @@ namespace madness {
 
         // truncate in compressed form only for low-dimensional functions
         // compression is very expensive if low-rank tensor approximations are used
-        if (NDIM<4) compress(world, v);
+        if (NDIM<4) {
+            truncate(world, v, tol, compressed, fence);
+            return;
+        }
 
         for (unsigned int i=0; i<v.size(); ++i) {
             v[i].truncate(tol, false);
@@ -356,6 +391,32 @@ namespace madness {
         return df;
     }
 
+    /// Applies several derivative operators to one function in a single pass
+
+    /// The neighbors of the leaves are fetched once for all operators,
+    /// see FunctionImpl::diff_many.
+    /// @return     the vector D[i](f)
+    template <typename T, std::size_t NDIM>
+    std::vector< Function<T,NDIM> >
+    apply(const std::vector< std::shared_ptr< Derivative<T,NDIM> > >& D,
+          const Function<T,NDIM>& f,
+          bool fence=true)
+    {
+        World& world=f.world();
+        if (VERIFY_TREE) f.verify_tree();
+        f.reconstruct();
+        std::vector< Function<T,NDIM> > df(D.size());
+        std::vector<const DerivativeBase<T,NDIM>*> op(D.size());
+        std::vector<FunctionImpl<T,NDIM>*> dfimpl(D.size());
+        for (std::size_t i=0; i<D.size(); ++i) {
+            df[i].set_impl(f,false);
+            op[i]=D[i].get();
+            dfimpl[i]=df[i].get_impl().get();
+        }
+        f.get_impl()->diff_many(op,dfimpl,fence);
+        return df;
+    }
+
     /// Generates a vector of zero functions (reconstructed)
     template <typename T, std::size_t NDIM>
     std::vector< Function<T,NDIM> >
@@ -643,7 +704,8 @@ namespace madness {
     /// Transforms a vector of functions according to new[i] = sum[j] old[j]*c[j,i]
 
     /// Uses sparsity in the transformation matrix --- set small elements to
-    /// zero to take advantage of this.
+    /// zero to take advantage of this.  The functions are transformed box
+    /// by box, see FunctionImpl::vtransform.
     template <typename T, typename R, std::size_t NDIM>
     std::vector< Function<TENSOR_RESULT_TYPE(T,R),NDIM> >
     transform(World& world,
@@ -659,19 +721,15 @@ namespace madness {
 
         std::vector< Function<resultT,NDIM> > vc = zero_functions_compressed<resultT,NDIM>(world, m);
         compress(world, v);
-
-        for (int i=0; i<m; ++i) {
-            for (int j=0; j<n; ++j) {
-                if (c(j,i) != R(0.0)) vc[i].gaxpy(resultT(1.0),v[j],resultT(c(j,i)),false);
-            }
-        }
+        if (n > 0 && m > 0) vc[0].vtransform(v, c, vc, 0.0, false);
 
         if (fence) world.gop.fence();
         return vc;
     }
 
     /// this version of transform uses Function::vtransform and screens
-    /// using both elements of `c` and `v`
+    /// using both elements of `c` and `v`: the term of v[j] in box b is
+    /// left out if |c(j,i)|*||v[j]||_b is below truncate_tol(tol,b)
     template <typename L, typename R, std::size_t NDIM>
     std::vector< Function<TENSOR_RESULT_TYPE(L,R),NDIM> >
     transform(World& world,  const std::vector< Function<L,NDIM> >& v,
@@ -708,12 +766,7 @@ namespace madness {
 
         std::vector< Function<resultT,NDIM> > vc = zero_functions_compressed<resultT,NDIM>(world, m);
         compress(world, v);
-
-        for (int i=0; i<m; ++i) {
-            for (int j=0; j<n; ++j) {
-                if (tmp(j,i) != R(0.0)) vc[i].gaxpy(1.0,v[j],tmp(j,i),false);
-            }
-        }
+        if (n > 0 && m > 0) vc[0].vtransform(v, tmp, vc, 0.0, false);
 
         if (fence) world.gop.fence();
         return vc;
@@ -822,45 +875,115 @@ namespace madness {
 
 
 
+    namespace detail {
+        /// A key for the point-to-point messages of one collective operation in \c world
+
+        /// All processes of \c world must call this in the same order.
+        inline std::pair<unsigned long, std::size_t> next_p2p_key(const World& world) {
+            static std::map<unsigned long, std::size_t> counter;
+            return std::make_pair(world.id(), counter[world.id()]++);
+        }
+
+        /// Sum the local patches \c P(ilow:ihigh,jlow:jhigh) of all processes into \c A ... collective
+
+        /// Each process sends the part of its patch owned by another process
+        /// to that process, so only the owners hold the sum.
+        template <typename T>
+        void reduce_scatter_patch(DistributedMatrix<T>& A, int64_t ilow, int64_t ihigh,
+                                  int64_t jlow, int64_t jhigh, const Tensor<T>& P) {
+            World& world = A.get_world();
+            const auto key = next_p2p_key(world);
+            const ProcessID me = world.rank();
+            int64_t i0, i1, j0, j1;
+            for (ProcessID p=0; p<world.size(); ++p) {
+                if (p == me) continue;
+                A.get_range(p, i0, i1, j0, j1);
+                i0 = std::max(i0,ilow); i1 = std::min(i1,ihigh);
+                j0 = std::max(j0,jlow); j1 = std::min(j1,jhigh);
+                if (i0>i1 || j0>j1) continue;
+                Tensor<T> block = copy(P(Slice(i0-ilow,i1-ilow),Slice(j0-jlow,j1-jlow)));
+                if (block.absmax() == 0.0) block = Tensor<T>();    // nothing to add
+                world.gop.send(p, key, block);
+            }
+
+            A.get_range(me, i0, i1, j0, j1);
+            int64_t ilo = i0;
+            int64_t jlo = j0;
+            i0 = std::max(i0,ilow); i1 = std::min(i1,ihigh);
+            j0 = std::max(j0,jlow); j1 = std::min(j1,jhigh);
+            if (i0>i1 || j0>j1) return;
+            Tensor<T> block = A.data()(Slice(i0-ilo,i1-ilo),Slice(j0-jlo,j1-jlo));
+            block += P(Slice(i0-ilow,i1-ilow),Slice(j0-jlow,j1-jlow));
+            for (ProcessID q=0; q<world.size(); ++q) {
+                if (q == me) continue;
+                Tensor<T> t = WorldGopInterface::recv< Tensor<T> >(q, key).get();
+                if (t.size()) block += t;
+            }
+        }
+    }
+
+    /// Computes the matrix inner product of two function vectors - q(i,j) = inner(f[i],g[j])
+
+    /// The result is computed in patches.  The local contributions to a
+    /// patch are sent to the owners of its elements instead of being
+    /// summed over all processes.  If f and g are the same vector (or sym)
+    /// only the patches on and above the diagonal are computed.
+    /// For complex types symmetric is interpreted as Hermitian.
+    /// @param[in]  tol     skip the contributions of nodes below tol to an element (0 for none)
     template <typename T, std::size_t NDIM>
     DistributedMatrix<T> matrix_inner(const DistributedMatrixDistribution& d,
                                       const std::vector< Function<T,NDIM> >& f,
                                       const std::vector< Function<T,NDIM> >& g,
-                                      bool sym=false)
+                                      bool sym=false, const double tol=0.0)
     {
         PROFILE_FUNC;
         DistributedMatrix<T> A(d);
+        World& world = A.get_world();
         const int64_t n = A.coldim();
         const int64_t m = A.rowdim();
         MADNESS_ASSERT(int64_t(f.size()) == n && int64_t(g.size()) == m);
+        const bool same = ((void*)(&f) == (void*)(&g));
+        const bool hermitian = (sym || same);
+        if (hermitian) MADNESS_ASSERT(n == m);
 
-        // Assume we can always create an ichunk*jchunk matrix locally
-        const int ichunk = 1000;
-        const int jchunk = 1000; // 1000*1000*8 = 8 MBytes
-        for (int64_t ilo=0; ilo<n; ilo+=ichunk) {
-            int64_t ihi = std::min(ilo + ichunk, n);
-            std::vector< Function<T,NDIM> > ivec(f.begin()+ilo, f.begin()+ihi);
-            for (int64_t jlo=0; jlo<m; jlo+=jchunk) {
-                int64_t jhi = std::min(jlo + jchunk, m);
-                std::vector< Function<T,NDIM> > jvec(g.begin()+jlo, g.begin()+jhi);
-
-                Tensor<T> P = matrix_inner(A.get_world(),ivec,jvec);
-                A.copy_from_replicated_patch(ilo, ihi-1, jlo, jhi-1, P);
+        world.gop.fence();
+        compress(world, f);
+        if (!same) compress(world, g);
+
+        // Assume we can always create an chunk*chunk matrix locally
+        const int64_t chunk = 1000; // 1000*1000*8 = 8 MBytes
+        for (int64_t ilo=0; ilo<n; ilo+=chunk) {
+            int64_t ihi = std::min(ilo + chunk, n);
+            std::vector<const FunctionImpl<T,NDIM>*> left(ihi-ilo);
+            for (int64_t i=ilo; i<ihi; ++i) left[i-ilo] = f[i].get_impl().get();
+            for (int64_t jlo=(hermitian ? ilo : 0); jlo<m; jlo+=chunk) {
+                int64_t jhi = std::min(jlo + chunk, m);
+                std::vector<const FunctionImpl<T,NDIM>*> right(jhi-jlo);
+                for (int64_t j=jlo; j<jhi; ++j) right[j-jlo] = g[j].get_impl().get();
+
+                Tensor<T> P = FunctionImpl<T,NDIM>::inner_local(left, right, hermitian && ilo==jlo, tol);
+                world.gop.fence();
+                detail::reduce_scatter_patch(A, ilo, ihi-1, jlo, jhi-1, P);
+                if (hermitian && ilo!=jlo) {
+                    P = conj_transpose(P);
+                    detail::reduce_scatter_patch(A, jlo, jhi-1, ilo, ihi-1, P);
+                }
             }
         }
+        world.gop.fence();
         return A;
     }
 
     /// Computes the matrix inner product of two function vectors - q(i,j) = inner(f[i],g[j])
 
-    /// For complex types symmetric is interpreted as Hermitian.
-    ///
-    /// The current parallel loop is non-optimal but functional.
+    /// For complex types symmetric is interpreted as Hermitian.  If f and g
+    /// are the same vector only the upper triangle is computed.
+    /// @param[in]  tol     skip the contributions of nodes below tol to an element (0 for none)
     template <typename T, typename R, std::size_t NDIM>
     Tensor< TENSOR_RESULT_TYPE(T,R) > matrix_inner(World& world,
                                                    const std::vector< Function<T,NDIM> >& f,
                                                    const std::vector< Function<R,NDIM> >& g,
-                                                   bool sym=false)
+                                                   bool sym=false, const double tol=0.0)
     {
         world.gop.fence();
         compress(world, f);
@@ -871,7 +994,7 @@ namespace madness {
         for (unsigned int i=0; i<f.size(); i++) left[i] = f[i].get_impl().get();
         for (unsigned int i=0; i<g.size(); i++) right[i]= g[i].get_impl().get();
 
-        Tensor< TENSOR_RESULT_TYPE(T,R) > r= FunctionImpl<T,NDIM>::inner_local(left, right, sym);
+        Tensor< TENSOR_RESULT_TYPE(T,R) > r= FunctionImpl<T,NDIM>::inner_local(left, right, sym, tol);
 
         world.gop.fence();
         world.gop.sum(r.ptr(),f.size()*g.size());
@@ -1530,6 +1653,30 @@ namespace madness {
         return vout;
     }
 
+    /// apply op on the input vector yielding an output vector of functions, many boxes at a time
+
+    /// The operator is called with the keys and values of nbatch boxes at
+    /// once, as op(keys,values), see FunctionImpl::multi_to_multi_op_values_batch
+    /// @param[in]  op   the operator working on vin
+    /// @param[in]  vin  vector of input Functions; needs to be refined to common level!
+    /// @param[in]  nbatch the number of boxes per call of op
+    /// @return vector of output Functions vout = op(vin)
+    template <typename T, typename opT, std::size_t NDIM>
+    std::vector<Function<T,NDIM> > multi_to_multi_op_values_batch(const opT& op,
+            const std::vector< Function<T,NDIM> >& vin,
+            const std::size_t nbatch,
+            const bool fence=true) {
+        MADNESS_ASSERT(vin.size()>0);
+        MADNESS_ASSERT(vin[0].is_initialized()); // might be changed
+        World& world=vin[0].world();
+        Function<T,NDIM> dummy;
+        dummy.set_impl(vin[0], false);
+        std::vector<Function<T,NDIM> > vout=zero_functions<T,NDIM>(world, op.get_result_size());
+        for (auto& out : vout) out.set_impl(vin[0],false);
+        dummy.multi_to_multi_op_values_batch(op, vin, vout, nbatch, fence);
+        return vout;
+    }
+
 
 
 
@@ -1681,10 +1828,8 @@ namespace madness {
         std::vector< std::shared_ptr< Derivative<T,NDIM> > > grad=
                 gradient_operator<T,NDIM>(world);
 
-        std::vector<Function<T,NDIM> > result(NDIM);
-        for (size_t i=0; i<NDIM; ++i) result[i]=apply(*(grad[i]),f,false);
-        if (fence) world.gop.fence();
-        return result;
+        // all NDIM derivatives in one pass over the tree
+        return apply(grad,f,fence);
     }
 
     // BLM first derivative
@@ -1702,10 +1847,7 @@ namespace madness {
         // Read in new coeff for each operator
         for (unsigned int i=0; i<NDIM; ++i) (*grad[i]).set_ble1();
 
-        std::vector<Function<T,NDIM> > result(NDIM);
-        for (unsigned int i=0; i<NDIM; ++i) result[i]=apply(*(grad[i]),f,false);
-        if (fence) world.gop.fence();
-        return result;
+        return apply(grad,f,fence);
     }
 
     // BLM second derivative
@@ -1723,10 +1865,7 @@ namespace madness {
         // Read in new coeff for each operator
         for (unsigned int i=0; i<NDIM; ++i) (*grad[i]).set_ble2();
 
-        std::vector<Function<T,NDIM> > result(NDIM);
-        for (unsigned int i=0; i<NDIM; ++i) result[i]=apply(*(grad[i]),f,false);
-        if (fence) world.gop.fence();
-        return result;
+        return apply(grad,f,fence);
     }
 
     // Bspline first derivative
@@ -1744,10 +1883,7 @@ namespace madness {
         // Read in new coeff for each operator
         for (unsigned int i=0; i<NDIM; ++i) (*grad[i]).set_bspline1();
 
-        std::vector<Function<T,NDIM> > result(NDIM);
-        for (unsigned int i=0; i<NDIM; ++i) result[i]=apply(*(grad[i]),f,false);
-        if (fence) world.gop.fence();
-        return result;
+        return apply(grad,f,fence);
     }
 
     // Bpsline second derivative
@@ -1765,10 +1901,7 @@ namespace madness {
         // Read in new coeff for each operator
         for (unsigned int i=0; i<NDIM; ++i) (*grad[i]).set_bspline2();
 
-        std::vector<Function<T,NDIM> > result(NDIM);
-        for (unsigned int i=0; i<NDIM; ++i) result[i]=apply(*(grad[i]),f,false);
-        if (fence) world.gop.fence();
-        return result;
+        return apply(grad,f,fence);
     }
 
     // Bspline third derivative
@@ -1786,10 +1919,7 @@ namespace madness {
         // Read in new coeff for each operator
         for (unsigned int i=0; i<NDIM; ++i) (*grad[i]).set_bspline3();
 
-        std::vector<Function<T,NDIM> > result(NDIM);
-        for (unsigned int i=0; i<NDIM; ++i) result[i]=apply(*(grad[i]),f,false);
-        if (fence) world.gop.fence();
-        return result;
+        return apply(grad,f,fence);
     }
 
 
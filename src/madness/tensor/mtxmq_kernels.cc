@@ -0,0 +1,296 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file tensor/mtxmq_kernels.cc
+/// \brief Fixed-shape mTxmq kernels for small matrices
+
+#include <madness/madness_config.h>
+#include <madness/tensor/mtxmq_kernels.h>
+#include <madness/world/madness_exception.h>
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define MADNESS_MTXMQ_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace madness {
+
+    namespace {
+
+        /// c(i,j) = sum(k) a(k,i)*b(k*ldb+j) for j,k<N
+
+        /// Portable version for the generic backend.  Two rows of c are
+        /// accumulated at a time so that each row of b is loaded once per
+        /// pair, and the loops over j are of fixed length so the compiler can
+        /// unroll and vectorize them for the baseline instruction set.
+        template <int N>
+        __attribute__((always_inline)) inline
+        void mtxmq_fixed(long dimi, double* MADNESS_RESTRICT c,
+                         const double* MADNESS_RESTRICT a,
+                         const double* MADNESS_RESTRICT b, long ldb) {
+            long i=0;
+            for (; i+1<dimi; i+=2, c+=2*N) {
+                double c0[N], c1[N];
+                for (int j=0; j<N; ++j) c0[j] = c1[j] = 0.0;
+                const double* MADNESS_RESTRICT ak = a+i;
+                const double* MADNESS_RESTRICT bk = b;
+                for (int k=0; k<N; ++k, ak+=dimi, bk+=ldb) {
+                    const double a0 = ak[0];
+                    const double a1 = ak[1];
+                    for (int j=0; j<N; ++j) {
+                        c0[j] += a0*bk[j];
+                        c1[j] += a1*bk[j];
+                    }
+                }
+                for (int j=0; j<N; ++j) {
+                    c[j] = c0[j];
+                    c[N+j] = c1[j];
+                }
+            }
+            if (i<dimi) {
+                double c0[N];
+                for (int j=0; j<N; ++j) c0[j] = 0.0;
+                const double* MADNESS_RESTRICT ak = a+i;
+                const double* MADNESS_RESTRICT bk = b;
+                for (int k=0; k<N; ++k, ak+=dimi, bk+=ldb) {
+                    const double a0 = ak[0];
+                    for (int j=0; j<N; ++j) c0[j] += a0*bk[j];
+                }
+                for (int j=0; j<N; ++j) c[j] = c0[j];
+            }
+        }
+
+        struct GenericISA {
+            template <int N>
+            static void kernel(long dimi, double* c, const double* a, const double* b, long ldb) {
+                mtxmq_fixed<N>(dimi, c, a, b, ldb);
+            }
+        };
+
+#ifdef MADNESS_MTXMQ_X86_KERNELS
+        /// AVX2 kernels ... a block of MR rows of c is held in registers as
+        /// (N+3)/4 vectors per row, the last one masked if 4 does not divide N
+        struct AVX2ISA {
+            template <int N, int MR>
+            __attribute__((always_inline, target("avx2,fma"))) static inline
+            void block(long dimi, double* MADNESS_RESTRICT c, const double* MADNESS_RESTRICT a,
+                       const double* MADNESS_RESTRICT b, long ldb) {
+                constexpr int NV = (N+3)/4;
+                constexpr int NT = N%4;
+                const __m256i mask = _mm256_setr_epi64x(-1, NT==0 || NT>1 ? -1 : 0,
+                                                        NT==0 || NT>2 ? -1 : 0, NT==0 ? -1 : 0);
+                __m256d acc[MR][NV];
+                for (int r=0; r<MR; ++r)
+                    for (int v=0; v<NV; ++v) acc[r][v] = _mm256_setzero_pd();
+                for (int k=0; k<N; ++k, a+=dimi, b+=ldb) {
+                    __m256d bk[NV];
+                    for (int v=0; v<NV; ++v)
+                        bk[v] = (NT && v==NV-1) ? _mm256_maskload_pd(b+4*v, mask) : _mm256_loadu_pd(b+4*v);
+                    for (int r=0; r<MR; ++r) {
+                        const __m256d ar = _mm256_broadcast_sd(a+r);
+                        for (int v=0; v<NV; ++v) acc[r][v] = _mm256_fmadd_pd(ar, bk[v], acc[r][v]);
+                    }
+                }
+                for (int r=0; r<MR; ++r) {
+                    for (int v=0; v<NV; ++v) {
+                        if (NT && v==NV-1) _mm256_maskstore_pd(c+r*N+4*v, mask, acc[r][v]);
+                        else _mm256_storeu_pd(c+r*N+4*v, acc[r][v]);
+                    }
+                }
+            }
+
+            template <int N>
+            __attribute__((target("avx2,fma")))
+            static void kernel(long dimi, double* c, const double* a, const double* b, long ldb) {
+                constexpr int NV = (N+3)/4;
+                constexpr int MR = NV<=2 ? 4 : (NV==3 ? 3 : (NV==4 ? 2 : 1)); // 16 registers
+                long i=0;
+                for (; i+MR<=dimi; i+=MR) block<N,MR>(dimi, c+i*N, a+i, b, ldb);
+                for (; i<dimi; ++i) block<N,1>(dimi, c+i*N, a+i, b, ldb);
+            }
+        };
+
+        /// AVX-512 kernels ... as for AVX2 with 8 doubles per vector
+        struct AVX512ISA {
+            template <int N, int MR>
+            __attribute__((always_inline, target("avx512f,avx2,fma"))) static inline
+            void block(long dimi, double* MADNESS_RESTRICT c, const double* MADNESS_RESTRICT a,
+                       const double* MADNESS_RESTRICT b, long ldb) {
+                constexpr int NV = (N+7)/8;
+                constexpr __mmask8 mask = (N%8) ? __mmask8((1u<<(N%8))-1) : __mmask8(0xff);
+                __m512d acc[MR][NV];
+                for (int r=0; r<MR; ++r)
+                    for (int v=0; v<NV; ++v) acc[r][v] = _mm512_setzero_pd();
+                for (int k=0; k<N; ++k, a+=dimi, b+=ldb) {
+                    __m512d bk[NV];
+                    for (int v=0; v<NV; ++v)
+                        bk[v] = (v==NV-1) ? _mm512_maskz_loadu_pd(mask, b+8*v) : _mm512_loadu_pd(b+8*v);
+                    for (int r=0; r<MR; ++r) {
+                        const __m512d ar = _mm512_set1_pd(a[r]);
+                        for (int v=0; v<NV; ++v) acc[r][v] = _mm512_fmadd_pd(ar, bk[v], acc[r][v]);
+                    }
+                }
+                for (int r=0; r<MR; ++r) {
+                    for (int v=0; v<NV; ++v) {
+                        if (v==NV-1) _mm512_mask_storeu_pd(c+r*N+8*v, mask, acc[r][v]);
+                        else _mm512_storeu_pd(c+r*N+8*v, acc[r][v]);
+                    }
+                }
+            }
+
+            template <int N>
+            __attribute__((target("avx512f,avx2,fma")))
+            static void kernel(long dimi, double* c, const double* a, const double* b, long ldb) {
+                constexpr int NV = (N+7)/8;
+                constexpr int MR = NV==1 ? 8 : (NV==2 ? 6 : 4); // 32 registers
+                long i=0;
+                for (; i+MR<=dimi; i+=MR) block<N,MR>(dimi, c+i*N, a+i, b, ldb);
+                for (; i<dimi; ++i) block<N,1>(dimi, c+i*N, a+i, b, ldb);
+            }
+        };
+#endif
+
+        typedef std::array<detail::mtxmq_kernelT, mtxmq_max_fixed_dim> tableT;
+
+        /// table[n-1] is the kernel for dimj=dimk=n
+        template <typename isaT, std::size_t... I>
+        tableT make_table(std::index_sequence<I...>) {
+            return tableT{{ &isaT::template kernel<int(I)+1>... }};
+        }
+
+        template <typename isaT>
+        const tableT* table() {
+            static const tableT t = make_table<isaT>(std::make_index_sequence<mtxmq_max_fixed_dim>());
+            return &t;
+        }
+
+        MtxmqBackend fastest_backend() {
+            if (mtxmq_backend_available(MtxmqBackend::AVX512)) return MtxmqBackend::AVX512;
+            if (mtxmq_backend_available(MtxmqBackend::AVX2)) return MtxmqBackend::AVX2;
+            return MtxmqBackend::Generic;
+        }
+
+        MtxmqBackend default_backend() {
+            const char* env = getenv("MAD_MTXMQ_BACKEND");
+            if (env) {
+                for (MtxmqBackend b : {MtxmqBackend::BLAS, MtxmqBackend::Generic,
+                                MtxmqBackend::AVX2, MtxmqBackend::AVX512}) {
+                    if (strcmp(env, mtxmq_backend_name(b)) == 0 && mtxmq_backend_available(b)) return b;
+                }
+            }
+            return fastest_backend();
+        }
+
+        struct BackendState {
+            MtxmqBackend backend;
+            const tableT* kernels; ///< null if BLAS
+        };
+
+        const tableT* kernels_of(MtxmqBackend backend) {
+            switch (backend) {
+              case MtxmqBackend::Generic:
+                return table<GenericISA>();
+#ifdef MADNESS_MTXMQ_X86_KERNELS
+              case MtxmqBackend::AVX2:
+                return table<AVX2ISA>();
+              case MtxmqBackend::AVX512:
+                return table<AVX512ISA>();
+#endif
+              default:
+                return nullptr;
+            }
+        }
+
+        BackendState& state() {
+            static BackendState s = [] {
+                BackendState s;
+                s.backend = default_backend();
+                s.kernels = kernels_of(s.backend);
+                return s;
+            }();
+            return s;
+        }
+    }
+
+    bool mtxmq_backend_available(MtxmqBackend backend) {
+        switch (backend) {
+          case MtxmqBackend::BLAS:
+          case MtxmqBackend::Generic:
+            return true;
+#ifdef MADNESS_MTXMQ_X86_KERNELS
+          case MtxmqBackend::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+          case MtxmqBackend::AVX512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")
+                && __builtin_cpu_supports("fma");
+#endif
+          default:
+            return false;
+        }
+    }
+
+    void set_mtxmq_backend(MtxmqBackend backend) {
+        if (!mtxmq_backend_available(backend))
+            MADNESS_EXCEPTION("set_mtxmq_backend: backend not available", int(backend));
+        BackendState& s = state();
+        s.backend = backend;
+        s.kernels = kernels_of(backend);
+    }
+
+    MtxmqBackend get_mtxmq_backend() {
+        return state().backend;
+    }
+
+    const char* mtxmq_backend_name(MtxmqBackend backend) {
+        switch (backend) {
+          case MtxmqBackend::BLAS: return "blas";
+          case MtxmqBackend::Generic: return "generic";
+          case MtxmqBackend::AVX2: return "avx2";
+          case MtxmqBackend::AVX512: return "avx512";
+        }
+        return "unknown";
+    }
+
+    namespace detail {
+
+        mtxmq_kernelT mtxmq_fixed_kernel(long n) {
+            const tableT* kernels = state().kernels;
+            if (!kernels || n < 1 || n > mtxmq_max_fixed_dim) return nullptr;
+            return (*kernels)[n-1];
+        }
+
+    }
+}
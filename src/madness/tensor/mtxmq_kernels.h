@@ -0,0 +1,85 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_TENSOR_MTXMQ_KERNELS_H__INCLUDED
+#define MADNESS_TENSOR_MTXMQ_KERNELS_H__INCLUDED
+
+/// \file tensor/mtxmq_kernels.h
+/// \brief Selection of the small-matrix kernels used by mTxmq
+
+namespace madness {
+
+    /// Implementations of \c mTxmq for small, fixed shapes
+
+    /// The MRA transforms multiply a (k^(d-1)*k) matrix by a (k,k) matrix
+    /// with k (or 2k) between 6 and 30.  Generic BLAS spends much of its
+    /// time in call overhead for such shapes, so for \c double and
+    /// \c dimj==dimk<=mtxmq_max_fixed_dim \c mTxmq dispatches to kernels that
+    /// are specialized for each dimension at compile time and built for
+    /// several instruction sets.
+    /// - \c BLAS : never use the fixed-shape kernels
+    /// - \c Generic : kernels compiled for the baseline instruction set
+    /// - \c AVX2 : kernels compiled with AVX2 and FMA (x86-64 only)
+    /// - \c AVX512 : kernels compiled with AVX-512F (x86-64 only)
+    enum class MtxmqBackend { BLAS, Generic, AVX2, AVX512 };
+
+    /// Largest dimj==dimk handled by the fixed-shape kernels
+    static const long mtxmq_max_fixed_dim = 32;
+
+    /// True if the backend was compiled in and is supported by this cpu
+    bool mtxmq_backend_available(MtxmqBackend backend);
+
+    /// Select the backend used by mTxmq
+
+    /// The default is the fastest available backend, unless overridden with the
+    /// environment variable \c MAD_MTXMQ_BACKEND (\c blas, \c generic, \c avx2 or
+    /// \c avx512).  Throws if the backend is not available.  Not thread safe,
+    /// call before tasks are running.
+    void set_mtxmq_backend(MtxmqBackend backend);
+
+    /// The backend presently used by mTxmq
+    MtxmqBackend get_mtxmq_backend();
+
+    /// Name of the backend, for printing
+    const char* mtxmq_backend_name(MtxmqBackend backend);
+
+    namespace detail {
+
+        /// A fixed-shape kernel for c(i,j) = sum(k) a(k,i)*b(k*ldb+j) with dimj=dimk
+        typedef void (*mtxmq_kernelT)(long dimi, double* c, const double* a, const double* b, long ldb);
+
+        /// The kernel of the selected backend for dimj=dimk=n, or null if there is none
+        mtxmq_kernelT mtxmq_fixed_kernel(long n);
+
+    }
+}
+
+#endif // MADNESS_TENSOR_MTXMQ_KERNELS_H__INCLUDED
@@ -36,6 +36,8 @@
 #define MADNESS_TENSOR_MXM_H__INCLUDED
 
 #include <madness/madness_config.h>
+#include <madness/tensor/mtxmq_kernels.h>
+#include <type_traits>
 
 #define HAVE_FAST_BLAS
 #ifdef  HAVE_FAST_BLAS
@@ -181,6 +183,26 @@ namespace madness {
     }
     
 
+    /// Dispatch \c C=AT*B to a fixed-shape kernel if there is one for this shape
+
+    /// Only real double matrices with \c dimj==dimk are handled, see MtxmqBackend
+    /// \return true if the product was computed
+    template <typename aT, typename bT, typename cT>
+    inline bool mtxmq_fixed(long dimi, long dimj, long dimk,
+                            cT* MADNESS_RESTRICT c, const aT* a, const bT* b, long ldb) {
+        if constexpr (std::is_same<aT,double>::value && std::is_same<bT,double>::value
+                      && std::is_same<cT,double>::value) {
+            if (dimj == dimk && dimj <= mtxmq_max_fixed_dim) {
+                detail::mtxmq_kernelT kernel = detail::mtxmq_fixed_kernel(dimj);
+                if (kernel) {
+                    kernel(dimi, c, a, b, ldb);
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
 #if defined(HAVE_FAST_BLAS) && !defined(HAVE_INTEL_MKL)
     // MKL provides support for mixed real/complex operations but most other libraries do not
     
@@ -258,6 +280,7 @@ namespace madness {
         if (dimk==0) {
             for (long i=0; i<dimi*dimj; i++) c[i] = 0.0;
         }
+        if (mtxmq_fixed(dimi, dimj, dimk, c, a, b, ldb)) return;
         
         const T one = 1.0;  // alpha in *gemm
         const T zero = 0.0; // beta  in *gemm
@@ -340,6 +363,7 @@ namespace madness {
         if (dimk==0) {
             for (long i=0; i<dimi*dimj; i++) c[i] = 0.0;
         }
+        if (mtxmq_fixed(dimi, dimj, dimk, c, a, b, ldb)) return;
         
         const cT one = 1.0;  // alpha in *gemm
         const cT zero = 0.0; // beta  in *gemm
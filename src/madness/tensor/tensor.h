@@ -58,6 +58,7 @@
 #include <madness/tensor/basetensor.h>
 #include <madness/tensor/aligned.h>
 #include <madness/tensor/mxm.h>
+#include <madness/tensor/tensor_pool.h>
 #include <madness/tensor/tensorexcept.h>
 #include <madness/tensor/tensoriter.h>
 
@@ -359,8 +360,15 @@ namespace madness {
                     _p = new T[_size];
                     _shptr = std::shared_ptr<T>(_p);
 #else
-                    if (posix_memalign((void **) &_p, TENSOR_ALIGNMENT, sizeof(T)*_size)) throw 1;
-                    _shptr.reset(_p, &free);
+                    static_assert(TENSOR_ALIGNMENT <= TensorPool::alignment, "TensorPool alignment is too small");
+                    if (TensorPool::enabled()) {
+                        _p = static_cast<T*>(TensorPool::allocate(sizeof(T)*_size));
+                        _shptr.reset(_p, &TensorPool::deallocate, TensorPoolAllocator<T>());
+                    }
+                    else {
+                        if (posix_memalign((void **) &_p, TENSOR_ALIGNMENT, sizeof(T)*_size)) throw 1;
+                        _shptr.reset(_p, &free);
+                    }
 #endif
                 }
                 catch (...) {
@@ -534,6 +542,21 @@ MADNESS_PRAGMA_GCC(diagnostic pop)
             allocate(d.size(), d.size() ? &(d[0]) : 0, dozero);
         }
 
+#ifndef TENSOR_USE_SHARED_ALIGNED_ARRAY
+        /// Makes a tensor referencing the memory \c p kept alive by \c owner, without copying
+
+        /// The memory must be contiguous and aligned as that of an allocated
+        /// tensor.  \c owner is released with the last tensor referencing \c p.
+        /// @param[in] d        the dimensions
+        /// @param[in] p        the data
+        /// @param[in] owner    keeps \c p alive, e.g. a memory-mapped file
+        Tensor(const std::vector<long>& d, T* p, const std::shared_ptr<void>& owner) : _p(p), _shptr(owner, p) {
+            _id = TensorTypeData<T>::id;
+            TENSOR_ASSERT(d.size()>0 && d.size() <= TENSOR_MAXDIM,"invalid ndim in new tensor", d.size(), 0);
+            set_dims_and_size(d.size(), d.data());
+        }
+#endif
+
         /// Politically incorrect general constructor.
 
         /// @param[in] nd Number of dimensions
@@ -0,0 +1,299 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file tensor/tensor_pool.cc
+/// \brief Per-thread pool of memory for the data of tensors
+
+#include <madness/tensor/tensor_pool.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace madness {
+
+    namespace {
+
+        struct ThreadCache;
+
+        /// Precedes each block ... padded to the alignment so the data stays aligned
+        struct alignas(TensorPool::alignment) BlockHeader {
+            ThreadCache* owner;     ///< null if the block is not pooled
+            int cls;                ///< size class
+            BlockHeader* next;      ///< link in a free list
+        };
+
+        /// Four classes per power of two from 64 bytes to 32 MB
+        const int min_log2 = 6;
+        const int max_log2 = 25;
+        const int nclass = (max_log2 - min_log2)*4 + 1;
+
+        std::size_t class_size(int c) {
+            const int j = min_log2 + c/4;
+            return (std::size_t(1)<<j) + (c%4)*(std::size_t(1)<<(j-2));
+        }
+
+        /// The smallest class with class_size(c) >= nbytes, for nbytes <= class_size(nclass-1)
+        int class_of(std::size_t nbytes) {
+            if (nbytes <= class_size(0)) return 0;
+            int j = 63 - __builtin_clzll((unsigned long long)(nbytes-1)); // 2^j < nbytes <= 2^(j+1)
+            const std::size_t quarter = std::size_t(1)<<(j-2);
+            int sub = int((nbytes - (std::size_t(1)<<j) + quarter - 1)/quarter);
+            if (sub == 4) {++j; sub = 0;}
+            return (j-min_log2)*4 + sub;
+        }
+
+        /// Increment a counter that only its owning thread writes
+        void bump(std::atomic<std::uint64_t>& counter, std::uint64_t n=1) {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        /// The free lists and statistics of one thread
+        struct ThreadCache {
+            BlockHeader* free[nclass];                  ///< only touched by the owner
+            std::atomic<BlockHeader*> remote{nullptr};  ///< blocks freed by other threads
+            std::atomic<std::size_t> nbytes_remote{0};  ///< bytes in remote, counted against the cap
+            std::atomic<bool> orphaned{false};          ///< the owning thread has exited
+            std::atomic<std::uint64_t> nalloc{0}, nreuse{0}, nsystem{0}, nfree_remote{0},
+                nrelease{0}, nrelease_remote{0}, nbytes_cached{0};
+
+            ThreadCache() {
+                for (int c=0; c<nclass; ++c) free[c] = nullptr;
+            }
+
+            /// Keep the block if within the cap, otherwise return it to the system
+            void put(BlockHeader* h, std::size_t max_cached) {
+                const std::size_t size = class_size(h->cls);
+                if (nbytes_cached.load(std::memory_order_relaxed) + size > max_cached) {
+                    std::free(h);
+                    bump(nrelease);
+                }
+                else {
+                    h->next = free[h->cls];
+                    free[h->cls] = h;
+                    bump(nbytes_cached, size);
+                }
+            }
+
+            /// Move the blocks freed by other threads to the free lists
+            void drain(std::size_t max_cached) {
+                BlockHeader* h = remote.exchange(nullptr, std::memory_order_acquire);
+                while (h) {
+                    BlockHeader* next = h->next;
+                    nbytes_remote.fetch_sub(class_size(h->cls), std::memory_order_relaxed);
+                    put(h, max_cached);
+                    h = next;
+                }
+            }
+
+            /// Free a block on behalf of another thread
+
+            /// The block is returned to the system if the owner's free and
+            /// remote lists together would exceed the cap.
+            void push_remote(BlockHeader* h, std::size_t max_cached) {
+                nfree_remote.fetch_add(1, std::memory_order_relaxed);
+                const std::size_t size = class_size(h->cls);
+                if (nbytes_remote.fetch_add(size, std::memory_order_relaxed) + size
+                    + nbytes_cached.load(std::memory_order_relaxed) > max_cached) {
+                    nbytes_remote.fetch_sub(size, std::memory_order_relaxed);
+                    std::free(h);
+                    nrelease_remote.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                BlockHeader* head = remote.load(std::memory_order_relaxed);
+                do {
+                    h->next = head;
+                } while (!remote.compare_exchange_weak(head, h, std::memory_order_release,
+                                                       std::memory_order_relaxed));
+            }
+        };
+
+        /// All caches ever made ... never freed, since blocks may outlive their thread
+        struct Registry {
+            std::mutex mutex;
+            std::vector<ThreadCache*> all;
+            std::vector<ThreadCache*> orphans;  ///< caches of exited threads, to be adopted
+        };
+
+        Registry& registry() {
+            static Registry* r = new Registry;
+            return *r;
+        }
+
+        thread_local ThreadCache* tcache = nullptr;  ///< trivially destructible so usable during thread exit
+        thread_local bool thread_exited = false;
+
+        /// Hands the cache of the thread over to the registry when the thread exits
+        struct CacheHandle {
+            ~CacheHandle() {
+                ThreadCache* cache = tcache;
+                tcache = nullptr;
+                thread_exited = true;
+                if (!cache) return;
+                cache->orphaned.store(true, std::memory_order_release);
+                Registry& r = registry();
+                std::lock_guard<std::mutex> lock(r.mutex);
+                r.orphans.push_back(cache);
+            }
+        };
+        thread_local CacheHandle handle;
+
+        /// The cache of this thread, null while the thread is exiting
+        ThreadCache* get_cache() {
+            if (tcache) return tcache;
+            if (thread_exited) return nullptr;
+            (void) &handle; // make sure the destructor runs at thread exit
+            Registry& r = registry();
+            ThreadCache* cache;
+            {
+                std::lock_guard<std::mutex> lock(r.mutex);
+                if (r.orphans.empty()) {
+                    cache = new ThreadCache;
+                    r.all.push_back(cache);
+                }
+                else {
+                    cache = r.orphans.back();
+                    r.orphans.pop_back();
+                }
+            }
+            cache->orphaned.store(false, std::memory_order_release);
+            tcache = cache;
+            return cache;
+        }
+
+        BlockHeader* system_block(std::size_t nbytes) {
+            void* p = nullptr;
+            if (posix_memalign(&p, TensorPool::alignment, sizeof(BlockHeader) + nbytes)) throw std::bad_alloc();
+            return static_cast<BlockHeader*>(p);
+        }
+
+        bool init_enabled() {
+            const char* env = getenv("MAD_TENSOR_POOL");
+            return !(env && strcmp(env, "0") == 0);
+        }
+
+        std::size_t init_max_cached() {
+            const char* env = getenv("MAD_TENSOR_POOL_MB");
+            return (env ? std::size_t(atol(env)) : std::size_t(64)) << 20;
+        }
+
+        std::atomic<std::size_t> max_cached{init_max_cached()};
+    }
+
+    std::atomic<bool> TensorPool::is_enabled{init_enabled()};
+
+    void* TensorPool::allocate(std::size_t nbytes) {
+        ThreadCache* cache = (enabled() && nbytes <= class_size(nclass-1)) ? get_cache() : nullptr;
+        if (!cache) {
+            BlockHeader* h = system_block(nbytes);
+            h->owner = nullptr;
+            return h+1;
+        }
+
+        bump(cache->nalloc);
+        const int c = class_of(nbytes);
+        const std::size_t cap = max_cached.load(std::memory_order_relaxed);
+        if (!cache->free[c] && cache->remote.load(std::memory_order_relaxed)) cache->drain(cap);
+        BlockHeader* h = cache->free[c];
+        if (h) {
+            cache->free[c] = h->next;
+            bump(cache->nreuse);
+            cache->nbytes_cached.store(cache->nbytes_cached.load(std::memory_order_relaxed) - class_size(c),
+                                       std::memory_order_relaxed);
+        }
+        else {
+            h = system_block(class_size(c));
+            h->owner = cache;
+            h->cls = c;
+            bump(cache->nsystem);
+        }
+        return h+1;
+    }
+
+    void TensorPool::deallocate(void* p) {
+        if (!p) return;
+        BlockHeader* h = static_cast<BlockHeader*>(p) - 1;
+        ThreadCache* owner = h->owner;
+        if (!owner) {
+            std::free(h);
+        }
+        else if (owner == tcache) {
+            owner->put(h, max_cached.load(std::memory_order_relaxed));
+        }
+        else if (owner->orphaned.load(std::memory_order_acquire)) {
+            std::free(h);  // nobody may be taking blocks from its lists
+        }
+        else {
+            owner->push_remote(h, max_cached.load(std::memory_order_relaxed));
+        }
+    }
+
+    void TensorPool::set_enabled(bool value) {
+        is_enabled.store(value, std::memory_order_relaxed);
+    }
+
+    void TensorPool::set_max_cached(std::size_t nbytes) {
+        max_cached = nbytes;
+    }
+
+    std::size_t TensorPool::get_max_cached() {
+        return max_cached;
+    }
+
+    TensorPool::Stats TensorPool::get_stats() {
+        Stats s;
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const ThreadCache* cache : r.all) {
+            s.nalloc += cache->nalloc.load(std::memory_order_relaxed);
+            s.nreuse += cache->nreuse.load(std::memory_order_relaxed);
+            s.nsystem += cache->nsystem.load(std::memory_order_relaxed);
+            s.nfree_remote += cache->nfree_remote.load(std::memory_order_relaxed);
+            s.nrelease += cache->nrelease.load(std::memory_order_relaxed)
+                + cache->nrelease_remote.load(std::memory_order_relaxed);
+            s.nbytes_cached += cache->nbytes_cached.load(std::memory_order_relaxed)
+                + cache->nbytes_remote.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    void TensorPool::print_stats(const char* msg) {
+        const Stats s = get_stats();
+        std::printf("%s: enabled=%d alloc=%llu reuse=%llu system=%llu remote-free=%llu release=%llu cached=%.1fMB\n",
+                    msg, int(enabled()), (unsigned long long) s.nalloc, (unsigned long long) s.nreuse,
+                    (unsigned long long) s.nsystem, (unsigned long long) s.nfree_remote,
+                    (unsigned long long) s.nrelease, s.nbytes_cached/1048576.0);
+    }
+}
@@ -0,0 +1,127 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_TENSOR_TENSOR_POOL_H__INCLUDED
+#define MADNESS_TENSOR_TENSOR_POOL_H__INCLUDED
+
+/// \file tensor/tensor_pool.h
+/// \brief Per-thread pool of memory for the data of tensors
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace madness {
+
+    /// Per-thread size-class pool for the data of tensors
+
+    /// The MRA kernels create and destroy very many temporary tensors of a few
+    /// sizes (k^d, (2k)^d, ...).  With the pool enabled their memory is taken
+    /// from and returned to free lists private to each thread, so that the
+    /// steady state does no calls to malloc or the kernel (large blocks are
+    /// otherwise mmapped and unmapped by malloc, page faulting on each use).
+    ///
+    /// Sizes are rounded up to one of four classes per power of two, so at
+    /// most 25% is wasted.  A block freed by the thread that allocated it goes
+    /// straight to that thread's free list.  A block freed by another thread
+    /// is pushed onto a lock-free list of the owner, which takes it back on
+    /// its next allocation.  Each thread caches at most get_max_cached()
+    /// bytes, counting the blocks freed to it by other threads, above that
+    /// blocks are returned to the system, as are blocks larger than the
+    /// largest class.  The caches of exiting threads are
+    /// adopted by new threads.
+    ///
+    /// The pool is enabled by default and can be disabled with the
+    /// environment variable \c MAD_TENSOR_POOL=0 or set_enabled().  The cap
+    /// on the bytes cached per thread may be set with
+    /// \c MAD_TENSOR_POOL_MB.
+    class TensorPool {
+    public:
+        /// Alignment of the memory returned by allocate()
+        static const std::size_t alignment = 64;
+
+        /// Statistics of the pool, summed over threads
+        struct Stats {
+            std::uint64_t nalloc = 0;       ///< calls to allocate()
+            std::uint64_t nreuse = 0;       ///< allocations served from a free list
+            std::uint64_t nsystem = 0;      ///< allocations from the system
+            std::uint64_t nfree_remote = 0; ///< blocks freed by a thread other than the owner
+            std::uint64_t nrelease = 0;     ///< blocks returned to the system
+            std::uint64_t nbytes_cached = 0;///< bytes presently held in free lists
+        };
+
+        /// Memory for \c nbytes bytes aligned to \c alignment ... throws std::bad_alloc on failure
+        static void* allocate(std::size_t nbytes);
+
+        /// Return memory obtained from allocate() ... may be called by any thread
+        static void deallocate(void* p);
+
+        /// Enable or disable the pool for subsequent allocations
+
+        /// Memory allocated while the pool was enabled may be freed at any time.
+        static void set_enabled(bool value);
+
+        /// True if allocations are taken from the pool
+        static bool enabled() {return is_enabled.load(std::memory_order_relaxed);}
+
+        /// Set the maximum number of bytes cached by each thread
+        static void set_max_cached(std::size_t nbytes);
+
+        /// The maximum number of bytes cached by each thread
+        static std::size_t get_max_cached();
+
+        /// Statistics summed over all threads
+        static Stats get_stats();
+
+        /// Print the statistics
+        static void print_stats(const char* msg = "tensor pool");
+
+    private:
+        static std::atomic<bool> is_enabled;
+    };
+
+    /// Standard allocator on top of TensorPool, used for the control blocks of the shared pointers of tensors
+    template <typename T>
+    struct TensorPoolAllocator {
+        typedef T value_type;
+
+        TensorPoolAllocator() = default;
+        template <typename U> TensorPoolAllocator(const TensorPoolAllocator<U>&) {}
+
+        T* allocate(std::size_t n) {return static_cast<T*>(TensorPool::allocate(n*sizeof(T)));}
+        void deallocate(T* p, std::size_t) {TensorPool::deallocate(p);}
+
+        template <typename U> bool operator==(const TensorPoolAllocator<U>&) const {return true;}
+        template <typename U> bool operator!=(const TensorPoolAllocator<U>&) const {return false;}
+    };
+}
+
+#endif // MADNESS_TENSOR_TENSOR_POOL_H__INCLUDED
@@ -46,6 +46,7 @@ bool smalltest = false;
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <vector>
 //#include <xmmintrin.h>
 
 #include <madness/world/safempi.h>
@@ -53,6 +54,7 @@ bool smalltest = false;
 #include <madness/tensor/cblas.h>
 #include <madness/tensor/tensor.h>
 #include <madness/tensor/mxm.h>
+#include <madness/tensor/mtxmq_kernels.h>
 
 using namespace madness;
 
@@ -165,6 +167,58 @@ void trantimer(const char* s, long ni, long nj, long nk, double *a, double *b, d
   printf("%20s %3ld %3ld %3ld %8.2f %8.2f\n",s, ni,nj,nk, fastest, fastest_dgemm);
 }
 
+/// check mTxmq against the reference mTxm, return false on error
+bool check_mtxmq(long nimax, long njmax, long nkmax, double *a, double *b, double *c, double *d) {
+    long ni, nj, nk, i;
+    for (ni=1; ni<std::min(60L,nimax); ni+=1) {
+        for (nj=1; nj<std::min(60L,njmax); nj+=1) {
+            for (nk=1; nk<std::min(60L,nkmax); nk+=1) {
+                for (i=0; i<ni*nj; ++i) d[i] = c[i] = 0.0;
+                mTxm (ni,nj,nk,c,a,b);
+                mTxmq(ni,nj,nk,d,a,b);
+                for (i=0; i<ni*nj; ++i) {
+                    double err = std::abs(d[i]-c[i]);
+                    /* This test is sensitive to the compilation options.
+                       Be sure to have the reference code above compiled
+                       -msse2 -fpmath=sse if using GCC.  Otherwise, to
+                       pass the test you may need to change the threshold
+                       to circa 1e-13.
+                    */
+                    if (err > 1e-13) {
+                        printf("test_mtxmq: error %ld %ld %ld %e\n",ni,nj,nk,err);
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/// check the fixed-shape case dimj==dimk with ldb>dimj (low rank transformations)
+bool check_mtxmq_ldb(long nimax) {
+    // own buffers ... the shared ones are too small for the padded b in the small test
+    nimax = std::min(400L,nimax);
+    const long nmax = mtxmq_max_fixed_dim;
+    std::vector<double> a(nimax*nmax), b(nmax*(nmax+3)), c(nimax*nmax), d(nimax*nmax);
+    ran_fill(a.size(), a.data());
+    ran_fill(b.size(), b.data());
+    for (long ni=1; ni<nimax; ni+=13) {
+        for (long n=1; n<=nmax; ++n) {
+            const long ldb=n+3;
+            mTxmq_reference(ni,n,n,c.data(),a.data(),b.data(),ldb);
+            mTxmq(ni,n,n,d.data(),a.data(),b.data(),ldb);
+            for (long i=0; i<ni*n; ++i) {
+                if (std::abs(d[i]-c[i]) > 1e-13) {
+                    printf("test_mtxmq: ldb error %ld %ld %ld %e\n",ni,n,ldb,std::abs(d[i]-c[i]));
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 int main(int argc, char * argv[]) {
 
     if (getenv("MAD_SMALL_TESTS")) smalltest=true;
@@ -174,7 +228,7 @@ int main(int argc, char * argv[]) {
     const long nimax=!smalltest ? 30*30 : 8*8;
     const long njmax=!smalltest ? 100 : 20;
     const long nkmax=!smalltest ? 100 : 20;
-    long ni, nj, nk, i, m;
+    long ni, m;
     double *a, *b, *c, *d;
 
     SafeMPI::Init_thread(argc, argv, MPI_THREAD_SINGLE);
@@ -200,30 +254,32 @@ int main(int argc, char * argv[]) {
 /*     } */
 /*     return 0; */
 
-    printf("Starting to test ... \n");
-    for (ni=1; ni<std::min(60L,nimax); ni+=1) {
-        for (nj=1; nj<std::min(60L,njmax); nj+=1) {
-            for (nk=1; nk<std::min(60L,nkmax); nk+=1) {
-                for (i=0; i<ni*nj; ++i) d[i] = c[i] = 0.0;
-                mTxm (ni,nj,nk,c,a,b);
-                mTxmq(ni,nj,nk,d,a,b);
-                for (i=0; i<ni*nj; ++i) {
-                    double err = std::abs(d[i]-c[i]);
-                    /* This test is sensitive to the compilation options.
-                       Be sure to have the reference code above compiled
-                       -msse2 -fpmath=sse if using GCC.  Otherwise, to
-                       pass the test you may need to change the threshold
-                       to circa 1e-13.
-                    */
-                    if (err > 1e-13) {
-                        printf("test_mtxmq: error %ld %ld %ld %e\n",ni,nj,nk,err);
-                        exit(1);
-                    }
-                }
-            }
+    const MtxmqBackend default_backend = get_mtxmq_backend();
+    const MtxmqBackend backends[] = {MtxmqBackend::BLAS, MtxmqBackend::Generic,
+                                     MtxmqBackend::AVX2, MtxmqBackend::AVX512};
+    for (MtxmqBackend backend : backends) {
+        if (!mtxmq_backend_available(backend)) {
+            printf("Backend %s not available\n", mtxmq_backend_name(backend));
+            continue;
+        }
+        set_mtxmq_backend(backend);
+        printf("Starting to test backend %s ... \n", mtxmq_backend_name(backend));
+        if (!check_mtxmq(nimax, njmax, nkmax, a, b, c, d)) exit(1);
+        if (!check_mtxmq_ldb(nimax)) exit(1);
+        printf("... OK!\n");
+    }
+
+    if (!smalltest) {
+        printf("%20s %3s %3s %3s %8s (GF/s) for each backend\n", "type", "M", "N", "K", "LOOP");
+        for (MtxmqBackend backend : backends) {
+            if (!mtxmq_backend_available(backend)) continue;
+            set_mtxmq_backend(backend);
+            printf("backend %s\n", mtxmq_backend_name(backend));
+            for (m=4; m<=24; m+=2) timer("(m*m,m)T*(m*m)", m*m,m,m,a,b,c);
         }
     }
-    printf("... OK!\n");
+    set_mtxmq_backend(default_backend);
+    printf("Default backend %s\n", mtxmq_backend_name(default_backend));
 
     if (!smalltest) {
         printf("%20s %3s %3s %3s %8s %8s (GF/s)\n", "type", "M", "N", "K", "LOOP", "BLAS");
@@ -0,0 +1,159 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+/// \file tensor/test_tensor_pool.cc
+/// \brief Tests and timing of the per-thread pool for the data of tensors
+
+#include <madness/tensor/tensor.h>
+#include <madness/tensor/tensor_pool.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace madness;
+
+bool smalltest = false;
+
+/// Blocks are aligned, writable to their full size and reused after being freed
+int test_sizes() {
+    int nerr = 0;
+    for (std::size_t nbytes : {1ul, 8ul, 64ul, 65ul, 100ul, 1000ul, 8000ul, 216000ul*8, 40000000ul}) {
+        char* p = static_cast<char*>(TensorPool::allocate(nbytes));
+        if (reinterpret_cast<std::uintptr_t>(p) % TensorPool::alignment) nerr++;
+        memset(p, 1, nbytes);
+        TensorPool::deallocate(p);
+        char* q = static_cast<char*>(TensorPool::allocate(nbytes));
+        if (nbytes <= 32*1024*1024 && q != p) nerr++; // largest class is 32 MB
+        TensorPool::deallocate(q);
+    }
+    if (nerr) std::printf("test_sizes: %d errors\n", nerr);
+    return nerr;
+}
+
+/// Tensors made by one thread and freed by another return to the owner
+int test_threads() {
+    int nerr = 0;
+    const TensorPool::Stats s0 = TensorPool::get_stats();
+    std::vector< Tensor<double> > v;
+    for (int i=0; i<100; ++i) v.push_back(Tensor<double>(10,10,10));
+    std::thread t([&v] {v.clear();});
+    t.join();
+    const TensorPool::Stats s1 = TensorPool::get_stats();
+    if (s1.nfree_remote - s0.nfree_remote < 100) nerr++;
+
+    // taken back on the next allocations of the owner
+    for (int i=0; i<100; ++i) v.push_back(Tensor<double>(10,10,10));
+    const TensorPool::Stats s2 = TensorPool::get_stats();
+    if (s2.nsystem != s1.nsystem) nerr++;
+    v.clear();
+
+    // the cache of an exited thread is adopted by the next one
+    std::thread t1([] {Tensor<double> a(20,20,20); Tensor<double> b(20,20,20);});
+    t1.join();
+    const TensorPool::Stats s3 = TensorPool::get_stats();
+    std::thread t2([] {Tensor<double> a(20,20,20); Tensor<double> b(20,20,20);});
+    t2.join();
+    const TensorPool::Stats s4 = TensorPool::get_stats();
+    if (s4.nsystem != s3.nsystem) nerr++;
+
+    if (nerr) std::printf("test_threads: %d errors\n", nerr);
+    return nerr;
+}
+
+/// Blocks freed by another thread count against the cap of the owner
+int test_remote_cap() {
+    int nerr = 0;
+    const std::size_t cap = TensorPool::get_max_cached();
+    TensorPool::set_max_cached(16*8192);
+    std::vector<void*> v;
+    for (int i=0; i<100; ++i) v.push_back(TensorPool::allocate(8000));
+    const TensorPool::Stats s0 = TensorPool::get_stats();
+    std::thread t([&v] {for (void* p : v) TensorPool::deallocate(p);});
+    t.join();
+    const TensorPool::Stats s1 = TensorPool::get_stats();
+    if (s1.nrelease - s0.nrelease < 100-16) nerr++;
+    TensorPool::set_max_cached(cap);
+
+    if (nerr) std::printf("test_remote_cap: %d errors\n", nerr);
+    return nerr;
+}
+
+long minor_faults() {
+    struct rusage u;
+    getrusage(RUSAGE_SELF, &u);
+    return u.ru_minflt;
+}
+
+/// Time making and freeing the temporaries of a typical apply, with and without the pool
+void time_alloc(long k) {
+    const long twok = 2*k;
+    const int nloop = smalltest ? 2000 : 20000;
+    for (bool pool : {false, true}) {
+        TensorPool::set_enabled(pool);
+        const TensorPool::Stats s0 = TensorPool::get_stats();
+        const long f0 = minor_faults();
+        const auto t0 = std::chrono::steady_clock::now();
+        double sum = 0.0;
+        for (int i=0; i<nloop; ++i) {
+            Tensor<double> s(k,k,k);
+            Tensor<double> d(twok,twok,twok);
+            Tensor<double> w(twok,twok,twok);
+            d(0,0,0) = i;
+            sum += s(0,0,0) + d(0,0,0) + w(0,0,0);
+        }
+        const double used = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        const TensorPool::Stats s1 = TensorPool::get_stats();
+        std::printf("k=%2ld pool=%d  %7.2f us/iteration  system allocations %7llu  page faults %7ld  (%g)\n",
+                    k, int(pool), 1e6*used/nloop, (unsigned long long)(pool ? s1.nsystem - s0.nsystem : 6*nloop),
+                    minor_faults() - f0, sum);
+    }
+    TensorPool::set_enabled(true);
+}
+
+int main(int argc, char** argv) {
+    if (getenv("MAD_SMALL_TESTS")) smalltest=true;
+    for (int iarg=1; iarg<argc; iarg++) if (strcmp(argv[iarg],"--small")==0) smalltest=true;
+
+    TensorPool::set_enabled(true);
+    int nerr = test_sizes() + test_threads() + test_remote_cap();
+
+    for (long k : {6, 10, 16, 20}) time_alloc(k);
+    TensorPool::print_stats();
+
+    std::printf("%s\n", nerr ? "FAILED" : "OK");
+    return nerr;
+}
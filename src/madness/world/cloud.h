@@ -17,7 +17,11 @@
 
 #include <madness/world/parallel_dc_archive.h>
 #include<any>
+#include<cstdio>
 #include<iomanip>
+#include<list>
+#include<set>
+#include<unistd.h>
 
 
 /*!
@@ -101,6 +105,16 @@ struct Recordlist {
 /// will be generated. When loading the data from the world the record list will be used to
 /// deserialize all stored objects.
 ///
+/// By default the container is replicated to all processes before a MacroTaskQ
+/// runs its tasks.  With set_on_demand() the records stay distributed and rank 0
+/// of a subworld fetches a record when it is first loaded.  The deserialized
+/// objects are cached per process; with set_cache_budget() the least recently
+/// used ones are dropped once the records of the cached objects exceed the
+/// budget, and with set_spill_directory() fetched records are kept in a
+/// node-local file, so a dropped object is reloaded from disk rather than
+/// fetched again.  A function stored more than once (e.g. in several vectors)
+/// is stored once, its record is the id of its implementation.
+///
 /// Note that there must be a fence after the destruction of subworld containers, as in:
 ///
 ///  create subworlds
@@ -115,19 +129,34 @@ class Cloud {
     bool is_replicated=false;   ///< if contents of the container are replicated
     bool dofence = true;      ///< fences after load/store
     bool force_load_from_cache = false;       ///< forces load from cache (mainly for debugging)
+    bool on_demand = false;   ///< records are fetched when loaded instead of replicated
+    std::size_t cache_budget = 0;   ///< bytes of the records of cached objects, 0 for no limit
+    std::string spill_dir;    ///< directory of the file of fetched records, empty for none
 
 public:
 
     typedef std::any cached_objT;
     using keyT = madness::archive::ContainerRecordOutputArchive::keyT;
     using valueT = std::vector<unsigned char>;
-    typedef std::map<keyT, cached_objT> cacheT;
+
+    /// A deserialized object, the size of its record and its position in the LRU list
+    struct cache_entryT {
+        cached_objT obj;
+        std::size_t nbyte;
+        std::list<keyT>::iterator lru;
+    };
+    typedef std::map<keyT, cache_entryT> cacheT;
     typedef Recordlist<keyT> recordlistT;
 
 private:
     madness::WorldContainer<keyT, valueT> container;
-    cacheT cached_objects;
-    recordlistT local_list_of_container_keys;   // a world-local list of keys occupied in container
+    mutable cacheT cached_objects;
+    mutable std::list<keyT> lru;                // cached records, most recently used first
+    mutable std::size_t cache_nbyte = 0;        // bytes of the records of the cached objects
+    std::set<keyT> local_list_of_container_keys;   // a world-local list of keys occupied in container
+
+    mutable std::FILE* spill_file = nullptr;    // records fetched from other processes
+    mutable std::map<keyT, std::pair<long,std::size_t>> spill_index;   // offset and size in spill_file
 
 public:
 
@@ -136,6 +165,10 @@ public:
         cache_reads(0l), cache_stores(0l) {
     }
 
+    ~Cloud() {
+        if (spill_file) std::fclose(spill_file);
+    }
+
     void set_debug(bool value) {
         debug = value;
     }
@@ -148,6 +181,38 @@ public:
         force_load_from_cache = value;
     }
 
+    /// Fetch records when they are loaded instead of replicating the container
+    void set_on_demand(bool value) {
+        on_demand = value;
+    }
+
+    /// Limit the cached objects to those of records of at most nbyte bytes per process, 0 for no limit
+    void set_cache_budget(std::size_t nbyte) {
+        cache_budget = nbyte;
+    }
+
+    /// Keep records fetched from other processes in a file in dir, empty for none
+
+    /// The file is removed when it is closed.  Use a node-local directory.
+    void set_spill_directory(const std::string& dir) {
+        spill_dir = dir;
+    }
+
+    /// Bytes of the records of the objects cached by this process
+    std::size_t get_cache_nbyte() const {
+        return cache_nbyte;
+    }
+
+    /// Number of objects dropped from the cache of this process
+    long get_nevict() const {
+        return nevict;
+    }
+
+    /// Number of records this process read from its spill file
+    long get_nspill_read() const {
+        return nspill_read;
+    }
+
     void print_size(World& universe) {
 
         std::size_t memsize=0;
@@ -164,9 +229,18 @@ public:
         universe.gop.sum(global_size);
         double byte2gbyte=1.0/(1024*1024*1024);
 
+        std::size_t cachesize=cache_nbyte;
+        std::size_t max_cachesize=cache_nbyte;
+        universe.gop.sum(cachesize);
+        universe.gop.max(max_cachesize);
+        std::size_t spillsize=0;
+        for (const auto& s : spill_index) spillsize+=s.second.second;
+        universe.gop.sum(spillsize);
+
         if (universe.rank()==0) {
             print("Cloud memory:");
             print("  replicated:",is_replicated);
+            print("  on demand: ",on_demand);
             print("size of cloud (total)");
             print("  number of records:",global_size);
             print("  memory in GBytes: ",global_memsize*byte2gbyte);
@@ -175,6 +249,10 @@ public:
             print("  memory in GBytes: ",global_memsize*byte2gbyte/universe.size());
             print("min/max of node");
             print("  memory in GBytes: ",min_memsize*byte2gbyte,max_memsize*byte2gbyte);
+            print("records of cached objects");
+            print("  memory in GBytes (total/max of node):",cachesize*byte2gbyte,max_cachesize*byte2gbyte);
+            print("  budget in GBytes per node:           ",cache_budget*byte2gbyte);
+            print("  spilled to disk in GBytes (total):   ",spillsize*byte2gbyte);
         }
     }
 
@@ -189,6 +267,8 @@ public:
         long cstores = long(cache_stores);
         universe.gop.sum(creads);
         universe.gop.sum(cstores);
+        long counts[5] = {long(nfetch), long(nbyte_fetch), long(nevict), long(nspill_write), long(nspill_read)};
+        universe.gop.sum(counts, 5);
         if (universe.rank() == 0) {
             auto precision = std::cout.precision();
             std::cout << std::fixed << std::setprecision(1);
@@ -198,11 +278,19 @@ public:
             std::cout << std::setprecision(precision) << std::scientific;
             print("cloud cache stores    ", long(cstores));
             print("cloud cache loads     ", long(creads));
+            print("cloud records fetched ", counts[0], "bytes", counts[1]);
+            print("cloud cache evictions ", counts[2], "(all processes)");
+            print("cloud records spilled ", counts[3], "read back", counts[4]);
         }
     }
     void clear_cache(World &subworld) {
         cached_objects.clear();
-        local_list_of_container_keys.list.clear();
+        lru.clear();
+        cache_nbyte = 0;
+        local_list_of_container_keys.clear();
+        if (spill_file) std::fclose(spill_file);
+        spill_file = nullptr;
+        spill_index.clear();
         subworld.gop.fence();
     }
 
@@ -212,6 +300,11 @@ public:
         replication_time=0l;
         cache_stores=0l;
         cache_reads=0l;
+        nfetch=0l;
+        nbyte_fetch=0l;
+        nevict=0l;
+        nspill_write=0l;
+        nspill_read=0l;
     }
 
     template<typename T>
@@ -242,7 +335,9 @@ public:
         return recordlist;
     }
 
+    /// Copy all records to all processes, unless they are fetched on demand
     void replicate(const std::size_t chunk_size=INT_MAX) {
+        if (on_demand) return;
 
         World& world=container.get_world();
         cloudtimer t(world,replication_time);
@@ -306,6 +401,11 @@ private:
     mutable std::atomic<long> replication_time=0l;    // in ms
     mutable std::atomic<long> cache_reads=0l;
     mutable std::atomic<long> cache_stores=0l;
+    mutable std::atomic<long> nfetch=0l;        // records read from the container
+    mutable std::atomic<long> nbyte_fetch=0l;
+    mutable std::atomic<long> nevict=0l;
+    mutable std::atomic<long> nspill_write=0l;
+    mutable std::atomic<long> nspill_read=0l;
 
     template<typename> struct is_tuple : std::false_type { };
     template<typename ...T> struct is_tuple<std::tuple<T...>> : std::true_type { };
@@ -337,21 +437,79 @@ private:
     };
 
 
+    /// Caches obj, first dropping the least recently used objects beyond the budget
+
+    /// All processes of a subworld load the same records in the same order
+    /// with the same sizes, so they drop the same objects.
     template<typename T>
-    void cache(madness::World &world, const T &obj, const keyT &record) const {
-        const_cast<cacheT &>(cached_objects).insert({record,std::make_any<T>(obj)});
+    void cache(madness::World &world, const T &obj, const keyT &record, std::size_t nbyte) const {
+        while (cache_budget && !lru.empty() && cache_nbyte + nbyte > cache_budget) {
+            auto it = cached_objects.find(lru.back());
+            cache_nbyte -= it->second.nbyte;
+            cached_objects.erase(it);
+            lru.pop_back();
+            nevict++;
+        }
+        lru.push_front(record);
+        cached_objects.insert({record, cache_entryT{std::make_any<T>(obj), nbyte, lru.begin()}});
+        cache_nbyte += nbyte;
     }
 
     template<typename T>
     T load_from_cache(madness::World &world, const keyT &record) const {
         if (world.rank()==0) cache_reads++;
         if (debug) print("loading", typeid(T).name(), "from cache record", record, "to world", world.id());
-//        if (auto obj = std::get_if<T>(&cached_objects.find(record)->second)) return *obj;
-        if (auto obj = std::any_cast<T>(&cached_objects.find(record)->second)) return *obj;
+        cache_entryT& entry = cached_objects.find(record)->second;
+        lru.splice(lru.begin(), lru, entry.lru);
+        if (auto obj = std::any_cast<T>(&entry.obj)) return *obj;
         MADNESS_EXCEPTION("failed to load from cloud-cache", 1);
         return T();
     }
 
+    /// The bytes of a record, from the spill file, the local or a remote container ... rank 0 of a subworld
+    valueT fetch(const keyT &record) const {
+        valueT v;
+        auto s = spill_index.find(record);
+        if (s != spill_index.end()) {
+            v.resize(s->second.second);
+            if (std::fseek(spill_file, s->second.first, SEEK_SET) == 0 &&
+                std::fread(v.data(), 1, v.size(), spill_file) == v.size()) {
+                nspill_read++;
+                return v;
+            }
+            spill_index.erase(s);
+        }
+
+        auto it = container.find(record).get();
+        if (it == container.end()) MADNESS_EXCEPTION("record not found", record);
+        v = it->second;
+        nfetch++;
+        nbyte_fetch += v.size();
+        if (!spill_dir.empty() && !container.is_local(record)) spill(record, v);
+        return v;
+    }
+
+    /// Append a record to the spill file, opened (and unlinked) on first use
+    void spill(const keyT &record, const valueT &v) const {
+        if (!spill_file) {
+            std::string name = spill_dir + "/madness_cloud." + std::to_string(getpid()) + "."
+                + std::to_string(container.get_world().rank());
+            spill_file = std::fopen(name.c_str(), "w+b");
+            if (!spill_file) {
+                print("Cloud: cannot open spill file", name);
+                const_cast<std::string&>(spill_dir).clear();
+                return;
+            }
+            std::remove(name.c_str());
+        }
+        if (std::fseek(spill_file, 0, SEEK_END) != 0) return;
+        const long offset = std::ftell(spill_file);
+        if (offset >= 0 && std::fwrite(v.data(), 1, v.size(), spill_file) == v.size()) {
+            spill_index[record] = std::make_pair(offset, v.size());
+            nspill_write++;
+        }
+    }
+
     template<typename T>
     T load_internal(madness::World &world, recordlistT &recordlist) const {
         T result;
@@ -376,9 +534,7 @@ private:
     /// currently implemented with a local copy of the recordlist, might be
     /// reimplemented with container.find(), which would include blocking communication.
     bool is_in_container(const keyT &key) const {
-        auto it = std::find(local_list_of_container_keys.list.begin(),
-                            local_list_of_container_keys.list.end(), key);
-        return it!=local_list_of_container_keys.list.end();
+        return local_list_of_container_keys.count(key) == 1;
     }
 
     template<typename T>
@@ -403,7 +559,7 @@ private:
             madness::archive::ContainerRecordOutputArchive ar(world, container, record);
             madness::archive::ParallelOutputArchive<madness::archive::ContainerRecordOutputArchive> par(world, ar);
             par & source;
-            local_list_of_container_keys+=record;
+            local_list_of_container_keys.insert(record);
         }
         if (dofence) world.gop.fence();
         return recordlistT{record};
@@ -417,10 +573,14 @@ private:
         if (is_cached(record)) return load_from_cache<T>(world, record);
         if (debug) print("loading", typeid(T).name(), "from container record", record, "to world", world.id());
         T target = allocator<T>(world);
-        madness::archive::ContainerRecordInputArchive ar(world, container, record);
+        valueT v;
+        if (world.rank()==0) v = fetch(record);
+        std::size_t nbyte = v.size();
+        world.gop.broadcast(nbyte, 0);
+        madness::archive::ContainerRecordInputArchive ar(world, std::move(v));
         madness::archive::ParallelInputArchive<madness::archive::ContainerRecordInputArchive> par(world, ar);
         par & target;
-        cache(world, target, record);
+        cache(world, target, record, nbyte);
         return target;
     }
 
@@ -80,6 +80,13 @@ namespace madness {
                 }
             }
             
+            /// Reads a record whose bytes the caller obtained on rank 0 of subworld
+            ContainerRecordInputArchive(World& subworld, std::vector<unsigned char>&& bytes)
+                : rank(subworld.rank())
+                , v(std::move(bytes))
+                , ar(v)
+            {}
+
             ~ContainerRecordInputArchive()
             {}
             
@@ -97,9 +97,12 @@ namespace SafeMPI {
     ///
     /// tags in [4096,8191] ... reserved for huge msg exchange by RMI
     ///
-    /// tags in [8192,MPI::TAG_UB] ... not used/managed by madness
+    /// tags in [8192,8255] ... receive shards 1, 2, ... of RMI (shard 0 uses RMI_TAG)
+    ///
+    /// tags in [8256,MPI::TAG_UB] ... not used/managed by madness
 
     static const int RMI_TAG = 1023;
+    static const int RMI_SHARD_TAG = 8192;
     static const int MPIAR_TAG = 1001;
     static const int DEFAULT_SEND_RECV_TAG = 1000;
 
@@ -217,13 +217,18 @@ void test_time() {
             }
             insert_used = madness::cpu_time()-insert_used;
             v = random_perm(nentries);
+            double find_used = madness::cpu_time();
+            for (int i=0; i<nentries; ++i) {
+                if (a.find(v[i]) == a.end()) throw "find failed in test_time";
+            }
+            find_used = madness::cpu_time()-find_used;
             double del_used = madness::cpu_time();
             for (int i=0; i<nentries; ++i) {
                 a.erase(i);
             }
             del_used = madness::cpu_time()-del_used;
-            printf("nbin=%8d   nent=%8d   insert=%.1es/call   del=%.1es/call\n",
-                   nbins, nentries, insert_used/nentries, del_used/nentries);
+            printf("nbin=%8d   nent=%8d   insert=%.1es/call   find=%.1es/call   del=%.1es/call\n",
+                   nbins, nentries, insert_used/nentries, find_used/nentries, del_used/nentries);
         }
     }
 }
@@ -386,6 +391,84 @@ void test_accessors() {
     if (a[1] != 20000000.0) MADNESS_EXCEPTION("Ooops", int(a[1]));
 }
 
+class Reader : public madness::ThreadBase {
+private:
+    const ConcurrentHashMap<int,double>& a;
+    const int nkey, nlookup;
+
+public:
+    double used;
+
+    Reader(const ConcurrentHashMap<int,double>& a, int nkey, int nlookup)
+            : ThreadBase(), a(a), nkey(nkey), nlookup(nlookup), used(0.0) {
+        start();
+    }
+
+    void run() {
+        used = madness::wall_time();
+        for (int i=0; i<nlookup; ++i) {
+            int key = int((long(i)*7919) % nkey);
+            if (i&1) {
+                ConcurrentHashMap<int,double>::const_iterator it = a.find(key);
+                if (it == a.end() || it->second != key) MADNESS_EXCEPTION("Reader: lost key", key);
+            }
+            else {
+                ConcurrentHashMap<int,double>::const_accessor r;
+                if (!a.find(r, key) || r->second != key) MADNESS_EXCEPTION("Reader: lost key", key);
+            }
+        }
+        used = madness::wall_time() - used;
+        ndone++;
+    }
+};
+
+class Churner : public madness::ThreadBase {
+private:
+    ConcurrentHashMap<int,double>& a;
+    const int nkey, niter;
+
+public:
+    Churner(ConcurrentHashMap<int,double>& a, int nkey, int niter)
+            : ThreadBase(), a(a), nkey(nkey), niter(niter) {
+        start();
+    }
+
+    void run() {
+        typedef ConcurrentHashMap<int,double>::datumT datumT;
+        for (int i=0; i<niter; ++i) {
+            int key = nkey + int(drand()*nkey);
+            if (drand() < 0.5) a.insert(datumT(key,key));
+            else a.erase(key);
+        }
+        ndone++;
+    }
+};
+
+void test_lookup() {
+    // Lookups of keys that are always present, running against a thread
+    // that inserts and erases other keys in the same bins so that the
+    // slot arrays keep growing, collecting tombstones and being rebuilt.
+    typedef ConcurrentHashMap<int,double>::datumT datumT;
+    const int nkey = smalltest ? 10000 : 200000;
+    const int nlookup = smalltest ? 100000 : 10000000;
+    ConcurrentHashMap<int,double> a(131);
+    for (int i=0; i<nkey; ++i) a.insert(datumT(i,i));
+
+    ndone = 0;
+    Reader r1(a, nkey, nlookup), r2(a, nkey, nlookup);
+    Churner c(a, nkey, nlookup/10);
+    while (ndone != 3) sched_yield();
+
+    size_t count = 0;
+    for (ConcurrentHashMap<int,double>::iterator it=a.begin(); it!=a.end(); ++it) count++;
+    if (count != a.size()) MADNESS_EXCEPTION("test_lookup: iteration and size disagree", count);
+    for (int i=0; i<nkey; ++i) {
+        if (a.find(i) == a.end()) MADNESS_EXCEPTION("test_lookup: lost key", i);
+    }
+    printf("lookup: nbin=%d   nent=%d   %.1es/call per reader while churning\n",
+           131, int(a.size()), std::max(r1.used,r2.used)/nlookup);
+}
+
 int main(int argc, char** argv) {
     madness::initialize(argc,argv);
 
@@ -395,6 +478,7 @@ int main(int argc, char** argv) {
     
     try {
         test_coverage();
+        test_lookup();
         if (!smalltest) {
             test_random();
             test_time();
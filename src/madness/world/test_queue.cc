@@ -62,6 +62,26 @@ public:
     static bool finished() {return total_count==(NGEN*NTASK);}
 };
 
+madness::AtomicInt nlocal, nhome, npool;
+
+// A task with a locality hint, counting whether it ran in its NUMA domain
+class LocalTask : public madness::TaskInterface {
+public:
+    LocalTask(unsigned long hint) : madness::TaskInterface(madness::TaskAttributes()) {
+        set_locality(hint);
+    }
+
+    virtual void run(madness::World& world) {
+        if (madness::ThreadPool::numa_domain() >= 0) {
+            npool++;
+            if (madness::ThreadPool::numa_domain() == madness::ThreadPool::numa_domain_of(*this)) nhome++;
+        }
+        nlocal++;
+    }
+
+    static bool finished() {return nlocal==NTASK;}
+};
+
 int main(int argc, char** argv) {
     bool smalltest = false;
     if (getenv("MAD_SMALL_TESTS")) smalltest=true;
@@ -94,6 +114,26 @@ int main(int argc, char** argv) {
             << " (s)\nTasks per thread:\n";
     for (unsigned long i = 0; i < (madness::ThreadPool::size() + 1); ++i)
         std::cout << i << " " << thread_counters[i] << "\n";
+    std::cout << "Stolen tasks = " << madness::ThreadPool::get_stats().nsteal << "\n";
+
+    // Tasks with a locality hint run on the NUMA domain it maps to, unless stolen
+    nlocal = 0;
+    nhome = 0;
+    npool = 0;
+    const std::size_t nsteal = madness::ThreadPool::get_stats().nsteal;
+    start = madness::wall_time();
+    for (int i=0; i<NTASK; ++i)
+        world.taskq.add(new LocalTask(i));
+    world.await(& LocalTask::finished);
+    finish = madness::wall_time();
+    std::cout << "NUMA domains = " << madness::ThreadPool::numa_domains()
+              << "\nTasks with locality hint = " << nlocal
+              << " run by pool threads = " << npool
+              << " in their domain = " << nhome
+              << "\nTotal runtime = " << finish - start << " (s)\n";
+    MADNESS_CHECK(nlocal == NTASK);
+    // a pool thread runs a task of another domain only if it stole it
+    MADNESS_CHECK(std::size_t(npool - nhome) <= madness::ThreadPool::get_stats().nsteal - nsteal);
 
     cleanup_tls();
     madness::finalize();
@@ -30,6 +30,7 @@
 */
 
 #include <vector>
+#include <atomic>
 #include <numeric>
 #include <algorithm>
 
@@ -1153,6 +1154,72 @@ void test14(World& world) {
   world.gop.fence();
 }
 
+/// Receives a numbered stream of ordered active messages from every process
+class Sequencer : public WorldObject<Sequencer> {
+    std::vector<long> next;     ///< one more than the number of the last message from each process
+    std::atomic<long> nerr;
+    std::atomic<long> nrecv;
+public:
+    Sequencer(World& world)
+            : WorldObject<Sequencer>(world)
+            , next(world.size(), 0)
+            , nerr(0)
+            , nrecv(0) {
+      process_pending();
+    }
+
+    void recv(ProcessID from, long i) {
+        if (i < next[from]) nerr++;  // numbers from a process must increase
+        next[from] = i+1;
+        nrecv++;
+    }
+
+    void recv_buf(ProcessID from, long i, const std::vector<double>& buf) {
+        if (buf.size() == 0 || buf.back() != i) nerr++;
+        recv(from, i);
+    }
+
+    long received() const {return nrecv;}
+    long errors() const {return nerr;}
+};
+
+/// Ordered active messages must arrive in order however many RMI server threads there are
+void test16(World& world) {
+    Sequencer seq(world);
+    world.gop.fence();
+
+    const long nmsg = 2000;
+    const std::vector<double> huge((world.size() > 1 ? RMI::max_msg_len() : 1024)/sizeof(double)+5, 0.0);
+    const double start = wall_time();
+    for (long i=0; i<nmsg; ++i) {
+        const ProcessID dest = (world.rank()+1+i)%world.size();
+        if (i%500 == 0) {
+            std::vector<double> buf(huge);
+            buf.back() = i;
+            seq.send(dest, &Sequencer::recv_buf, world.rank(), i, buf);
+        }
+        else {
+            seq.send(dest, &Sequencer::recv, world.rank(), i);
+        }
+    }
+    world.gop.fence();
+    const double used = wall_time() - start;
+
+    long nerr = seq.errors();
+    long nrecv = seq.received();
+    world.gop.sum(nerr);
+    world.gop.sum(nrecv);
+    MADNESS_CHECK(nerr == 0);
+    MADNESS_CHECK(nrecv == nmsg*world.size());
+
+    for (int s=0; s<RMI::nshard(); ++s) {
+        const RMIStats stats = RMI::get_stats(s);
+        print("RMI shard", s, "messages sent", stats.nmsg_sent, "received", stats.nmsg_recv);
+    }
+    print("Test16 OK", nmsg, "ordered messages with", RMI::nshard(), "RMI server threads in", used, "s");
+    world.gop.fence();
+}
+
 void test15(World& world) {
 
   if (world.size() > 1) {
@@ -1349,6 +1416,7 @@ int main(int argc, char** argv) {
         test13(world);
         test14(world);
         test15(world);
+        test16(world);
 
         for (int i=0; i<10; ++i) {
           print("REPETITION",i);
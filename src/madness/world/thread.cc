@@ -45,6 +45,10 @@
 #include <madness/world/atomicint.h>
 #include <cstring>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <dirent.h>
 
 #if defined(HAVE_IBMBGQ) and defined(HPM)
 extern "C" unsigned int HPM_Prof_init_thread(void);
@@ -267,6 +271,66 @@ namespace madness {
 #endif
     }
 
+    void ThreadBase::set_affinity(const std::vector<int>& cpus) {
+#ifndef ON_A_MAC
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (int cpu : cpus) CPU_SET(cpu,&mask);
+        if (sched_setaffinity(0, sizeof(mask), &mask) == -1) {
+            perror("system error message");
+            std::cout << "ThreadBase: set_affinity: Could not set cpu affinity" << std::endl;
+        }
+#endif
+    }
+
+    namespace {
+        /// Parse a Linux cpu list such as "0-3,8,10-11"
+        std::vector<int> parse_cpulist(const std::string& list) {
+            std::vector<int> cpus;
+            std::stringstream ss(list);
+            std::string range;
+            while (std::getline(ss, range, ',')) {
+                int lo, hi;
+                const int n = sscanf(range.c_str(), "%d-%d", &lo, &hi);
+                if (n == 1) hi = lo;
+                if (n >= 1) for (int i=lo; i<=hi; ++i) cpus.push_back(i);
+            }
+            return cpus;
+        }
+
+        std::vector< std::vector<int> > read_numa_topology() {
+            std::vector< std::vector<int> > domains;
+            DIR* dir = opendir("/sys/devices/system/node");
+            if (dir) {
+                std::vector<int> nodes;
+                while (dirent* entry = readdir(dir)) {
+                    int node;
+                    if (sscanf(entry->d_name, "node%d", &node) == 1) nodes.push_back(node);
+                }
+                closedir(dir);
+                std::sort(nodes.begin(), nodes.end());
+                for (int node : nodes) {
+                    std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                    std::string list;
+                    if (f && std::getline(f, list)) {
+                        std::vector<int> cpus = parse_cpulist(list);
+                        if (!cpus.empty()) domains.push_back(cpus);
+                    }
+                }
+            }
+            if (domains.empty()) {
+                domains.resize(1);
+                for (int i=0; i<ThreadBase::num_hw_processors(); ++i) domains[0].push_back(i);
+            }
+            return domains;
+        }
+    }
+
+    const std::vector< std::vector<int> >& ThreadBase::numa_topology() {
+        static const std::vector< std::vector<int> > domains = read_numa_topology();
+        return domains;
+    }
+
 #if defined(HAVE_IBMBGQ) and defined(HPM)
   void ThreadBase::set_hpm_thread_env(int hpm_thread_id) {
     if (hpm_thread_id == ThreadBase::hpm_thread_id_all) {
@@ -346,6 +410,13 @@ namespace madness {
     ThreadPool::ThreadPool(int nthread)
     : threads(nullptr)
     , main_thread()
+#ifdef MADNESS_USE_WORK_STEALING
+    , local_queues(nullptr)
+    , wait_policy(WaitPolicy::Busy)
+    , wait_usleep(0)
+    , domain_queues(nullptr)
+#endif
+    , ndomain(1)
     , nthreads(nthread)
     , finish(false)
     {
@@ -381,8 +452,12 @@ namespace madness {
             MADNESS_EXCEPTION("When configured with MADNESS_TASK_BACKEND=Pthreads MAD_NUM_THREADS cannot exceed 64",1);
 
         try {
-            if (nthreads > 0)
+            if (nthreads > 0) {
                 threads = new ThreadPoolThread[nthreads];
+#ifdef MADNESS_USE_WORK_STEALING
+                local_queues = new WSDeque<PoolTaskInterface*>[nthreads];
+#endif
+            }
             else
                 threads = 0;
         }
@@ -390,6 +465,17 @@ namespace madness {
             MADNESS_EXCEPTION("memory allocation failed", 0);
         }
 
+        // NUMA domains ... see numa_domains()
+        const char* mad_numa = getenv("MAD_NUMA");
+        if (mad_numa && atoi(mad_numa) > 0 && nthreads > 1) {
+            const int n = atoi(mad_numa);
+            const int ntopo = (n > 1) ? n : ThreadBase::numa_topology().size();
+            ndomain = std::max(1, std::min(ntopo, nthreads));
+#ifdef MADNESS_USE_WORK_STEALING
+            if (ndomain > 1) domain_queues = new DomainQueue[ndomain];
+#endif
+        }
+
         for (int i=0; i<nthreads; ++i) {
             threads[i].set_pool_thread_index(i);
             threads[i].start(pool_thread_main, (void *)(threads+i));
@@ -423,9 +509,32 @@ namespace madness {
         return nthread;
     }
 
+    std::vector<int> ThreadPool::numa_domain_cpus(int d) const {
+        const std::vector< std::vector<int> >& topology = ThreadBase::numa_topology();
+        if (atoi(getenv("MAD_NUMA")) == 1) return topology[d];
+
+        // Split all CPUs into ndomain blocks of consecutive ids
+        std::vector<int> cpus;
+        for (const auto& domain : topology) cpus.insert(cpus.end(), domain.begin(), domain.end());
+        std::sort(cpus.begin(), cpus.end());
+        const int ncpu = cpus.size();
+        const int lo = (long(d)*ncpu)/ndomain, hi = (long(d+1)*ncpu)/ndomain;
+        if (lo == hi) return std::vector<int>(1, cpus[d % ncpu]);
+        return std::vector<int>(cpus.begin()+lo, cpus.begin()+hi);
+    }
+
     void ThreadPool::thread_main(ThreadPoolThread* const thread) {
         PROFILE_MEMBER_FUNC(ThreadPool);
-        thread->set_affinity(2, thread->get_pool_thread_index());
+        thread_domain = pool_thread_domain(thread->get_pool_thread_index());
+        if (ndomain > 1) {
+            thread->set_affinity(numa_domain_cpus(thread_domain));
+        }
+        else {
+            thread->set_affinity(2, thread->get_pool_thread_index());
+        }
+#ifdef MADNESS_USE_WORK_STEALING
+        local_queue = local_queues + thread->get_pool_thread_index();
+#endif
 
 #if !HAVE_PARSEC
 #define MULTITASK
@@ -541,7 +650,24 @@ namespace madness {
 
     // Returns queue statistics
     const DQStats& ThreadPool::get_stats() {
+#ifdef MADNESS_USE_WORK_STEALING
+        // Tasks run from the work-stealing queues are accounted as
+        // pushed to the back and popped from the front of the queue
+        static DQStats stats;
+        stats = instance()->queue.get_stats();
+        for (int i=0; i<instance()->nthreads; ++i) {
+            const WSDeque<PoolTaskInterface*>& q = instance()->local_queues[i];
+            stats.npush_back += q.get_npush();
+            stats.npop_front += q.get_npop() + q.get_nsteal();
+            stats.nsteal += q.get_nsteal();
+        }
+        if (instance()->domain_queues) {
+            for (int d=0; d<instance()->ndomain; ++d) stats.nsteal += instance()->domain_queues[d].get_nsteal();
+        }
+        return stats;
+#else
         return instance()->queue.get_stats();
+#endif
     }
 
 } // namespace madness
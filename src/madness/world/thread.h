@@ -40,8 +40,11 @@
 
 #include <madness/world/thread_info.h>
 #include <madness/world/dqueue.h>
+#include <madness/world/wsdeque.h>
 #include <madness/world/function_traits.h>
 #include <vector>
+#include <deque>
+#include <atomic>
 #include <cstddef>
 #include <cstdio>
 #include <pthread.h>
@@ -210,6 +213,18 @@ namespace madness {
         /// \param[in] ind Description needed.
         static void set_affinity(int logical_id, int ind=-1);
 
+        /// Bind the calling thread to a set of CPUs.
+
+        /// \param[in] cpus The ids of the CPUs the thread may run on.
+        static void set_affinity(const std::vector<int>& cpus);
+
+        /// The CPUs of each NUMA domain of this node.
+
+        /// Read from /sys/devices/system/node on Linux, otherwise (or if that
+        /// fails) a single domain holding all processors.
+        /// \return The ids of the CPUs of each domain.
+        static const std::vector< std::vector<int> >& numa_topology();
+
         /// \todo Brief description needed.
 
         /// \todo Descriptions needed.
@@ -288,6 +303,9 @@ namespace madness {
         static const unsigned long GENERATOR = 1ul<<8; ///< Mask for generator bit.
         static const unsigned long STEALABLE = GENERATOR<<1; ///< Mask for stealable bit.
         static const unsigned long HIGHPRIORITY = GENERATOR<<2; ///< Mask for priority bit.
+        static const unsigned long LOCALITY = GENERATOR<<3; ///< Mask for the bit telling that a locality hint is set.
+        static const int LOCALITY_SHIFT = 16; ///< Position of the locality hint.
+        static const unsigned long LOCALITY_HINT = 0xfffful<<LOCALITY_SHIFT; ///< Mask for the locality hint.
 
         /// Sets the attributes to the desired values.
 
@@ -354,6 +372,29 @@ namespace madness {
                 flags &= ~HIGHPRIORITY;
         }
 
+        /// Sets the locality hint, typically a hash of the key of the data the task works on.
+
+        /// Tasks with equal hints are preferably run by threads of the same
+        /// NUMA domain (see ThreadPool::numa_domains()).
+        /// \param[in] hint The hint ... only the low 16 bits are kept.
+        void set_locality(unsigned long hint) {
+            flags = (flags & ~LOCALITY_HINT) | LOCALITY | ((hint<<LOCALITY_SHIFT) & LOCALITY_HINT);
+        }
+
+        /// Test if a locality hint is set.
+
+        /// \return True if a locality hint is set, false otherwise.
+        bool has_locality() const {
+            return flags&LOCALITY;
+        }
+
+        /// Get the locality hint.
+
+        /// \return The locality hint.
+        unsigned long get_locality() const {
+            return (flags&LOCALITY_HINT)>>LOCALITY_SHIFT;
+        }
+
         /// Set the number of threads.
 
         /// \attention Are you sure this is what you want to call? Only call
@@ -1134,6 +1175,38 @@ namespace madness {
         ThreadPoolThread *threads; ///< Array of threads.
         ThreadPoolThread main_thread; ///< Placeholder for main thread tls.
         DQueue<PoolTaskInterface*> queue; ///< Queue of tasks.
+#ifdef MADNESS_USE_WORK_STEALING
+        WSDeque<PoolTaskInterface*>* local_queues; ///< Work-stealing queue of each pool thread.
+        WaitPolicy wait_policy; ///< How idle threads wait for work.
+        int wait_usleep; ///< Sleep duration for WaitPolicy::Sleep
+        inline static thread_local WSDeque<PoolTaskInterface*>* local_queue = nullptr; ///< Queue of this thread, null if not a pool thread
+        inline static thread_local unsigned int steal_seed = 0; ///< State of the random choice of the victim
+
+        /// Tasks with a locality hint waiting for a thread of their NUMA domain
+        class DomainQueue : private Spinlock {
+            std::deque<PoolTaskInterface*> q;
+            std::atomic<std::size_t> n{0};
+            std::atomic<std::size_t> nsteal{0};   ///< tasks taken by threads of other domains
+        public:
+            void push(PoolTaskInterface* task) {
+                lock(); q.push_back(task); n++; unlock();
+            }
+            PoolTaskInterface* pop() {
+                if (n == 0) return nullptr;
+                PoolTaskInterface* task = nullptr;
+                lock();
+                if (!q.empty()) {task = q.front(); q.pop_front(); n--;}
+                unlock();
+                return task;
+            }
+            std::size_t size() const {return n;}
+            void count_steal() {nsteal++;}
+            std::size_t get_nsteal() const {return nsteal;}
+        };
+        DomainQueue* domain_queues; ///< Queue of each NUMA domain, null unless more than one domain is used
+#endif
+        int ndomain; ///< Number of NUMA domains the pool threads are spread over
+        inline static thread_local int thread_domain = -1; ///< NUMA domain of this thread, -1 if not a pool thread
         int nthreads; ///< Number of threads.
         volatile bool finish; ///< Set to true when time to stop.
         AtomicInt nfinished; ///< Thread pool exit counter.
@@ -1203,7 +1276,29 @@ namespace madness {
 #else
 
             PoolTaskInterface* taskbuf[nmax];
+#ifdef MADNESS_USE_WORK_STEALING
+            // The global queue holds the high-priority tasks and all tasks
+            // submitted by non-pool threads, so it comes first.  Only look at
+            // it when it is not empty to keep idle threads off its lock.
+            int ntask = queue.empty() ? 0 : queue.pop_front(nmax, taskbuf, false);
+            if (ntask == 0) {
+                ntask = run_domain_tasks(this_thread);
+                if (ntask == 0) ntask = run_local_tasks(this_thread);
+                if (ntask == 0) {
+                    PoolTaskInterface* task = steal_task();
+                    if (task) {
+                        run_one_task(task, this_thread);
+                        ntask = 1;
+                    }
+                    else if (wait) {
+                        idle();
+                    }
+                }
+                return (ntask>0);
+            }
+#else
             int ntask = queue.pop_front(nmax, taskbuf, wait);
+#endif
 #ifdef MADNESS_TASK_PROFILING
             profiling::TaskEventList* event_list =
                     this_thread->profiler().new_list(ntask);
@@ -1229,6 +1324,110 @@ namespace madness {
 #endif
         }
 
+#ifdef MADNESS_USE_WORK_STEALING
+        /// Run a single task taken from one of the work-stealing queues.
+
+        /// \param[in,out] task The task, deleted after it ran.
+        /// \param[in,out] this_thread The calling thread (used for profiling only).
+        void run_one_task(PoolTaskInterface* task, ThreadPoolThread* const this_thread) {
+#ifdef MADNESS_TASK_PROFILING
+            task->set_event(this_thread->profiler().new_list(1)->event());
+#endif // MADNESS_TASK_PROFILING
+            if (task->run_multi_threaded())
+                delete task;
+        }
+
+        /// Run up to \c nmax tasks from the queue of the calling thread, newest first.
+
+        /// Stops early if tasks show up in the global queue, which might be
+        /// high priority.
+        /// \param[in,out] this_thread The calling thread (used for profiling only).
+        /// \return The number of tasks run.
+        int run_local_tasks(ThreadPoolThread* const this_thread) {
+            int ntask = 0;
+            if (!local_queue) return 0;
+            while (ntask < nmax && queue.empty()) {
+                PoolTaskInterface* task = local_queue->pop();
+                if (!task) break;
+                run_one_task(task, this_thread);
+                ++ntask;
+            }
+            return ntask;
+        }
+
+        /// Run up to \c nmax tasks from the queue of the NUMA domain of the calling thread.
+
+        /// \param[in,out] this_thread The calling thread (used for profiling only).
+        /// \return The number of tasks run.
+        int run_domain_tasks(ThreadPoolThread* const this_thread) {
+            int ntask = 0;
+            if (!domain_queues || thread_domain < 0) return 0;
+            DomainQueue& dq = domain_queues[thread_domain];
+            while (ntask < nmax && queue.empty()) {
+                PoolTaskInterface* task = dq.pop();
+                if (!task) break;
+                run_one_task(task, this_thread);
+                ++ntask;
+            }
+            return ntask;
+        }
+
+        /// Take the oldest task from the queue of another, randomly chosen, pool thread.
+
+        /// Victims in the NUMA domain of the calling thread are tried
+        /// first, then the queues of the other domains, then their threads.
+        /// \return The task or null if no task was found.
+        PoolTaskInterface* steal_task() {
+            if (nthreads == 0) return nullptr;
+            unsigned int& x = steal_seed;
+            if (x == 0) x = 2463534242u + 7919u*(1u+reinterpret_cast<std::uintptr_t>(local_queue)%nthreads);
+            x ^= x << 13; x ^= x >> 17; x ^= x << 5; // xorshift32
+            const int first = x % nthreads;
+            for (int pass=0; pass<(domain_queues ? 2 : 1); ++pass) {
+                if (pass == 1) {
+                    for (int d=0; d<ndomain; ++d) {
+                        if (d == thread_domain) continue;
+                        DomainQueue& dq = domain_queues[(first+d)%ndomain];
+                        PoolTaskInterface* task = dq.pop();
+                        if (task) {
+                            dq.count_steal();
+                            return task;
+                        }
+                    }
+                }
+                for (int i=0; i<nthreads; ++i) {
+                    const int v = (first+i)%nthreads;
+                    if (domain_queues && (pool_thread_domain(v) == thread_domain) == (pass == 1)) continue;
+                    WSDeque<PoolTaskInterface*>* victim = local_queues + v;
+                    if (victim == local_queue || victim->empty()) continue;
+                    PoolTaskInterface* task = victim->steal();
+                    if (task) return task;
+                }
+            }
+            return nullptr;
+        }
+
+        /// Called by a thread that found no work in any queue.
+        void idle() const {
+            switch (wait_policy) {
+              case WaitPolicy::Yield:
+                std::this_thread::yield();
+                break;
+              case WaitPolicy::Sleep:
+                myusleep(wait_usleep);
+                break;
+              default:
+                cpu_relax();
+            }
+        }
+#endif // MADNESS_USE_WORK_STEALING
+
+        /// The CPUs of a NUMA domain, see numa_domains().
+
+        /// \param[in] d The domain.
+        /// \return The ids of its CPUs.
+        std::vector<int> numa_domain_cpus(int d) const;
+
         /// \todo Brief description needed.
 
         /// \todo Description needed.
@@ -1316,6 +1515,16 @@ namespace madness {
             if (task->is_high_priority() && (task_threads == 1)) {
                 instance()->queue.push_front(task);
             }
+#ifdef MADNESS_USE_WORK_STEALING
+            else if (task_threads == 1 && task->has_locality() && instance()->domain_queues &&
+                     numa_domain_of(*task) != thread_domain) {
+                // Task belongs to another NUMA domain
+                instance()->domain_queues[numa_domain_of(*task)].push(task);
+            }
+            else if (task_threads == 1 && local_queue && local_queue->push(task)) {
+                // Task submitted by a pool thread stays with it, unless stolen
+            }
+#endif
             else {
                 instance()->queue.push_back(task, task_threads);
             }
@@ -1324,6 +1533,7 @@ namespace madness {
 
         /// \todo Brief description needed.
 
+        /// Tasks in the work-stealing queues of the pool threads are not scanned.
         /// \todo Descriptions needed.
         /// \tparam opT Description needed.
         /// \param[in,out] op Description needed.
@@ -1371,11 +1581,59 @@ namespace madness {
             return instance()->nthreads;
         }
 
+        /// Returns the number of NUMA domains the pool threads are spread over.
+
+        /// This is 1 unless enabled by the environment variable \c MAD_NUMA.
+        /// With \c MAD_NUMA=1 each pool thread is bound to the CPUs of one
+        /// domain of ThreadBase::numa_topology(), consecutive threads sharing
+        /// a domain.  With \c MAD_NUMA=n (n>1) the CPUs are split into n
+        /// domains of consecutive ids (e.g., to test on a single-domain node).
+        /// Tasks with a locality hint (TaskAttributes::set_locality()) are
+        /// then queued for the threads of domain numa_domain_of(), idle
+        /// threads stealing from their own domain before the others.  As
+        /// each thread takes tensors from its own pool, data made by such
+        /// tasks is first touched in their domain.
+        /// \return The number of NUMA domains.
+        static int numa_domains() {
+            return instance()->ndomain;
+        }
+
+        /// Returns the NUMA domain of the calling thread.
+
+        /// \return The domain, or -1 if this is not a pool thread.
+        static int numa_domain() {
+            return thread_domain;
+        }
+
+        /// Returns the NUMA domain that should run a task with a locality hint.
+
+        /// \param[in] attr The attributes of the task.
+        /// \return The domain.
+        static int numa_domain_of(const TaskAttributes& attr) {
+            return attr.get_locality() % instance()->ndomain;
+        }
+
+        /// Returns the NUMA domain of a pool thread.
+
+        /// \param[in] i The index of the thread in the pool.
+        /// \return The domain.
+        int pool_thread_domain(int i) const {
+            return int((long(i)*ndomain)/nthreads);
+        }
+
         /// Returns the number of tasks in the queue.
 
         /// \return The number of tasks in the queue.
         static std::size_t queue_size() {
+#ifdef MADNESS_USE_WORK_STEALING
+            std::size_t n = instance()->queue.size();
+            for (int i=0; i<instance()->nthreads; ++i) n += instance()->local_queues[i].size();
+            if (instance()->domain_queues)
+                for (int d=0; d<instance()->ndomain; ++d) n += instance()->domain_queues[d].size();
+            return n;
+#else
             return instance()->queue.size();
+#endif
         }
 
         /// Returns queue statistics.
@@ -1461,6 +1719,10 @@ namespace madness {
 #elif HAVE_INTEL_TBB
 #else
             delete[] threads;
+#ifdef MADNESS_USE_WORK_STEALING
+            delete[] local_queues;
+            delete[] domain_queues;
+#endif
 #endif
         }
 
@@ -1471,6 +1733,10 @@ namespace madness {
 #if !HAVE_INTEL_TBB && !HAVE_PARSEC
           instance()->queue.set_wait_policy(policy,
                                             sleep_duration_in_microseconds);
+#ifdef MADNESS_USE_WORK_STEALING
+          instance()->wait_policy = policy;
+          instance()->wait_usleep = sleep_duration_in_microseconds;
+#endif
 #endif
         }
 
@@ -322,33 +322,39 @@ namespace madness {
         double npop_front = q.npop_front;
         double ntask = q.npush_back + q.npush_front;
         double nmax = q.nmax;
+        double nsteal = q.nsteal;
         world.gop.sum(npush_back);
         world.gop.sum(npush_front);
         world.gop.sum(npop_front);
         world.gop.sum(ntask);
         world.gop.sum(nmax);
+        world.gop.sum(nsteal);
 
         double max_npush_back = q.npush_back;
         double max_npush_front = q.npush_front;
         double max_npop_front = q.npop_front;
         double max_ntask = q.npush_back + q.npush_front;
         double max_nmax = q.nmax;
+        double max_nsteal = q.nsteal;
         world.gop.max(max_npush_back);
         world.gop.max(max_npush_front);
         world.gop.max(max_npop_front);
         world.gop.max(max_ntask);
         world.gop.max(max_nmax);
+        world.gop.max(max_nsteal);
 
         double min_npush_back = q.npush_back;
         double min_npush_front = q.npush_front;
         double min_npop_front = q.npop_front;
         double min_ntask = q.npush_back + q.npush_front;
         double min_nmax = q.nmax;
+        double min_nsteal = q.nsteal;
         world.gop.min(min_npush_back);
         world.gop.min(min_npush_front);
         world.gop.min(min_npop_front);
         world.gop.min(min_ntask);
         world.gop.min(min_nmax);
+        world.gop.min(min_nsteal);
 
 #ifdef HAVE_PAPI
         double val[NUMEVENTS], max_val[NUMEVENTS], min_val[NUMEVENTS];
@@ -398,6 +404,8 @@ namespace madness {
                    min_nmax, nmax/world.size(), max_nmax);
             printf("  #hi-pri tasks per node    %.2e / %.2e / %.2e\n",
                    min_npush_front, npush_front/world.size(), max_npush_front);
+            printf("  #stolen tasks per node    %.2e / %.2e / %.2e\n",
+                   min_nsteal, nsteal/world.size(), max_nsteal);
             printf("\n");
 #ifdef HAVE_PAPI
             printf("         PAPI statistics (min / avg / max)\n");
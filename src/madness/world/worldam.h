@@ -41,6 +41,7 @@
 #include <vector>
 #include <cstddef>
 #include <memory>
+#include <atomic>
 #include <pthread.h>
 
 namespace madness {
@@ -247,15 +248,15 @@ namespace madness {
         // Next 3 were volatile but no need since protected by spinlock with implied barriers/fence
         int cur_msg;               ///< Index of next buffer to attempt to use
         unsigned long nsent;       ///< Counts no. of AM sent for purpose of termination detection
-        unsigned long nrecv;       ///< Counts no. of AM received for purpose of termination detection
+        std::atomic<unsigned long> nrecv; ///< Counts no. of AM received for purpose of termination detection
 
         std::vector<int> map_to_comm_world; ///< Maps rank in current MPI communicator to SafeMPI::COMM_WORLD
 
         /// This handles all incoming RMI messages for all instances
         static void handler(void *buf, std::size_t nbyte) {
-            // It will be singled threaded since only the RMI receiver
-            // thread will invoke it ... however note that nrecv will
-            // be read by the main thread during fence operations.
+            // Only the RMI server threads will invoke it ... there may be
+            // several of them and nrecv will be read by the main thread
+            // during fence operations, hence nrecv is atomic.
             AmArg* arg = static_cast<AmArg*>(buf);
             am_handlerT func = arg->get_func();
             World* w = arg->get_world();
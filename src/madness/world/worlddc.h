@@ -488,7 +488,7 @@ namespace madness {
         	if (fence) world.gop.fence();
         }
 
-        hashfunT& get_hash() const { return local.get_hash(); }
+        const hashfunT& get_hash() const { return local.get_hash(); }
 
         bool is_local(const keyT& key) const {
             return owner(key) == me;
@@ -780,6 +780,18 @@ namespace madness {
         inline void check_initialized() const {
             MADNESS_ASSERT(p);
         }
+
+        /// The attributes of a task on item \c key, hinting the task queue to run it on the NUMA domain of the key
+
+        /// The low bits of the hash often decide the owner, so higher ones are
+        /// used.  With a single domain the hint would not be used and \c attr
+        /// is returned unchanged, without hashing the key.
+        TaskAttributes key_attr(const keyT& key, const TaskAttributes& attr) const {
+            if (ThreadPool::numa_domains() <= 1) return attr;
+            TaskAttributes result(attr);
+            result.set_locality(p->get_hash()(key) >> 16);
+            return result;
+        }
     public:
 
         /// Makes an uninitialized container (no communication)
@@ -1037,7 +1049,7 @@ namespace madness {
         }
 
         /// Returns a reference to the hashing functor
-        hashfunT& get_hash() const {
+        const hashfunT& get_hash() const {
             check_initialized();
             return p->get_hash();
         }
@@ -1295,7 +1307,7 @@ namespace madness {
         task(const keyT& key, memfunT memfun, const TaskAttributes& attr = TaskAttributes()) {
             check_initialized();
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT) = &implT:: template itemfun<memfunT>;
-            return p->task(owner(key), itemfun, key, memfun, attr);
+            return p->task(owner(key), itemfun, key, memfun, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T)" in process owning item (non-blocking comm if remote)
@@ -1314,7 +1326,7 @@ namespace madness {
             check_initialized();
             typedef REMFUTURE(arg1T) a1T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&) = &implT:: template itemfun<memfunT,a1T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T,arg2T)" in process owning item (non-blocking comm if remote)
@@ -1334,7 +1346,7 @@ namespace madness {
             typedef REMFUTURE(arg1T) a1T;
             typedef REMFUTURE(arg2T) a2T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&, const a2T&) = &implT:: template itemfun<memfunT,a1T,a2T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T,arg2T,arg3T)" in process owning item (non-blocking comm if remote)
@@ -1355,7 +1367,7 @@ namespace madness {
             typedef REMFUTURE(arg2T) a2T;
             typedef REMFUTURE(arg3T) a3T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&, const a2T&, const a3T&) = &implT:: template itemfun<memfunT,a1T,a2T,a3T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T,arg2T,arg3T,arg4T)" in process owning item (non-blocking comm if remote)
@@ -1377,7 +1389,7 @@ namespace madness {
             typedef REMFUTURE(arg3T) a3T;
             typedef REMFUTURE(arg4T) a4T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&, const a2T&, const a3T&, const a4T&) = &implT:: template itemfun<memfunT,a1T,a2T,a3T,a4T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T,arg2T,arg3T,arg4T,arg5T)" in process owning item (non-blocking comm if remote)
@@ -1400,7 +1412,7 @@ namespace madness {
             typedef REMFUTURE(arg4T) a4T;
             typedef REMFUTURE(arg5T) a5T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&, const a2T&, const a3T&, const a4T&, const a5T&) = &implT:: template itemfun<memfunT,a1T,a2T,a3T,a4T,a5T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, arg5, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, arg5, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T,arg2T,arg3T,arg4T,arg5T,arg6T)" in process owning item (non-blocking comm if remote)
@@ -1424,7 +1436,7 @@ namespace madness {
             typedef REMFUTURE(arg5T) a5T;
             typedef REMFUTURE(arg6T) a6T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&, const a2T&, const a3T&, const a4T&, const a5T&, const a6T&) = &implT:: template itemfun<memfunT,a1T,a2T,a3T,a4T,a5T,a6T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, arg5, arg6, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, arg5, arg6, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun(arg1T,arg2T,arg3T,arg4T,arg5T,arg6T,arg7T)" in process owning item (non-blocking comm if remote)
@@ -1449,7 +1461,7 @@ namespace madness {
             typedef REMFUTURE(arg6T) a6T;
             typedef REMFUTURE(arg7T) a7T;
             MEMFUN_RETURNT(memfunT)(implT::*itemfun)(const keyT&, memfunT, const a1T&, const a2T&, const a3T&, const a4T&, const a5T&, const a6T&, const a7T&) = &implT:: template itemfun<memfunT,a1T,a2T,a3T,a4T,a5T,a6T,a7T>;
-            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, arg5, arg6, arg7, attr);
+            return p->task(owner(key), itemfun, key, memfun, arg1, arg2, arg3, arg4, arg5, arg6, arg7, key_attr(key, attr));
         }
 
         /// Adds task "resultT memfun() const" in process owning item (non-blocking comm if remote)
@@ -80,6 +80,7 @@ namespace madness {
             uint64_t ntask1, nsent1, nrecv1, ntask2, nsent2, nrecv2;
             do {
                 world_.taskq.fence();
+                run_fence_hooks(); // any tasks or messages they make are counted below
 
                 // Since the number of outstanding tasks and number of AM sent/recv
                 // don't share a critical section read each twice and ensure they
@@ -158,6 +159,16 @@ namespace madness {
         madness::print(world_.rank(), ": WORLD.GOP.FENCE: done with fence in ", npass, (npass > 1 ? " loops" : " loop"));
     }
 
+    void WorldGopInterface::run_fence_hooks() {
+        // the lock is held while the hooks run so that an object cannot
+        // withdraw its hook (i.e., be destroyed) while it is running
+        ScopedMutex<Mutex> lock(fence_hooks_mutex_);
+        if (fence_hooks_.empty()) return;
+        std::map<const void*, std::function<void()> > hooks;
+        hooks.swap(fence_hooks_);
+        for (auto& hook : hooks) hook.second();
+    }
+
     void WorldGopInterface::fence(bool debug) {
       fence_impl([]{}, false, debug);
     }
@@ -39,8 +39,10 @@
 /// the abbreviation.
 
 #include <functional>
+#include <map>
 #include <type_traits>
 #include <madness/world/worldtypes.h>
+#include <madness/world/worldmutex.h>
 #include <madness/world/buffer_archive.h>
 #include <madness/world/world.h>
 #include <madness/world/deferred_cleanup.h>
@@ -147,6 +149,8 @@ namespace madness {
         std::shared_ptr<detail::DeferredCleanup> deferred_; ///< Deferred cleanup object.
         bool debug_; ///< Debug mode
         bool forbid_fence_=false; ///< forbid calling fence() in case of several active worlds
+        Mutex fence_hooks_mutex_; ///< Protects fence_hooks_ and is held while they run
+        std::map<const void*, std::function<void()> > fence_hooks_; ///< Actions for the next fence
 
         friend class detail::DeferredCleanup;
 
@@ -624,6 +628,9 @@ namespace madness {
                         bool pause_during_epilogue = false,
                         bool debug = false);
 
+        /// Run and clear the fence hooks
+        void run_fence_hooks();
+
     public:
 
         // In the World constructor can ONLY rely on MPI and MPI being initialized
@@ -670,6 +677,26 @@ namespace madness {
         /// \param[in] debug set to true to print progress statistics using madness::print(); the default is false.
         void fence(bool debug = false);
 
+        /// Register an action that the next fence runs once all local tasks are done
+
+        /// Used to flush data that is buffered locally, e.g., to aggregate
+        /// messages.  The action is run once, by the thread calling the fence,
+        /// and may submit tasks and send active messages, which the fence then
+        /// waits for.  Registering again with the same \c key before the fence
+        /// replaces the action.
+        /// \param[in] key identifies the action, usually the address of the object it flushes
+        /// \param[in] action the action
+        void add_fence_hook(const void* key, std::function<void()> action) {
+            ScopedMutex<Mutex> lock(fence_hooks_mutex_);
+            fence_hooks_[key] = std::move(action);
+        }
+
+        /// Withdraw the action registered with \c key, if any ... waits if hooks are running
+        void remove_fence_hook(const void* key) {
+            ScopedMutex<Mutex> lock(fence_hooks_mutex_);
+            fence_hooks_.erase(key);
+        }
+
         /// Executes an action on single (this) thread after ensuring all other work is done
 
         /// \param[in] action the action to execute (by the calling thread)
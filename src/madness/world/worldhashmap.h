@@ -49,6 +49,9 @@
 #include <new>
 #include <stdio.h>
 #include <map>
+#include <atomic>
+#include <cstdint>
+#include <vector>
 
 namespace madness {
 
@@ -60,8 +63,23 @@ namespace madness {
     namespace Hash_private {
 
         // A hashtable is an array of nbin bins.
-        // Each bin is a linked list of entries protected by a spinlock.
-        // Each entry holds a key+value pair, a read-write mutex, and a link to the next entry.
+        // Each bin holds its entries on a doubly linked list, which is what
+        // iterators walk, and indexes them with an open-addressed array of
+        // (hash,entry) slots.  The slot array grows with the bin, so the table
+        // resizes incrementally one bin at a time.  Writers serialize on the
+        // bin spinlock; lookups probe the slots without taking it.  Erased
+        // entries and replaced slot arrays are freed only once no lookup that
+        // could still see them is in progress in the bin.  Lookups register in
+        // the counter of the current epoch of the bin; once 64 entries or
+        // arrays are retired a writer flips the epoch and waits for the few
+        // lookups of the old one, so a bin under constant lookups cannot
+        // accumulate retired memory without bound.
+        // Each entry holds a key+value pair, its hash, and a read-write mutex.
+        //
+        // Memory: a slot is 16 bytes, a bin that was ever used has at least 8
+        // slots (128 bytes), and an array between 1/4 (after erasures) and
+        // 3/4 full, i.e. 1.33 to 4 slots per live entry, plus one
+        // replaced array per resize until it is reclaimed.
 
         template <typename keyT, typename valueT>
         class entry : public madness::MutexReaderWriter {
@@ -70,9 +88,12 @@ namespace madness {
             datumT datum;
 
             class entry<keyT,valueT> * next;
+            class entry<keyT,valueT> * prev;
+            const std::size_t hashval;    // hash of the key
+            std::atomic<bool> dead;       // set when erased, checked by lookups
 
-            entry(const datumT& datum, entry<keyT,valueT>* next)
-                    : datum(datum), next(next) {}
+            entry(const datumT& datum, entry<keyT,valueT>* next, std::size_t hashval)
+                    : datum(datum), next(next), prev(0), hashval(hashval), dead(false) {}
         };
 
         template <class keyT, class valueT>
@@ -80,14 +101,58 @@ namespace madness {
         private:
             typedef entry<keyT,valueT> entryT;
             typedef std::pair<const keyT, valueT> datumT;
-            // Could pad here to avoid false sharing of cache line but
-            // perhaps better to just use more bins
+
+            struct slot {
+                std::atomic<std::size_t> hash;
+                std::atomic<entryT*> e;   // 0 if never used, tombstone() once erased
+            };
+
+            /// Slot array of a bin; the capacity is a power of two
+            struct slotarray {
+                const std::size_t mask;
+                const int shift;
+                slot* const slots;
+                slotarray* next_retired;
+
+                slotarray(int logcap)
+                        : mask((std::size_t(1)<<logcap)-1), shift(64-logcap)
+                        , slots(new slot[mask+1]), next_retired(0) {
+                    for (std::size_t i=0; i<=mask; ++i) {
+                        slots[i].hash.store(0, std::memory_order_relaxed);
+                        slots[i].e.store(0, std::memory_order_relaxed);
+                    }
+                }
+
+                ~slotarray() {
+                    delete [] slots;
+                }
+
+                /// First slot to probe (Fibonacci hashing, so keys of one bin spread out)
+                std::size_t start(std::size_t hash) const {
+                    return std::size_t((std::uint64_t(hash)*0x9E3779B97F4A7C15ull) >> shift);
+                }
+            };
+
+            std::atomic<slotarray*> idx;
+            int ntomb;                              // tombstones in idx, protected by the lock
+            mutable std::atomic<int> nreader[2];    // lookups in progress in each epoch
+            mutable std::atomic<int> epoch;         // counter new lookups register in
+            std::vector<entryT*> retired;           // erased entries not yet freed
+            std::size_t nretired_index;             // replaced slot arrays not yet freed
+            slotarray* retired_index;               // replaced slot arrays not yet freed
+
+            static entryT* tombstone() {
+                return reinterpret_cast<entryT*>(std::uintptr_t(1));
+            }
+
         public:
 
-            entryT* p; // was volatile but all uses are protect by mutex with implied barriers and fences
+            entryT* p; // head of the entry list, protected by the lock
             int ninbin; // ditto
 
-            bin() : p(0),ninbin(0) {}
+            static const std::size_t max_retired = 64; // retired items that make a writer wait for the lookups
+
+            bin() : idx(0), ntomb(0), nreader{0,0}, epoch(0), nretired_index(0), retired_index(0), p(0), ninbin(0) {}
 
             ~bin() {
                 clear();
@@ -102,23 +167,32 @@ namespace madness {
                     ninbin--;
                 }
                 MADNESS_ASSERT(ninbin == 0);
+                delete idx.load();
+                idx.store(0);
+                ntomb = 0;
+                reclaim(true);
                 unlock();           // END CRITICAL SECTION
             }
 
-            entryT* find(const keyT& key, const int lockmode) const {
+            entryT* find(const keyT& key, std::size_t hash, const int lockmode) const {
                 bool gotlock;
                 entryT* result;
                 madness::MutexWaiter waiter;
                 do {
-                    lock();             // BEGIN CRITICAL SECTION
-                    result = match(key);
+                    const int e = begin_lookup();
+                    result = match(key, hash);
                     if (result) {
                         gotlock = result->try_lock(lockmode);
+                        // lost a race with erase ... look again
+                        if (gotlock && result->dead.load()) {
+                            result->unlock(lockmode);
+                            gotlock = false;
+                        }
                     }
                     else {
                         gotlock = true;
                     }
-                    unlock();           // END CRITICAL SECTION
+                    nreader[e].fetch_sub(1);    // END LOOKUP
                     if (!gotlock) waiter.wait(); //cpu_relax();
                 }
                 while (!gotlock);
@@ -126,18 +200,22 @@ namespace madness {
                 return result;
             }
 
-            std::pair<entryT*,bool> insert(const datumT& datum, int lockmode) {
+            std::pair<entryT*,bool> insert(const datumT& datum, std::size_t hash, int lockmode) {
                 bool gotlock;
                 entryT* result;
                 bool notfound;
                 madness::MutexWaiter waiter;
                 do {
                     lock();             // BEGIN CRITICAL SECTION
-                    result = match(datum.first);
+                    result = match(datum.first, hash);
                     notfound = !result;
                     if (notfound) {
-                        result = p = new entryT(datum,p);
+                        result = new entryT(datum,p,hash);
+                        if (p) p->prev = result;
+                        p = result;
                         ++ninbin;
+                        add_to_index(result);
+                        reclaim(false);
                     }
                     gotlock = result->try_lock(lockmode);
                     unlock();           // END CRITICAL SECTION
@@ -148,24 +226,30 @@ namespace madness {
                 return std::pair<entryT*,bool>(result,notfound);
             }
 
-            bool del(const keyT& key, int lockmode) {
+            bool del(const keyT& key, std::size_t hash, int lockmode) {
                 bool status = false;
                 lock();             // BEGIN CRITICAL SECTION
-                for (entryT *t=p,*prev=0; t; prev=t,t=t->next) {
-                    if (t->datum.first == key) {
-                        if (prev) {
-                            prev->next = t->next;
-                        }
-                        else {
-                            p = t->next;
+                slotarray* x = idx.load(std::memory_order_relaxed);
+                if (x) {
+                    for (std::size_t i=x->start(hash); ; i=(i+1)&x->mask) {
+                        entryT* t = x->slots[i].e.load(std::memory_order_relaxed);
+                        if (!t) break;
+                        if (t != tombstone() && t->hashval == hash && t->datum.first == key) {
+                            x->slots[i].e.store(tombstone());
+                            ++ntomb;
+                            t->dead.store(true);
+                            if (t->prev) t->prev->next = t->next;
+                            else p = t->next;
+                            if (t->next) t->next->prev = t->prev;
+                            t->unlock(lockmode);
+                            --ninbin;
+                            retired.push_back(t);
+                            status = true;
+                            break;
                         }
-                        t->unlock(lockmode);
-                        delete t;
-                        --ninbin;
-                        status = true;
-                        break;
                     }
                 }
+                reclaim(false);
                 unlock();           // END CRITICAL SECTION
                 return status;
             }
@@ -175,11 +259,90 @@ namespace madness {
             };
 
         private:
-            entryT* match(const keyT& key) const {
-                entryT* t;
-                for (t=p; t; t=t->next)
-                    if (t->datum.first == key) break;
-                return t;
+            /// Registers a lookup in the current epoch and returns the epoch
+
+            /// The epoch is checked again after the increment, so a writer that
+            /// flipped it in between never misses the lookup.
+            int begin_lookup() const {
+                while (true) {
+                    const int e = epoch.load();
+                    nreader[e].fetch_add(1);
+                    if (epoch.load() == e) return e;
+                    nreader[e].fetch_sub(1);
+                }
+            }
+
+            /// Probes the slots for key ... safe without the lock since nothing
+            /// reachable from idx when the lookup began is freed before it ends
+            entryT* match(const keyT& key, std::size_t hash) const {
+                const slotarray* x = idx.load();
+                if (!x) return 0;
+                for (std::size_t i=x->start(hash); ; i=(i+1)&x->mask) {
+                    entryT* t = x->slots[i].e.load();
+                    if (!t) return 0;
+                    if (t != tombstone() &&
+                        x->slots[i].hash.load(std::memory_order_relaxed) == hash &&
+                        t->hashval == hash && !t->dead.load() && t->datum.first == key) return t;
+                }
+            }
+
+            /// Puts a new entry into the slots, rebuilding them when over 3/4 full
+            void add_to_index(entryT* t) {
+                slotarray* x = idx.load(std::memory_order_relaxed);
+                if (!x || 4*std::size_t(ninbin+ntomb) > 3*(x->mask+1)) {
+                    // room for twice the live entries, which drops the tombstones
+                    int logcap = 3;
+                    while ((std::size_t(1)<<logcap) < 2*std::size_t(ninbin)) ++logcap;
+                    slotarray* y = new slotarray(logcap);
+                    for (entryT* e=p; e; e=e->next) place(y, e);
+                    idx.store(y);
+                    ntomb = 0;
+                    if (x) {
+                        x->next_retired = retired_index;
+                        retired_index = x;
+                        ++nretired_index;
+                    }
+                }
+                else {
+                    place(x, t);
+                }
+            }
+
+            void place(slotarray* x, entryT* t) {
+                for (std::size_t i=x->start(t->hashval); ; i=(i+1)&x->mask) {
+                    entryT* e = x->slots[i].e.load(std::memory_order_relaxed);
+                    if (!e || e == tombstone()) {
+                        if (e) --ntomb;
+                        x->slots[i].hash.store(t->hashval, std::memory_order_relaxed);
+                        x->slots[i].e.store(t, std::memory_order_release);
+                        return;
+                    }
+                }
+            }
+
+            /// Frees retired entries and slot arrays if no lookup can still see them
+
+            /// Called with the lock held.  Frees at once if no lookup is in
+            /// progress.  Otherwise, with max_retired items retired, the epoch
+            /// is flipped: lookups beginning from now on cannot reach the
+            /// retired items, and those of the old epoch are waited for.
+            void reclaim(bool force) {
+                if (retired.empty() && !retired_index) return;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!force && (nreader[0].load() != 0 || nreader[1].load() != 0)) {
+                    if (retired.size() + nretired_index < max_retired) return;
+                    const int e = epoch.load();
+                    epoch.store(1-e);
+                    while (nreader[e].load() != 0) cpu_relax();
+                }
+                for (entryT* t : retired) delete t;
+                retired.clear();
+                while (retired_index) {
+                    slotarray* x = retired_index->next_retired;
+                    delete retired_index;
+                    retired_index = x;
+                }
+                nretired_index = 0;
             }
 
         };
@@ -432,8 +595,8 @@ namespace madness {
             return primes[nprimes-1];
         }
 
-        unsigned int hash_to_bin(const keyT& key) const {
-            return hashfun(key)%nbins;
+        unsigned int hash_to_bin(std::size_t hash) const {
+            return hash%nbins;
         }
 
     public:
@@ -465,16 +628,18 @@ namespace madness {
         }
 
         std::pair<iterator,bool> insert(const datumT& datum) {
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> result = bins[bin].insert(datum,entryT::NOLOCK);
+            std::size_t hash = hashfun(datum.first);
+            int bin = hash_to_bin(hash);
+            std::pair<entryT*,bool> result = bins[bin].insert(datum,hash,entryT::NOLOCK);
             return std::pair<iterator,bool>(iterator(this,bin,result.first),result.second);
         }
 
         /// Returns true if new pair was inserted; false if key is already in the map and the datum was not inserted
         bool insert(accessor& result, const datumT& datum) {
             result.release();
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> r = bins[bin].insert(datum,entryT::WRITELOCK);
+            std::size_t hash = hashfun(datum.first);
+            int bin = hash_to_bin(hash);
+            std::pair<entryT*,bool> r = bins[bin].insert(datum,hash,entryT::WRITELOCK);
             result.set(r.first);
             return r.second;
         }
@@ -482,8 +647,9 @@ namespace madness {
         /// Returns true if new pair was inserted; false if key is already in the map and the datum was not inserted
         bool insert(const_accessor& result, const datumT& datum) {
             result.release();
-            int bin = hash_to_bin(datum.first);
-            std::pair<entryT*,bool> r = bins[bin].insert(datum,entryT::READLOCK);
+            std::size_t hash = hashfun(datum.first);
+            int bin = hash_to_bin(hash);
+            std::pair<entryT*,bool> r = bins[bin].insert(datum,hash,entryT::READLOCK);
             result.set(r.first);
             return r.second;
         }
@@ -499,7 +665,8 @@ namespace madness {
         }
 
         std::size_t erase(const keyT& key) {
-            if (bins[hash_to_bin(key)].del(key,entryT::NOLOCK)) return 1;
+            std::size_t hash = hashfun(key);
+            if (bins[hash_to_bin(hash)].del(key,hash,entryT::NOLOCK)) return 1;
             else return 0;
         }
 
@@ -509,34 +676,39 @@ namespace madness {
         }
 
         void erase(accessor& item) {
-            bins[hash_to_bin(item->first)].del(item->first,entryT::WRITELOCK);
+            std::size_t hash = hashfun(item->first);
+            bins[hash_to_bin(hash)].del(item->first,hash,entryT::WRITELOCK);
             item.unset();
         }
 
         void erase(const_accessor& item) {
             item.convert_read_lock_to_write_lock();
-            bins[hash_to_bin(item->first)].del(item->first,entryT::WRITELOCK);
+            std::size_t hash = hashfun(item->first);
+            bins[hash_to_bin(hash)].del(item->first,hash,entryT::WRITELOCK);
             item.unset();
         }
 
         iterator find(const keyT& key) {
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::NOLOCK);
+            std::size_t hash = hashfun(key);
+            int bin = hash_to_bin(hash);
+            entryT* entry = bins[bin].find(key,hash,entryT::NOLOCK);
             if (!entry) return end();
             else return iterator(this,bin,entry);
         }
 
         const_iterator find(const keyT& key) const {
-            int bin = hash_to_bin(key);
-            const entryT* entry = bins[bin].find(key,entryT::NOLOCK);
+            std::size_t hash = hashfun(key);
+            int bin = hash_to_bin(hash);
+            const entryT* entry = bins[bin].find(key,hash,entryT::NOLOCK);
             if (!entry) return end();
             else return const_iterator(this,bin,entry);
         }
 
         bool find(accessor& result, const keyT& key) {
             result.release();
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::WRITELOCK);
+            std::size_t hash = hashfun(key);
+            int bin = hash_to_bin(hash);
+            entryT* entry = bins[bin].find(key,hash,entryT::WRITELOCK);
             bool foundit = entry;
             if (foundit) result.set(entry);
             return foundit;
@@ -544,8 +716,9 @@ namespace madness {
 
         bool find(const_accessor& result, const keyT& key) const {
             result.release();
-            int bin = hash_to_bin(key);
-            entryT* entry = bins[bin].find(key,entryT::READLOCK);
+            std::size_t hash = hashfun(key);
+            int bin = hash_to_bin(hash);
+            entryT* entry = bins[bin].find(key,hash,entryT::READLOCK);
             bool foundit = entry;
             if (foundit) result.set(entry);
             return foundit;
@@ -590,7 +763,7 @@ namespace madness {
             return const_iterator(this,false);
         }
 
-        hashfunT& get_hash() const { return hashfun; }
+        const hashfunT& get_hash() const { return hashfun; }
 
         void print_stats() const {
             for (unsigned int i=0; i<nbins; ++i) {
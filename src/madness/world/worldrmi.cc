@@ -47,19 +47,37 @@
 namespace madness {
 
     std::unique_ptr<RMI::RmiTask> RMI::task_ptr = nullptr;
-    RMIStats RMI::stats;
     bool RMI::debugging = false;
-    std::list< std::unique_ptr<RMISendReq> > RMI::send_req;
+    thread_local std::list< std::unique_ptr<RMISendReq> > RMI::send_req;
 
     bool& RMI::is_server_thread_accessor() {
       static thread_local bool is_server_thread = false;
       return is_server_thread;
     }
 
+    RMI::RmiTask::Shard*& RMI::RmiTask::Shard::current() {
+      static thread_local Shard* shard = nullptr;
+      return shard;
+    }
+
+    void RMI::RmiTask::Shard::clear_send_req() {
+        //std::cout << "clearing server messages " << pthread_self() << std::endl;
+        stats.max_serv_send_q = std::max(stats.max_serv_send_q,uint64_t(send_req.size()));
+        auto it=send_req.begin();
+        while (it != send_req.end()) {
+            if ((*it)->TestAndFree())
+                it = send_req.erase(it);
+            else
+                ++it;
+        }
+    }
+
 
-    void RMI::RmiTask::process_some() {
+    void RMI::RmiTask::Shard::process_some() {
 
         const bool print_debug_info = RMI::debugging;
+        const ProcessID rank = task.rank;
+        const std::size_t maxq_ = task.maxq_;
 
         if (print_debug_info && n_in_q)
             print_error(rank, ":RMI: about to call Testsome with ", n_in_q, " messages in the queue\n");
@@ -93,8 +111,8 @@ namespace madness {
                 const size_t len = status[m].Get_count(MPI_BYTE);
                 const int i = ind[m];
 
-                ++(RMI::stats.nmsg_recv);
-                RMI::stats.nbyte_recv += len;
+                ++(stats.nmsg_recv);
+                stats.nbyte_recv += len;
 
                 const header* h = (const header*)(recv_buf[i]);
                 rmi_handlerT func = archive::to_abs_fn_ptr<rmi_handlerT>(h->func);
@@ -115,7 +133,7 @@ namespace madness {
                 }
                 else {
                   if (print_debug_info)
-                    print_error(rank, ":RMI: enqueing from=", src,
+                    print_error(rank, ":RMI: shard ", id, " enqueing from=", src,
                                 " nbyte=", len, " func=", func,
                                 " ordered=", is_ordered(attr),
                                 " fromcount=", count,
@@ -176,7 +194,9 @@ namespace madness {
         }
     }
 
-    void RMI::RmiTask::post_pending_huge_msg() {
+    void RMI::RmiTask::Shard::post_pending_huge_msg() {
+        const std::size_t nrecv_ = task.nrecv_;
+        SafeMPI::Intracomm& comm = task.comm;
         if (recv_buf[nrecv_]) return;      // Message already pending
         if (!hugeq.empty()) {
             const auto& hugemsg = hugeq.front();
@@ -190,16 +210,17 @@ namespace madness {
             int nada=0;
             // make unique tags to ensure that ack msgs do not collide with normal recv msgs
 #ifdef MADNESS_USE_BSEND_ACKS
-            comm.Bsend(&nada, sizeof(nada), MPI_BYTE, src, tag + unique_tag_period());
+            comm.Bsend(&nada, sizeof(nada), MPI_BYTE, src, tag + RmiTask::unique_tag_period());
 #else
-            comm.Send(&nada, sizeof(nada), MPI_BYTE, src, tag + unique_tag_period());
+            comm.Send(&nada, sizeof(nada), MPI_BYTE, src, tag + RmiTask::unique_tag_period());
 #endif // MADNESS_USE_BSEND_ACKS
         }
     }
 
-    void RMI::RmiTask::post_recv_buf(int i) {
+    void RMI::RmiTask::Shard::post_recv_buf(int i) {
+        const std::size_t nrecv_ = task.nrecv_;
         if (i < (int)nrecv_) {
-            recv_req[i] = comm.Irecv(recv_buf[i], max_msg_len_, MPI_BYTE, MPI_ANY_SOURCE, SafeMPI::RMI_TAG);
+            recv_req[i] = task.comm.Irecv(recv_buf[i], task.max_msg_len_, MPI_BYTE, MPI_ANY_SOURCE, tag);
         }
         else if (i == (int)nrecv_) {
             free(recv_buf[i]);
@@ -221,24 +242,18 @@ namespace madness {
         //for (int i=0; i<nrecv_; ++i) free(recv_buf[i]);
     }
 
-    static std::atomic<bool> rmi_task_is_running = false;
+    static std::atomic<int> rmi_task_is_running = 0; // No. of shards running
 
     RMI::RmiTask::RmiTask(const SafeMPI::Intracomm& _comm)
             : comm(_comm.Clone())
             , nproc(comm.Get_size())
             , rank(comm.Get_rank())
-            , finished(false)
             , send_counters(new counterT[nproc])
-            , recv_counters(new counterT[nproc])
             , max_msg_len_(DEFAULT_MAX_MSG_LEN)
             , nrecv_(DEFAULT_NRECV)
             , maxq_(DEFAULT_NRECV + 1)
-            , recv_buf()
-            , recv_req()
-            , status()
-            , ind()
-            , q()
-            , n_in_q(0)
+            , shards()
+            , next_shard(0)
     {
         // Get the maximum buffer size from the MAD_BUFFER_SIZE environment
         // variable.
@@ -310,30 +325,74 @@ namespace madness {
             }
         }
 
-        // Allocate memory for receive buffer and requests
-        recv_buf.reset(new void*[maxq_]);
-        recv_req.reset(new Request[maxq_]);
+        // Get the number of server threads from the MAD_RMI_SHARDS
+        // environment variable ... all processes must agree so use the
+        // largest value.
+        int nshard = 1;
+        const char* mad_rmi_shards = getenv("MAD_RMI_SHARDS");
+        if (mad_rmi_shards) {
+            std::stringstream ss(mad_rmi_shards);
+            ss >> nshard;
+            if (nshard < 1) nshard = 1;
+            if (nshard > MAX_NSHARD) {
+                nshard = MAX_NSHARD;
+                print_error("!!! WARNING: MAD_RMI_SHARDS must be at most ", MAX_NSHARD, ".\n");
+            }
+        }
+        if (nproc > 1) {
+            int nshard_max = nshard;
+            comm.Allreduce(&nshard, &nshard_max, 1, MPI_INT, MPI_MAX);
+            nshard = nshard_max;
+        }
 
-        // Initialize the send/recv counts
+        // Initialize the send counts
         std::fill_n(send_counters.get(), nproc, 0);
-        std::fill_n(recv_counters.get(), nproc, 0);
 
-        // Allocate buffers for message tracking
-        status.reset(new SafeMPI::Status[maxq_]);
-        ind.reset(new int[maxq_]);
-        q.reset(new qmsg[maxq_]);
+        for (int s = 0; s < nshard; ++s) shards.emplace_back(new Shard(*this, s));
+    }
+
+    RMI::RmiTask::Shard::Shard(RmiTask& task, int id)
+            : task(task)
+            , id(id)
+            , tag(id == 0 ? SafeMPI::RMI_TAG : SafeMPI::RMI_SHARD_TAG + id)
+            , hugeq()
+            , finished(false)
+            , recv_counters(new counterT[task.nproc])
+            , recv_buf(new void*[task.maxq_])
+            , recv_req(new Request[task.maxq_])
+            , status(new SafeMPI::Status[task.maxq_])
+            , ind(new int[task.maxq_])
+            , q(new qmsg[task.maxq_])
+            , n_in_q(0)
+            , stats()
+    {
+        // Initialize the recv counts
+        std::fill_n(recv_counters.get(), task.nproc, 0);
 
         // Allocate receive buffers
-        if(nproc > 1) {
-            for(int i = 0; i < (int)nrecv_; ++i) {
-                if(posix_memalign(&recv_buf[i], ALIGNMENT, max_msg_len_))
+        if(task.nproc > 1) {
+            for(int i = 0; i < (int)task.nrecv_; ++i) {
+                if(posix_memalign(&recv_buf[i], ALIGNMENT, task.max_msg_len_))
                     MADNESS_EXCEPTION("RMI:initialize:failed allocating aligned recv buffer", 1);
                 post_recv_buf(i);
             }
-            recv_buf[nrecv_] = 0;
+            recv_buf[task.nrecv_] = 0;
         }
     }
 
+    void RMI::RmiTask::start() {
+#if HAVE_INTEL_TBB
+        for (auto& shard : shards) {
+            Shard* p = shard.get();
+            ThreadPool::tbb_arena->enqueue([p]{
+                p->run();
+            });
+        }
+#else
+        for (auto& shard : shards) shard->start();
+#endif // HAVE_INTEL_TBB
+    }
+
 
     void RMI::RmiTask::huge_msg_handler(void *buf, size_t /*nbytein*/) {
         const size_t* info = (size_t *)(buf);
@@ -341,6 +400,8 @@ namespace madness {
         const int src = info[nword];
         const size_t nbyte = info[nword+1];
         const int tag = info[nword+2];
+        Shard* shard = Shard::current();
+        MADNESS_ASSERT(shard);
 
         // extra dose of paranoia: assert that we never process so many huge messages
         // that the tag wraparound somewhere becomes possible ...
@@ -348,11 +409,11 @@ namespace madness {
         // AND it has enough threads to use up all tags
         // NB list::size() is O(1) in c++11, but O(N) in older libstdc++
         bool OK = (ThreadPool::size() < size_t(RMI::RmiTask::unique_tag_period()) ||
-                   RMI::task_ptr->hugeq.size() <
-                   std::size_t(RMI::RmiTask::unique_tag_period() / RMI::task_ptr->comm.Get_size()));
+                   shard->hugeq.size() <
+                   std::size_t(RMI::RmiTask::unique_tag_period() / shard->task.nproc));
         if (!OK) MADNESS_EXCEPTION("huge_msg_handler paranoid test failing", RMI::RmiTask::unique_tag_period());
-        RMI::task_ptr->hugeq.push_back(std::make_tuple(src, nbyte, tag));
-        RMI::task_ptr->post_pending_huge_msg();
+        shard->hugeq.push_back(std::make_tuple(src, nbyte, tag));
+        shard->post_pending_huge_msg();
     }
 
     namespace detail {
@@ -404,38 +465,41 @@ namespace madness {
             MADNESS_ASSERT(task_ptr == nullptr);
             task_ptr.reset(new RmiTask(comm));
 
-#if HAVE_INTEL_TBB
-            ThreadPool::tbb_arena->enqueue([]{
-                task_ptr->run();
-            });
+            task_ptr->start();
 
+#if HAVE_INTEL_TBB
             //TODO: is it needed ?
             task_ptr->comm.Barrier();
 
-            while (!rmi_task_is_running) {
+            while (rmi_task_is_running < int(task_ptr->shards.size())) {
               myusleep(100000);
             }
-#else
-            task_ptr->start();
 #endif // HAVE_INTEL_TBB
         }
 
 
     void RMI::RmiTask::set_rmi_task_is_running(bool flag) {
-        rmi_task_is_running = flag; // Yipeeeeeeeeeeeeeeeeeeeeee ... fighting TBB laziness
+        rmi_task_is_running += flag ? 1 : -1; // Yipeeeeeeeeeeeeeeeeeeeeee ... fighting TBB laziness
     }
 
     RMI::Request
-    RMI::RmiTask::RmiTask::isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr) {
+    RMI::RmiTask::isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr) {
+        return isend(buf, nbyte, dest, func, attr, shard_of(attr));
+    }
+
+    RMI::Request
+    RMI::RmiTask::isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr, int shard) {
 
         MADNESS_ASSERT(nbyte <= std::numeric_limits<int>::max());
 
-        int tag = SafeMPI::RMI_TAG;
+        int tag = shards[shard]->tag;
         static std::size_t numsent = 0; // for tracking synchronous sends
 
         if (nbyte > max_msg_len_) {
             // Huge message protocol ... send message to dest indicating size and origin of huge message.
             // Remote end posts a buffer then acks the request.  This end can then send.
+            // The request goes to the same shard as the message would so that
+            // the message is received in its ordering domain.
             const int nword = HEADER_LEN/sizeof(size_t);
             size_t info[nword+3];
             info[nword  ] = rank;
@@ -446,7 +510,7 @@ namespace madness {
             int ack;
             // make unique tags to ensure that ack msgs do not collide with normal recv msgs
             Request req_ack = comm.Irecv(&ack, sizeof(ack), MPI_BYTE, dest, tag + unique_tag_period());
-            Request req_send = isend(info, sizeof(info), dest, RMI::RmiTask::huge_msg_handler, ATTR_UNORDERED);
+            Request req_send = isend(info, sizeof(info), dest, RMI::RmiTask::huge_msg_handler, ATTR_UNORDERED, shard);
 
             MutexWaiter waiter;
             while (!req_send.Test()) waiter.wait();
@@ -459,7 +523,7 @@ namespace madness {
 
         if (RMI::debugging)
           print_error(rank, ":RMI: sending buf=", buf, " nbyte=", nbyte,
-                      " dest=", dest, " func=", func,
+                      " dest=", dest, " shard=", shard, " func=", func,
                       " ordered=", is_ordered(attr),
                       " count=", int(send_counters[dest]), "\n");
 
@@ -479,8 +543,9 @@ namespace madness {
         h->func = archive::to_rel_fn_ptr(func);
         h->attr = attr;
 
-        ++(RMI::stats.nmsg_sent);
-        RMI::stats.nbyte_sent += nbyte;
+        RMIStats& stats = shards[shard]->stats;
+        ++(stats.nmsg_sent);
+        stats.nbyte_sent += nbyte;
 
 
         numsent++;
@@ -509,6 +574,26 @@ namespace madness {
         return result;
     }
 
+    RMIStats RMI::get_stats() {
+        RMIStats result;
+        if (!task_ptr) return result;
+        for (const auto& shard : task_ptr->shards) {
+            const RMIStats& s = shard->stats;
+            result.nmsg_sent += s.nmsg_sent;
+            result.nbyte_sent += s.nbyte_sent;
+            result.nmsg_recv += s.nmsg_recv;
+            result.nbyte_recv += s.nbyte_recv;
+            result.max_serv_send_q = std::max(result.max_serv_send_q, s.max_serv_send_q);
+        }
+        return result;
+    }
+
+    RMIStats RMI::get_stats(int shard) {
+        MADNESS_ASSERT(shard >= 0 && shard < nshard());
+        if (!task_ptr) return RMIStats();
+        return task_ptr->shards[shard]->stats;
+    }
+
   int RMI::testsome_backoff_us = 2;
 
 } // namespace madness
@@ -41,13 +41,16 @@
 #include <list>
 #include <memory>
 #include <tuple>
+#include <vector>
+#include <atomic>
 #include <pthread.h>
 #include <madness/world/print.h>
 
 /*
-  There is just one server thread and it is the only one
-  messing with the recv buffers, so there is no need for
-  mutex on recv related data.
+  There is by default one server thread (more may be requested with
+  MAD_RMI_SHARDS, each receiving its own share of the messages) and
+  it is the only one messing with its recv buffers, so there is no
+  need for mutex on recv related data.
 
   Multiple threads (including the server) may send hence
   we need to be careful about send-related data.
@@ -57,7 +60,7 @@
 
   This RMI service operates only in (a clone of) COMM_WORLD.  It easy enough
   to extend to other communicators but the point is to have
-  only one server thread for all possible uses.  You just
+  only one set of server threads for all possible uses.  You just
   have to translate rank_in_comm into rank_in_world by
   getting the groups from both communicators using
   MPI_Comm_group and then creating a map from ranks in
@@ -79,10 +82,10 @@
   (right now it is a SafeMPI::Request but this is not guaranteed)
 
   void RMI::begin()
-  - to start the server thread
+  - to start the server threads
 
   void RMI::end()
-  - to terminate the server thread
+  - to terminate the server threads
 
   bool RMI::get_debug()
   - to get the debug flag
@@ -143,7 +146,7 @@ namespace madness {
         virtual ~RMISendReq() {} // ESSENTIAL!!
     };
 
-    /// This class implements the communications server thread and provides the only send interface
+    /// This class implements the communications server threads and provides the only send interface
     class RMI  {
         typedef uint16_t counterT;
         typedef uint32_t attrT;
@@ -167,30 +170,12 @@ namespace madness {
         static void set_this_thread_is_server(bool flag = true) { is_server_thread_accessor() = flag;}
         static bool get_this_thread_is_server() {return is_server_thread_accessor();}
 
-        static std::list< std::unique_ptr<RMISendReq> > send_req; // List of outstanding world active messages sent by the server
+        /// List of outstanding world active messages sent by a server thread ... each server thread has its own
+        static thread_local std::list< std::unique_ptr<RMISendReq> > send_req;
 
     private:
 
-        static void clear_send_req() {
-            //std::cout << "clearing server messages " << pthread_self() << std::endl;
-            stats.max_serv_send_q = std::max(stats.max_serv_send_q,uint64_t(send_req.size()));
-            auto it=send_req.begin();
-            while (it != send_req.end()) {
-                if ((*it)->TestAndFree()) 
-                    it = send_req.erase(it);
-                else 
-                    ++it;
-            }
-        }
-
-        class RmiTask
-#if HAVE_INTEL_TBB
-                : private madness::Mutex
-#else
-                : public madness::ThreadBase, private madness::Mutex
-#endif // HAVE_INTEL_TBB
-        {
-
+        class RmiTask : private madness::Mutex {
         public:
 
             struct header {
@@ -198,83 +183,127 @@ namespace madness {
                 attrT attr;
             }; // struct header
 
-            /// q of huge messages, each msg = {source,nbytes,tag}
-            std::list< std::tuple<int,size_t,int> > hugeq;
+            /// One server thread with its own recv buffers and ordering domain
+
+            /// Only this thread touches its recv buffers, queues and counters,
+            /// so there is no need for a mutex on recv related data.  Ordered
+            /// messages from a given source always arrive at the same shard
+            /// (see RmiTask::shard_of()) which thus sees them all in order.
+            class Shard
+#if HAVE_INTEL_TBB
+                    {
+#else
+                    : public madness::ThreadBase {
+#endif // HAVE_INTEL_TBB
+            public:
+                RmiTask& task;              // The task that owns this shard
+                const int id;               // Index of this shard
+                const int tag;              // Tag of the messages received by this shard
+
+                /// q of huge messages, each msg = {source,nbytes,tag}
+                std::list< std::tuple<int,size_t,int> > hugeq;
+
+                std::atomic<bool> finished;     // True if finished ... atomic seems preferable to volatile
+                std::unique_ptr<counterT[]> recv_counters;
+                std::unique_ptr<void*[]> recv_buf; // Will be at least ALIGNMENT aligned ... +1 for huge messages
+                std::unique_ptr<SafeMPI::Request[]> recv_req;
+
+                std::unique_ptr<SafeMPI::Status[]> status;
+                std::unique_ptr<int[]> ind;
+                std::unique_ptr<qmsg[]> q;
+                int n_in_q;
+
+                /// Statistics of the messages received by and sent to this shard
+                RMIStats stats;
+
+                Shard(RmiTask& task, int id);
+
+                /// The shard of the calling server thread, or null if it is not a server thread
+                static Shard*& current();
+
+                void process_some();
+                void post_pending_huge_msg();
+                void post_recv_buf(int i);
+                void clear_send_req();
+
+#if HAVE_INTEL_TBB
+                void run() {
+                    current() = this;
+                    set_rmi_task_is_running(true);
+                    RMI::set_this_thread_is_server(true);
+                    while (! finished) process_some();
+                    RMI::set_this_thread_is_server(false);
+                    set_rmi_task_is_running(false);
+                    finished = false;  // to ensure that RmiTask::exit() that
+                                       // triggered the exit proceeds to completion
+                }
+#else
+                void run() {
+                    current() = this;
+                    RMI::set_this_thread_is_server(true);
+                    try {
+                        while (! finished) process_some();
+                        finished = false;
+                    } catch(...) {
+                        RMI::set_this_thread_is_server(false);
+                        throw;
+                    }
+                    RMI::set_this_thread_is_server(false);
+                }
+#endif // HAVE_INTEL_TBB
+
+                void exit() {
+                    // Set finished flag
+                    finished = true;
+                    while(finished)
+                        myusleep(1000);
+                }
+            }; // class Shard
 
             SafeMPI::Intracomm comm;
             const int nproc;            // No. of processes in comm world
             const ProcessID rank;       // Rank of this process
-            std::atomic<bool> finished;     // True if finished ... atomic seems preferable to volatile
             std::unique_ptr<counterT[]> send_counters; // used to be volatile but no need
-            std::unique_ptr<counterT[]> recv_counters;
             std::size_t max_msg_len_;
             std::size_t nrecv_;
             long nssend_;
             std::size_t maxq_;
-            std::unique_ptr<void*[]> recv_buf; // Will be at least ALIGNMENT aligned ... +1 for huge messages
-            std::unique_ptr<SafeMPI::Request[]> recv_req;
-
-            std::unique_ptr<SafeMPI::Status[]> status;
-            std::unique_ptr<int[]> ind;
-            std::unique_ptr<qmsg[]> q;
-            int n_in_q;
+            std::vector< std::unique_ptr<Shard> > shards;
+            std::atomic<unsigned int> next_shard; // Round-robins unordered messages over the shards
 
             static inline bool is_ordered(attrT attr) { return attr & ATTR_ORDERED; }
 
-            void process_some();
-
             RmiTask(const SafeMPI::Intracomm& comm = SafeMPI::COMM_WORLD);
             virtual ~RmiTask();
 
             static void set_rmi_task_is_running(bool flag = true);
 
-#if HAVE_INTEL_TBB
-            void run() {
-                set_rmi_task_is_running(true);
-                RMI::set_this_thread_is_server(true);
-
-                while (! finished) process_some();
-
-                RMI::set_this_thread_is_server(false);
-                set_rmi_task_is_running(false);
-
-                finished = false;  // to ensure that RmiTask::exit() that
-                                   // triggered the exit proceeds to completion
-            }
-#else
-            void run() {
-                RMI::set_this_thread_is_server(true);
-                try {
-                    while (! finished) process_some();
-                    finished = false;
-                } catch(...) {
-                    delete this;
-                    RMI::set_this_thread_is_server(false);
-                    throw;
-                }
-                RMI::set_this_thread_is_server(false);
-            }
-#endif // HAVE_INTEL_TBB
+            /// Start the server threads
+            void start();
 
             void exit() {
                 if (debugging)
-                  print_error(rank, ":RMI: sending exit request to server thread\n");
-
-                // Set finished flag
-                finished = true;
-                while(finished)
-                    myusleep(1000);
+                  print_error(rank, ":RMI: sending exit request to server threads\n");
+                for (auto& shard : shards) shard->exit();
             }
 
             static void huge_msg_handler(void *buf, size_t nbytein);
 
             Request isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr);
 
-            void post_pending_huge_msg();
-
-            void post_recv_buf(int i);
-
         private:
+            /// The shard at \c dest that receives a message
+
+            /// All ordered messages from this process go to the same shard at
+            /// any destination, the others are spread round-robin.
+            int shard_of(attrT attr) {
+                const int n = shards.size();
+                if (n == 1) return 0;
+                if (is_ordered(attr)) return rank % n;
+                return next_shard++ % n;
+            }
+
+            Request isend(const void* buf, size_t nbyte, ProcessID dest, rmi_handlerT func, attrT attr, int shard);
 
             /// thread-safely round-robins through tags in [first_tag, first_tag+period) range
             /// @returns new tag to be used in messaging
@@ -282,16 +311,14 @@ namespace madness {
             /// the period of tags returned by unique_tag()
             /// @warning this bounds how many huge messages each RmiTask will be able to process
             static constexpr int unique_tag_period() { return 2048; }
-
         }; // class RmiTask
 
-
         static std::unique_ptr<RmiTask> task_ptr;    // Pointer to the singleton instance
-        static RMIStats stats;
         static bool debugging;    // True if debugging ... used to be volatile but no need
 
         static const size_t DEFAULT_MAX_MSG_LEN = 3*512*1024;  //!< the default size of recv buffers, in bytes; the actual size can be configured by the user via envvar MAD_BUFFER_SIZE
         static const int DEFAULT_NRECV = 128;  //!< the default # of recv buffers; the actual number can be configured by the user via envvar MAD_RECV_BUFFERS
+        static const int MAX_NSHARD = 64;  //!< the largest # of server threads, see SafeMPI::RMI_SHARD_TAG
 
         // Not allowed
         RMI(const RMI&);
@@ -313,9 +340,9 @@ namespace madness {
             return task_ptr->maxq_;
         }
 
-        /// Returns the number of recv buffers
+        /// Returns the number of recv buffers of each server thread
 
-        /// @return The number of recv buffers
+        /// @return The number of recv buffers of each server thread
         /// @note The default value is given by RMI::DEFAULT_NRECV, can be overridden at runtime by the user via environment variable MAD_RECV_BUFFERS
         /// @warning Cannot be smaller than 32.
         static std::size_t nrecv() {
@@ -323,6 +350,16 @@ namespace madness {
             return task_ptr->nrecv_;
         }
 
+        /// Returns the number of server threads (receive shards)
+
+        /// @return The number of server threads, each with its own recv buffers
+        /// @note The default is 1, can be overridden at runtime by the user via
+        /// environment variable MAD_RMI_SHARDS (at most RMI::MAX_NSHARD).  The
+        /// largest value over the processes is used by all of them.
+        static int nshard() {
+            return task_ptr ? int(task_ptr->shards.size()) : 1;
+        }
+
         /// Send a remote method invocation (again you should probably be looking at worldam.h instead)
 
         /// @param[in] buf Pointer to the data buffer (do not modify until send is completed)
@@ -344,6 +381,7 @@ namespace madness {
 
         /// will complain to std::cerr and throw if ASLR is on by making
         /// sure that address of this function matches across @p comm
+
         /// @param[in] comm the communicator
         static void assert_aslr_off(const SafeMPI::Intracomm& comm = SafeMPI::COMM_WORLD);
 
@@ -361,7 +399,15 @@ namespace madness {
 
         static bool get_debug() { return debugging; }
 
-        static const RMIStats& get_stats() { return stats; }
+        /// Message statistics summed over the server threads
+        static RMIStats get_stats();
+
+        /// Message statistics of one server thread
+
+        /// The sent counts are of the messages sent to this shard of the
+        /// destinations, the recv counts of those received by it.
+        /// @param[in] shard index of the shard in [0,nshard())
+        static RMIStats get_stats(int shard);
     }; // class RMI
 
 } // namespace madness
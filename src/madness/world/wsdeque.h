@@ -0,0 +1,176 @@
+/*
+  This file is part of MADNESS.
+
+  Copyright (C) 2007,2010 Oak Ridge National Laboratory
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+  For more information please contact:
+
+  Robert J. Harrison
+  Oak Ridge National Laboratory
+  One Bethel Valley Road
+  P.O. Box 2008, MS-6367
+
+  email: harrisonrj@ornl.gov
+  tel:   865-241-3937
+  fax:   865-572-0680
+*/
+
+#ifndef MADNESS_WORLD_WSDEQUE_H__INCLUDED
+#define MADNESS_WORLD_WSDEQUE_H__INCLUDED
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <madness/world/madness_exception.h>
+
+/// \file wsdeque.h
+/// \brief Implements WSDeque, a lock-free work-stealing deque
+
+namespace madness {
+
+    /// A lock-free, fixed capacity work-stealing deque of pointers.
+
+    /// This is the Chase-Lev deque in the formulation of Le, Pop, Cohen and
+    /// Zappa Nardelli (PPoPP 2013) for weakly ordered memory.  Exactly one
+    /// thread (the owner) may call push() and pop(), which operate on the
+    /// bottom of the deque in LIFO order.  Any thread may call steal(), which
+    /// takes the oldest element from the top.
+    ///
+    /// Unlike DQueue the capacity does not grow.  If push() fails the caller
+    /// is expected to put the element elsewhere (ThreadPool uses the global
+    /// DQueue as overflow).
+    template <typename T>
+    class WSDeque {
+        static_assert(std::is_pointer<T>::value, "WSDeque can only hold pointers");
+
+        const std::int64_t mask;                    ///< capacity-1
+        std::unique_ptr<std::atomic<T>[]> buf;      ///< circular buffer
+        alignas(64) std::atomic<std::int64_t> top;  ///< next element to steal
+        alignas(64) std::atomic<std::int64_t> bottom; ///< next free slot of the owner
+        alignas(64) std::atomic<std::uint64_t> nsteal; ///< #elements taken by other threads
+        std::uint64_t npush;                        ///< #calls to push, owner only
+        std::uint64_t npop;                         ///< #successful calls to pop, owner only
+        std::uint64_t noverflow;                    ///< #failed calls to push, owner only
+
+    public:
+        /// Construct an empty deque with capacity 2^log2capacity
+        explicit WSDeque(unsigned int log2capacity=14)
+            : mask((std::int64_t(1)<<log2capacity)-1)
+            , buf(new std::atomic<T>[std::size_t(1)<<log2capacity])
+            , top(0), bottom(0), nsteal(0), npush(0), npop(0), noverflow(0) {
+            if (log2capacity>30) MADNESS_EXCEPTION("WSDeque: capacity too large",log2capacity);
+        }
+
+        WSDeque(const WSDeque&) = delete;
+        WSDeque& operator=(const WSDeque&) = delete;
+
+        /// Push a value onto the bottom ... owner only
+
+        /// \return false if the deque is full and the value was not inserted
+        bool push(T value) {
+            const std::int64_t b = bottom.load(std::memory_order_relaxed);
+            const std::int64_t t = top.load(std::memory_order_acquire);
+            if (b-t > mask) {
+                ++noverflow;
+                return false;
+            }
+            buf[b & mask].store(value, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b+1, std::memory_order_relaxed);
+            ++npush;
+            return true;
+        }
+
+        /// Pop the most recently pushed value off the bottom ... owner only
+
+        /// \return the value or nullptr if the deque is empty
+        T pop() {
+            const std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t t = top.load(std::memory_order_relaxed);
+            T value = nullptr;
+            if (t <= b) {
+                value = buf[b & mask].load(std::memory_order_relaxed);
+                if (t == b) {
+                    // Last element ... race against thieves
+                    if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+                                                     std::memory_order_relaxed))
+                        value = nullptr;
+                    bottom.store(b+1, std::memory_order_relaxed);
+                }
+            }
+            else {
+                bottom.store(b+1, std::memory_order_relaxed);
+            }
+            if (value) ++npop;
+            return value;
+        }
+
+        /// Steal the oldest value off the top ... any thread
+
+        /// \return the value or nullptr if the deque is empty or another thread won the race
+        T steal() {
+            std::int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const std::int64_t b = bottom.load(std::memory_order_acquire);
+            if (t < b) {
+                T value = buf[t & mask].load(std::memory_order_relaxed);
+                if (!top.compare_exchange_strong(t, t+1, std::memory_order_seq_cst,
+                                                 std::memory_order_relaxed))
+                    return nullptr;
+                nsteal.fetch_add(1, std::memory_order_relaxed);
+                return value;
+            }
+            return nullptr;
+        }
+
+        /// Approximate number of elements ... exact only if called by the owner with no concurrent thieves
+        std::size_t size() const {
+            const std::int64_t b = bottom.load(std::memory_order_relaxed);
+            const std::int64_t t = top.load(std::memory_order_relaxed);
+            return (b>t) ? std::size_t(b-t) : 0;
+        }
+
+        /// Approximate test for emptiness
+        bool empty() const {
+            return size()==0;
+        }
+
+        /// The capacity of the deque
+        std::size_t capacity() const {
+            return std::size_t(mask+1);
+        }
+
+        /// #calls to push that inserted a value
+        std::uint64_t get_npush() const {return npush;}
+
+        /// #values popped by the owner
+        std::uint64_t get_npop() const {return npop;}
+
+        /// #values stolen by other threads
+        std::uint64_t get_nsteal() const {return nsteal.load(std::memory_order_relaxed);}
+
+        /// #calls to push that failed since the deque was full
+        std::uint64_t get_noverflow() const {return noverflow;}
+    };
+
+}  // namespace madness
+
+#endif // MADNESS_WORLD_WSDEQUE_H__INCLUDED